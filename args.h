@@ -1,6 +1,12 @@
 #ifndef ARGS_H
 #define ARGS_H
 
+#include "stats.h"
+#include "mem.h"
+#include "log.h"
+#include "progress.h"
+#include "bitmap.h"
+#include "blocksig.h"
 #include <stdint.h>
 
 #define MAGIC_LCP_FA_CONSTANT 2.20  // the constant reduction of cores is 2.33 but to be 
@@ -9,16 +15,29 @@
 #define MAGIC_LCP_FQ_CONSTANT 2.00  // the constant reduction of cores is 1.5 but to be 
                                     // more efficient, it is selected higher than that
 
-typedef enum {
-    INFO,
-    WARN,
-    ERROR
-} LogLevel;
+#define STDIN_INPUT "-"             // input name that reads from standard input
+#define STREAM_INITIAL_CORES 65536  // initial core capacity of inputs of unknown size
+
+#define PARTITION_SAMPLES 64        // keys sampled per bucket to pick the bucket boundaries of --partitions
+#define PARALLEL_PAIR_CORES 4194304 // cores of a partitioned pair above which its buckets are merged by
+                                    // several threads, smaller pairs do not pay for the task group
+#define CC_HIST_BINS 1024           // core counts of the abundance histogram, higher counts share the last bin
+#define AUTO_MAX_CC_FACTOR 10       // max-cc picked by --auto-cc, as a multiple of the coverage peak
+#define AUTO_MIN_SOLID 0.5          // share of the core occurrences at or above the trough for it to be
+                                    // trusted, not to take noise in the tail of shallow samples for it
+
+#ifndef COMPRESSION_RATIO
+#define COMPRESSION_RATIO 4         // typical compression ratio of gzipped inputs
+#endif
 
 typedef enum {
     FA,
     FQ,
-    LOAD
+    LOAD,
+    SERVE,
+    MERGE,
+    SKETCH,
+    DIST
 } program_mode;
 
 typedef enum {
@@ -28,26 +47,83 @@ typedef enum {
 
 typedef uint64_t simple_core; // first 32 bits are ulabel, last 32 is length of the core
 
+typedef enum {
+    KEY_CORE,  // 64 bits: label and length of the core (simple_core)
+    KEY_LABEL, // 32 bits: label of the core
+    KEY_HASH   // 32 bits: hash of the label and the length of the core
+} key_type;
+
+/**
+ * @brief Bytes of a key of the given type in a cores array.
+ */
+static inline size_t key_size(key_type key) {
+    return key == KEY_CORE ? sizeof(simple_core) : sizeof(uint32_t);
+}
+
+/**
+ * @brief Name of a key type, as given with `--key`.
+ */
+static inline const char *key_name(key_type key) {
+    return key == KEY_CORE ? "core" : key == KEY_LABEL ? "label" : "hash";
+}
+
+struct coredict;
+
 struct pargs {
     program_mode mode;
+    program_mode input_mode; // FA, FQ or LOAD, the inputs the signatures are generated from
     int thread_number;
     char *prefix;
     int number_of_genomes;
+    int pin; // 1: pin workers to cpus over NUMA nodes, 0: false
+    char *stats_file; // NULL if statistics are not written
+    int progress_interval; // seconds between progress reports, 0 if not reported
+    char *status_file; // NULL if progress is not written to a file
+    char *db_file; // signature database written by fa/fq and served by serve, NULL if none
+    char *socket_path; // Unix socket the server listens on
+    int shard_index; // 1-based distance shard computed by this run, 0 if not sharded
+    int shard_count;
+    char *shard_list; // file listing the shard blocks merged by merge
+    int verbose;
 };
 
 struct gargs {
     int apply_filter;
     uint32_t min_cc;
     uint32_t max_cc;
+    int auto_cc; // 1: min_cc and max_cc are picked from the core abundance histogram
+    uint32_t fallback_min_cc; // thresholds given for --auto-cc, kept if the histogram has no trough
+    uint32_t fallback_max_cc;
+    uint64_t *cc_hist; // distinct cores by their count, CC_HIST_BINS bins, NULL if not built
     char *inFileName;
     char *shortName;
     char *outFileName;
+    char *cache_dir; // NULL if signature cache is disabled
     uint64_t cores_len;
-    simple_core *cores;
+    uint64_t cores_capacity; // number of cores the array can hold
+    void *cores; // keys of key_size(key) bytes, sorted after genSign
+    key_type key;
+    uint64_t core_bases; // summed lengths of all cores produced, for keys without lengths
     double total_len;
+    int failed; // 1: the signature could not be generated completely, the reason is logged
+    struct coredict *dict; // dictionary the signature is encoded with, NULL to keep the keys
+    struct bitmap ids; // dictionary IDs of the cores, replacing the keys if dict is set
+    int compress; // 1: the signature is compressed into blocks, replacing the keys
+    struct blocksig blocks;
+    uint32_t partitions; // buckets of the signature by the high bits of the keys, 1 if not partitioned
+    uint64_t *partition_offsets; // first key of every bucket and the length, NULL if not partitioned
+    // scheduling
+    uint64_t work_estimate; // estimated uncompressed input size in bytes
+    double work_seconds; // time spent processing the genome
+    int numa_node; // node the signature was allocated on, -1 if unknown
+    struct gstats stats;
+    struct memtrack mem; // tracked bytes of the sequence and core buffers
     // other
     sim_calculation_type sct;
     int lcp_level;
+    uint64_t lcp_window; // bases per LCP window of long sequences, 0 to process them at once
+    uint64_t n_split; // minimum length of the N runs sequences are split at, 0 not to split
+    int drop_masked; // skip soft-masked (lowercase) regions
     int write_lcpt; // 1: true, 0: false
     int verbose;  // 1: true, 0: false
 };
@@ -0,0 +1,233 @@
+/**
+ * @file kernel_bench.c
+ * @brief Microbenchmarks for the signature and distance kernels.
+ *
+ * Every benchmark is repeated and the fastest repetition is reported as
+ * tab-separated values:
+ *
+ *     bench  params  seconds  rate  unit
+ *
+ * - `calcUISize`: intersection/union of two sorted signatures sharing half
+ *                 of their cores.
+ * - `sort`:       genSign without filtering on random cores.
+ * - `genSign`:    genSign with min/max core count filtering.
+ *
+ * The three kernels above run with 64-bit core keys and again with 32-bit
+ * label keys (`key=label` in the params). `calcUISize` also runs on the
+ * bitmaps of signatures encoded with a core dictionary (`dict` in the params)
+ * and on block-compressed signatures (`compress`), and on signatures split
+ * into buckets merged one after another (`partitions=P`), with uniform and
+ * with dense labels (`labels=dense`) as lcptools assigns them.
+ * - `partitionBalance`: largest bucket of the partitioned signatures as a
+ *                 multiple of the mean bucket (`max/mean` in the rate).
+ * - `read_fasta`: signature of a FASTA file (parsing, LCP and genSign).
+ * - `read_fastq`: signature of a FASTQ file.
+ *
+ * Usage: ./kernel_bench <fasta> <fastq> [cores] [repeats] [lcp_level]
+ */
+
+#include "../args.h"
+#include "../utils.h"
+#include "../rfasta.h"
+#include "../rfastq.h"
+#include <time.h>
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t state = 42;
+
+static uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+static void init_genome(struct gargs *g, const char *filename, int lcp_level, key_type key) {
+    memset(g, 0, sizeof(struct gargs));
+    g->key = key;
+    g->inFileName = (char *)filename;
+    g->shortName = (char *)filename;
+    g->lcp_level = lcp_level;
+    g->min_cc = 2;
+    g->max_cc = 255;
+    g->sct = SET;
+    g->numa_node = -1;
+}
+
+static void release_genome(struct gargs *g) {
+    mem_free(&(g->mem), g->cores, g->cores_capacity * key_size(g->key));
+    bitmap_free(&(g->ids), &(g->mem));
+    blocksig_free(&(g->blocks), &(g->mem));
+    mem_free(&(g->mem), g->partition_offsets, (g->partitions + 1) * sizeof(uint64_t));
+    g->partition_offsets = NULL;
+    g->cores = NULL;
+    g->cores_len = 0;
+    g->cores_capacity = 0;
+}
+
+static void random_cores(struct gargs *g, uint64_t len, uint64_t range) {
+    g->cores = mem_malloc(&(g->mem), len * key_size(g->key));
+    g->cores_len = len;
+    g->cores_capacity = len;
+    for (uint64_t i=0; i<len; i++) {
+        if (g->key == KEY_CORE)
+            ((simple_core *)g->cores)[i] = ((next() % range) << 32) | (next() & 0xFF);
+        else
+            ((uint32_t *)g->cores)[i] = next() % range;
+    }
+}
+
+static uint64_t file_size(const char *filename) {
+    struct stat st;
+    return stat(filename, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+static void report(const char *bench, const char *params, double seconds, double amount, const char *unit) {
+    printf("%s\t%s\t%.6f\t%.3f\t%s\n", bench, params, seconds, seconds > 0 ? amount / seconds : 0.0, unit);
+}
+
+static const char *key_params(key_type key) {
+    return key == KEY_CORE ? "" : key == KEY_LABEL ? ",key=label" : ",key=hash";
+}
+
+static void report_balance(const char *params, const struct gargs *g, int n) {
+    uint64_t largest = 0, total = 0;
+    for (int i=0; i<n; i++) {
+        for (uint32_t p=0; p<g[i].partitions; p++) {
+            uint64_t size = g[i].partition_offsets[p+1] - g[i].partition_offsets[p];
+            largest = size > largest ? size : largest;
+            total += size;
+        }
+    }
+    double mean = (double)total / (n * g[0].partitions);
+    printf("partitionBalance\t%s\t%.6f\t%.3f\tmax/mean\n", params, 0.0, mean > 0 ? largest / mean : 0.0);
+}
+
+static void bench_calcUISize(uint64_t len, int repeats, key_type key, struct coredict *dict, int compress, uint32_t partitions, uint64_t range) {
+    struct gargs g[2];
+    uint64_t inter = 0, uni = 0;
+    double best = 1e30;
+    char params[96];
+
+    init_genome(&g[0], "a", 0, key);
+    init_genome(&g[1], "b", 0, key);
+    random_cores(&g[0], len, range);
+    random_cores(&g[1], len, range);
+    memcpy(g[1].cores, g[0].cores, len / 2 * key_size(key));
+
+    for (int i=0; i<2; i++) {
+        genSign(&g[i], SET);
+        g[i].dict = dict;
+        g[i].compress = compress;
+        g[i].partitions = partitions;
+        packSign(&g[i]);
+    }
+    if (partitions > 1) {
+        partitionSignatures(g, 2);
+    }
+
+    for (int r=0; r<repeats; r++) {
+        double start = now();
+        calcUISize(&g[0], &g[1], &inter, &uni);
+        double elapsed = now() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+
+    snprintf(params, sizeof(params), "cores=%lu%s%s", len, key_params(key), dict != NULL ? ",dict" : compress ? ",compress" : "");
+    if (partitions > 1) {
+        snprintf(params + strlen(params), sizeof(params) - strlen(params), ",partitions=%u%s", partitions, range < UINT32_MAX ? ",labels=dense" : "");
+    }
+    report("calcUISize", params, best, (g[0].cores_len + g[1].cores_len) / 1e6, "Mcores/s");
+    if (partitions > 1) {
+        report_balance(params, g, 2);
+    }
+
+    release_genome(&g[0]);
+    release_genome(&g[1]);
+}
+
+static void bench_genSign(uint64_t len, int repeats, int apply_filter, key_type key) {
+    double best = 1e30;
+    char params[64];
+
+    for (int r=0; r<repeats; r++) {
+        struct gargs g;
+        init_genome(&g, "a", 0, key);
+        g.apply_filter = apply_filter;
+        // a small key range gives the repeated cores the filter works on
+        random_cores(&g, len, apply_filter ? len / 4 : UINT32_MAX);
+
+        double start = now();
+        genSign(&g, SET);
+        double elapsed = now() - start;
+        best = elapsed < best ? elapsed : best;
+
+        release_genome(&g);
+    }
+
+    snprintf(params, sizeof(params), "cores=%lu%s", len, key_params(key));
+    report(apply_filter ? "genSign" : "sort", params, best, len / 1e6, "Mcores/s");
+}
+
+static void bench_reader(const char *bench, thread_func_t reader, const char *filename, int lcp_level, int repeats) {
+    double best = 1e30;
+    char params[64];
+
+    for (int r=0; r<repeats; r++) {
+        struct gargs g;
+        init_genome(&g, filename, lcp_level, KEY_CORE);
+
+        double start = now();
+        reader(&g);
+        double elapsed = now() - start;
+        best = elapsed < best ? elapsed : best;
+
+        release_genome(&g);
+    }
+
+    snprintf(params, sizeof(params), "lcp_level=%d", lcp_level);
+    report(bench, params, best, file_size(filename) / 1048576.0, "MB/s");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <fasta> <fastq> [cores] [repeats] [lcp_level]\n", argv[0]);
+        return 1;
+    }
+
+    uint64_t cores = argc > 3 ? strtoull(argv[3], NULL, 10) : 4000000;
+    int repeats = argc > 4 ? atoi(argv[4]) : 5;
+    int lcp_level = argc > 5 ? atoi(argv[5]) : 4;
+
+    LCP_INIT();
+
+    printf("bench\tparams\tseconds\trate\tunit\n");
+
+    bench_calcUISize(cores, repeats, KEY_CORE, NULL, 0, 1, UINT32_MAX);
+    bench_genSign(cores, repeats, 0, KEY_CORE);
+    bench_genSign(cores, repeats, 1, KEY_CORE);
+    bench_calcUISize(cores, repeats, KEY_LABEL, NULL, 0, 1, UINT32_MAX);
+    bench_genSign(cores, repeats, 0, KEY_LABEL);
+    bench_genSign(cores, repeats, 1, KEY_LABEL);
+
+    // signatures sharing half of their cores, encoded with one dictionary
+    struct coredict dict;
+    coredict_init(&dict);
+    bench_calcUISize(cores, repeats, KEY_CORE, &dict, 0, 1, UINT32_MAX);
+    coredict_free(&dict);
+    bench_calcUISize(cores, repeats, KEY_CORE, NULL, 1, 1, UINT32_MAX);
+    bench_calcUISize(cores, repeats, KEY_LABEL, NULL, 1, 1, UINT32_MAX);
+    bench_calcUISize(cores, repeats, KEY_CORE, NULL, 0, 64, UINT32_MAX);
+    // lcptools labels are dense IDs, a few times fewer than the cores of a genome
+    bench_calcUISize(cores, repeats, KEY_CORE, NULL, 0, 64, cores / 4);
+
+    bench_reader("read_fasta", read_fasta, argv[1], lcp_level, repeats);
+    bench_reader("read_fastq", read_fastq, argv[2], lcp_level, repeats);
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#!/bin/sh
+# Runs the benchmark suite and writes the results as tab-separated values:
+#
+#     bench  params  seconds  rate  unit
+#
+# Synthetic inputs are generated once into bench/data with a fixed seed, so
+# results of different builds are comparable. With -b the results are
+# compared against a previous results file and the script fails if any
+# benchmark got slower than the tolerance allows.
+#
+# Usage: bench/run.sh [-t threads] [-s scale] [-o results.tsv] [-b baseline.tsv] [-x tolerance]
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT_DIR=$(dirname "$BENCH_DIR")
+DATA_DIR="$BENCH_DIR/data"
+
+threads=$(nproc)
+scale=1
+results="$BENCH_DIR/results.tsv"
+baseline=""
+tolerance=0.10
+
+while getopts "t:s:o:b:x:" opt; do
+    case $opt in
+        t) threads=$OPTARG ;;
+        s) scale=$OPTARG ;;
+        o) results=$OPTARG ;;
+        b) baseline=$OPTARG ;;
+        x) tolerance=$OPTARG ;;
+        *) echo "Usage: $0 [-t threads] [-s scale] [-o results.tsv] [-b baseline.tsv] [-x tolerance]" >&2; exit 1 ;;
+    esac
+done
+
+set -e
+
+now() {
+    date +%s.%N
+}
+
+# generate inputs, the scale multiplies the genome length and the read count
+data="$DATA_DIR/scale$scale"
+if [ ! -f "$data/done" ]; then
+    echo "Generating synthetic data in $data" >&2
+    rm -rf "$data"
+    mkdir -p "$data/fa" "$data/fq" "$data/fq.gz"
+    "$BENCH_DIR/synth" fa "$data/fa" 8 $((1000000 * scale)) 2 0.01 42
+    "$BENCH_DIR/synth" fq "$data/fq" 4 $((1000000 * scale)) $((100000 * scale)) 150 0.01 42
+    for f in "$data"/fq/*.fq; do
+        gzip -c "$f" > "$data/fq.gz/$(basename "$f").gz"
+        echo "$data/fq.gz/$(basename "$f").gz" >> "$data/fq.gz/fq.txt"
+    done
+    touch "$data/done"
+fi
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+printf "bench\tparams\tseconds\trate\tunit\n" > "$results"
+
+# kernels
+"$BENCH_DIR/kernel_bench" "$data/fa/g0.fa" "$data/fq/r0.fq" $((4000000 * scale)) | tail -n +2 >> "$results"
+
+# thread pool, renamed to the common columns
+"$BENCH_DIR/tpool_bench" "$threads" | awk -F '\t' 'NR > 1 { printf "tpool.%s\tthreads=%s,tasks=%s\t%s\t%s\tMtasks/s\n", $1, $2, $3, $4, $5 }' >> "$results"
+
+# end-to-end runs
+for input in fa fq fq.gz; do
+    mode=${input%.gz}
+    list="$data/$input/$mode.txt"
+    bytes=$(cat $(cat "$list") | wc -c)
+    start=$(now)
+    "$ROOT_DIR/gencore" "$mode" -i "$list" -t "$threads" -p "$tmp/out" > /dev/null
+    end=$(now)
+    echo "$start $end $bytes" | awk -v bench="gencore.$input" -v params="threads=$threads" \
+        '{ s = $2 - $1; printf "%s\t%s\t%.6f\t%.3f\tMB/s\n", bench, params, s, (s > 0 ? $3 / 1048576 / s : 0) }' >> "$results"
+done
+
+cat "$results"
+
+# compare with the baseline on the seconds of matching benchmarks
+if [ -n "$baseline" ]; then
+    failed=0
+    awk -F '\t' -v tolerance="$tolerance" '
+        FNR == 1 { next }
+        NR == FNR { base[$1 "\t" $2] = $3; next }
+        ($1 "\t" $2) in base {
+            ratio = base[$1 "\t" $2] > 0 ? $3 / base[$1 "\t" $2] : 1
+            status = ratio > 1 + tolerance ? "REGRESSION" : ratio < 1 - tolerance ? "improved" : "ok"
+            failed += status == "REGRESSION"
+            printf "%s\t%s\t%.6f\t%.6f\t%.3f\t%s\n", $1, $2, base[$1 "\t" $2], $3, ratio, status
+        }
+        END { exit failed > 0 }
+    ' "$baseline" "$results" > "$tmp/compare" || failed=1
+    printf "\nbench\tparams\tbaseline\tseconds\tratio\tstatus\n" >&2
+    cat "$tmp/compare" >&2
+    exit $failed
+fi
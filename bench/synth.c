@@ -0,0 +1,223 @@
+/**
+ * @file synth.c
+ * @brief Deterministic synthetic data generator for the benchmarks.
+ *
+ * Genomes are generated in families: every family has a uniformly random
+ * root genome and its members are mutated copies of the root, so that
+ * distances within a family are small and distances across families are
+ * large. Reads are sampled from mutated copies of a single root genome on
+ * both strands, with substitution errors. The same seed always produces
+ * the same files.
+ *
+ * Usage:
+ *     ./synth fa <dir> [genomes] [length] [families] [mutation_rate] [seed]
+ *     ./synth fq <dir> [samples] [length] [reads] [read_length] [error_rate] [seed]
+ *
+ * Files are written as <dir>/g<i>.fa or <dir>/r<i>.fq together with the
+ * list file <dir>/fa.txt or <dir>/fq.txt that can be given to gencore.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LINE_WIDTH 60
+#define CHROMOSOMES 4
+#define INDEL_RATIO 0.2
+
+static const char bases[4] = {'A', 'C', 'G', 'T'};
+
+static uint64_t state;
+
+static int base_index(char c) {
+    return c == 'A' ? 0 : c == 'C' ? 1 : c == 'G' ? 2 : 3;
+}
+
+static uint64_t next() {
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+static double uniform() {
+    return (next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void seed(uint64_t value) {
+    state = value ? value : 0x9E3779B97F4A7C15ULL;
+    for (int i=0; i<8; i++)
+        next();
+}
+
+static char *random_genome(uint64_t length) {
+    char *genome = (char *)malloc(length);
+    if (genome == NULL) {
+        fprintf(stderr, "Could not allocate %lu bytes.\n", length);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i=0; i<length; i++)
+        genome[i] = bases[next() & 3];
+    return genome;
+}
+
+/**
+ * Copies the root with substitutions and single base insertions/deletions,
+ * returning the length of the copy in *out_length.
+ */
+static char *mutate(const char *root, uint64_t length, double rate, uint64_t *out_length) {
+    char *copy = (char *)malloc(length + length / 8 + 16);
+    uint64_t len = 0;
+
+    if (copy == NULL) {
+        fprintf(stderr, "Could not allocate %lu bytes.\n", length);
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint64_t i=0; i<length; i++) {
+        if (uniform() >= rate) {
+            copy[len++] = root[i];
+        } else if (uniform() >= INDEL_RATIO) {
+            copy[len++] = bases[(base_index(root[i]) + 1 + next() % 3) & 3];
+        } else if (next() & 1) {
+            copy[len++] = root[i];
+            copy[len++] = bases[next() & 3];
+        }
+    }
+
+    *out_length = len;
+    return copy;
+}
+
+static FILE *open_output(const char *dir, const char *name) {
+    char filename[4096];
+    snprintf(filename, sizeof(filename), "%s/%s", dir, name);
+
+    FILE *out = fopen(filename, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Could not open %s for writing.\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    return out;
+}
+
+static void write_fasta(FILE *out, const char *genome, uint64_t length) {
+    uint64_t chrom_len = length / CHROMOSOMES;
+
+    for (int c=0; c<CHROMOSOMES; c++) {
+        uint64_t begin = c * chrom_len;
+        uint64_t end = c == CHROMOSOMES-1 ? length : begin + chrom_len;
+
+        fprintf(out, ">chr%d synthetic\n", c+1);
+        for (uint64_t i=begin; i<end; i+=LINE_WIDTH) {
+            fwrite(genome + i, 1, end-i < LINE_WIDTH ? end-i : LINE_WIDTH, out);
+            fputc('\n', out);
+        }
+    }
+}
+
+static void generate_fasta(const char *dir, int genomes, uint64_t length, int families, double rate) {
+    FILE *list = open_output(dir, "fa.txt");
+    char **roots = (char **)malloc(families * sizeof(char *));
+
+    for (int f=0; f<families; f++)
+        roots[f] = random_genome(length);
+
+    for (int i=0; i<genomes; i++) {
+        char name[64];
+        uint64_t len;
+        char *genome = mutate(roots[i % families], length, rate, &len);
+
+        snprintf(name, sizeof(name), "g%d.fa", i);
+        FILE *out = open_output(dir, name);
+        write_fasta(out, genome, len);
+        fclose(out);
+
+        fprintf(list, "%s/%s\n", dir, name);
+        free(genome);
+    }
+
+    for (int f=0; f<families; f++)
+        free(roots[f]);
+    free(roots);
+    fclose(list);
+}
+
+static void generate_fastq(const char *dir, int samples, uint64_t length, uint64_t reads, int read_length, double error_rate) {
+    FILE *list = open_output(dir, "fq.txt");
+    char *root = random_genome(length);
+    char *read = (char *)malloc(read_length + 1);
+    char *quality = (char *)malloc(read_length + 1);
+
+    read[read_length] = '\0';
+    quality[read_length] = '\0';
+
+    for (int s=0; s<samples; s++) {
+        char name[64];
+        uint64_t len;
+        char *genome = mutate(root, length, 0.01 * (s+1), &len);
+
+        snprintf(name, sizeof(name), "r%d.fq", s);
+        FILE *out = open_output(dir, name);
+
+        for (uint64_t r=0; r<reads && len>(uint64_t)read_length; r++) {
+            uint64_t pos = next() % (len - read_length);
+            int reverse = next() & 1;
+
+            for (int i=0; i<read_length; i++) {
+                char c = reverse ? genome[pos+read_length-1-i] : genome[pos+i];
+                if (reverse)
+                    c = bases[3 - base_index(c)];
+                if (uniform() < error_rate) {
+                    c = bases[(base_index(c) + 1 + next() % 3) & 3];
+                    quality[i] = '#' + next() % 10;
+                } else {
+                    quality[i] = '5' + next() % 10;
+                }
+                read[i] = c;
+            }
+
+            fprintf(out, "@read%lu/%d\n%s\n+\n%s\n", r, reverse ? 2 : 1, read, quality);
+        }
+
+        fclose(out);
+        fprintf(list, "%s/%s\n", dir, name);
+        free(genome);
+    }
+
+    free(quality);
+    free(read);
+    free(root);
+    fclose(list);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || (strcmp(argv[1], "fa") && strcmp(argv[1], "fq"))) {
+        fprintf(stderr, "Usage: %s fa <dir> [genomes] [length] [families] [mutation_rate] [seed]\n", argv[0]);
+        fprintf(stderr, "       %s fq <dir> [samples] [length] [reads] [read_length] [error_rate] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "fa") == 0) {
+        int genomes = argc > 3 ? atoi(argv[3]) : 8;
+        uint64_t length = argc > 4 ? strtoull(argv[4], NULL, 10) : 1000000;
+        int families = argc > 5 ? atoi(argv[5]) : 2;
+        double rate = argc > 6 ? atof(argv[6]) : 0.01;
+        seed(argc > 7 ? strtoull(argv[7], NULL, 10) : 42);
+
+        generate_fasta(argv[2], genomes, length, families > 0 ? families : 1, rate);
+    } else {
+        int samples = argc > 3 ? atoi(argv[3]) : 4;
+        uint64_t length = argc > 4 ? strtoull(argv[4], NULL, 10) : 1000000;
+        uint64_t reads = argc > 5 ? strtoull(argv[5], NULL, 10) : 100000;
+        int read_length = argc > 6 ? atoi(argv[6]) : 150;
+        double error_rate = argc > 7 ? atof(argv[7]) : 0.01;
+        seed(argc > 8 ? strtoull(argv[8], NULL, 10) : 42);
+
+        generate_fastq(argv[2], samples, length, reads, read_length, error_rate);
+    }
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file tpool_bench.c
+ * @brief Contention benchmark for the thread pool.
+ *
+ * Runs millions of tiny tasks through the pool for an increasing number of 
+ * threads and reports the throughput as tab-separated values:
+ *
+ *     bench  threads  tasks  seconds  mtasks_per_sec
+ *
+ * - `flat`:   all tasks are added from the main thread (injection queue).
+ * - `nested`: tasks recursively add two subtasks each (worker deques, stealing).
+ * - `forjoin`: parallel_for over outer items, each running an inner parallel_for 
+ *              with a grain of one (task groups, helping waits).
+ *
+ * Usage: ./tpool_bench [max_threads] [tasks]
+ */
+
+#include "../tpool.h"
+#include <stdio.h>
+#include <time.h>
+
+static _Atomic uint64_t counter;
+static struct tpool *pool;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void tiny(void *arg) {
+    (void)arg;
+    atomic_fetch_add_explicit(&counter, 1, memory_order_relaxed);
+}
+
+static void tree(void *arg) {
+    uintptr_t depth = (uintptr_t)arg;
+    atomic_fetch_add_explicit(&counter, 1, memory_order_relaxed);
+    if (depth > 0) {
+        tpool_add_work(pool, tree, (void *)(depth-1));
+        tpool_add_work(pool, tree, (void *)(depth-1));
+    }
+}
+
+static void inner(void *arg, size_t begin, size_t end) {
+    (void)arg;
+    atomic_fetch_add_explicit(&counter, end - begin, memory_order_relaxed);
+}
+
+static void outer(void *arg, size_t begin, size_t end) {
+    uint64_t per_item = *(uint64_t *)arg;
+    for (size_t i=begin; i<end; i++)
+        tpool_parallel_for(pool, 0, per_item, 1, inner, NULL);
+}
+
+int main(int argc, char **argv) {
+    size_t max_threads = argc > 1 ? (size_t)atoi(argv[1]) : 8;
+    uint64_t tasks = argc > 2 ? strtoull(argv[2], NULL, 10) : 4000000;
+    uintptr_t depth = 0;
+    int failed = 0;
+
+    // a full binary tree of the given depth has 2^(depth+1)-1 tasks
+    while (((uint64_t)2 << (depth+1)) - 1 <= tasks)
+        depth++;
+
+    printf("bench\tthreads\ttasks\tseconds\tmtasks_per_sec\n");
+
+    for (size_t threads=1; threads<=max_threads; threads*=2) {
+        double start, elapsed;
+        uint64_t expected;
+
+        pool = tpool_create(threads);
+
+        atomic_store(&counter, 0);
+        start = now();
+        for (uint64_t i=0; i<tasks; i++)
+            tpool_add_work(pool, tiny, NULL);
+        tpool_wait(pool);
+        elapsed = now() - start;
+        failed |= atomic_load(&counter) != tasks;
+        printf("flat\t%zu\t%lu\t%.4f\t%.3f\n", threads, tasks, elapsed, tasks / elapsed / 1e6);
+
+        atomic_store(&counter, 0);
+        expected = ((uint64_t)2 << depth) - 1;
+        start = now();
+        tpool_add_work(pool, tree, (void *)depth);
+        tpool_wait(pool);
+        elapsed = now() - start;
+        failed |= atomic_load(&counter) != expected;
+        printf("nested\t%zu\t%lu\t%.4f\t%.3f\n", threads, expected, elapsed, expected / elapsed / 1e6);
+
+        atomic_store(&counter, 0);
+        uint64_t per_item = tasks / 64;
+        expected = per_item * 64;
+        start = now();
+        tpool_parallel_for(pool, 0, 64, 1, outer, &per_item);
+        elapsed = now() - start;
+        failed |= atomic_load(&counter) != expected;
+        printf("forjoin\t%zu\t%lu\t%.4f\t%.3f\n", threads, expected, elapsed, expected / elapsed / 1e6);
+
+        tpool_destroy(pool);
+    }
+
+    if (failed) {
+        fprintf(stderr, "Task count mismatch.\n");
+        return 1;
+    }
+
+    return 0;
+}
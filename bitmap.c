@@ -0,0 +1,155 @@
+#include "bitmap.h"
+
+static inline int is_bitset(const struct bitmap_container *c) {
+    return c->cardinality > BITMAP_ARRAY_MAX;
+}
+
+static inline uint64_t container_words(uint32_t cardinality) {
+    return cardinality > BITMAP_ARRAY_MAX ? BITMAP_WORDS : (cardinality + 3) / 4;
+}
+
+int bitmap_build(struct bitmap *bm, struct memtrack *mem, const uint32_t *ids, uint64_t len) {
+
+    memset(bm, 0, sizeof(struct bitmap));
+
+    if (len == 0) {
+        return 1;
+    }
+
+    // first pass: containers and their sizes
+    uint32_t count = 0;
+    uint64_t words = 0;
+    for (uint64_t i=0; i<len; ) {
+        uint64_t j = i + 1;
+        while (j < len && (ids[j] >> BITMAP_CHUNK_BITS) == (ids[i] >> BITMAP_CHUNK_BITS)) {
+            j++;
+        }
+        count++;
+        words += container_words(j - i);
+        i = j;
+    }
+
+    bm->containers = (struct bitmap_container *)mem_malloc(mem, count * sizeof(struct bitmap_container));
+    bm->data = (uint64_t *)mem_malloc(mem, words * sizeof(uint64_t));
+
+    if (bm->containers == NULL || bm->data == NULL) {
+        mem_free(mem, bm->containers, count * sizeof(struct bitmap_container));
+        mem_free(mem, bm->data, words * sizeof(uint64_t));
+        memset(bm, 0, sizeof(struct bitmap));
+        return 0;
+    }
+
+    memset(bm->data, 0, words * sizeof(uint64_t));
+    bm->count = count;
+    bm->words = words;
+    bm->cardinality = len;
+
+    // second pass: fill the containers
+    uint64_t offset = 0;
+    struct bitmap_container *c = bm->containers;
+    for (uint64_t i=0; i<len; c++) {
+        uint64_t j = i + 1;
+        while (j < len && (ids[j] >> BITMAP_CHUNK_BITS) == (ids[i] >> BITMAP_CHUNK_BITS)) {
+            j++;
+        }
+
+        c->high = ids[i] >> BITMAP_CHUNK_BITS;
+        c->cardinality = j - i;
+        c->offset = offset;
+
+        if (is_bitset(c)) {
+            uint64_t *bits = bm->data + offset;
+            for (uint64_t k=i; k<j; k++) {
+                uint16_t low = ids[k] & 0xFFFF;
+                bits[low >> 6] |= 1ULL << (low & 63);
+            }
+        } else {
+            uint16_t *array = (uint16_t *)(bm->data + offset);
+            for (uint64_t k=i; k<j; k++) {
+                array[k - i] = ids[k] & 0xFFFF;
+            }
+        }
+
+        offset += container_words(c->cardinality);
+        i = j;
+    }
+
+    return 1;
+}
+
+static uint64_t and_count_bitsets(const uint64_t *bits1, const uint64_t *bits2) {
+    uint64_t count = 0;
+    for (int w=0; w<BITMAP_WORDS; w++) {
+        count += __builtin_popcountll(bits1[w] & bits2[w]);
+    }
+    return count;
+}
+
+static uint64_t and_count_array_bitset(const uint16_t *array, uint32_t cardinality, const uint64_t *bits) {
+    uint64_t count = 0;
+    for (uint32_t k=0; k<cardinality; k++) {
+        count += (bits[array[k] >> 6] >> (array[k] & 63)) & 1;
+    }
+    return count;
+}
+
+static uint64_t and_count_arrays(const uint16_t *array1, uint32_t size1, const uint16_t *array2, uint32_t size2) {
+    uint64_t count = 0;
+    uint32_t index1 = 0, index2 = 0;
+    while (index1 < size1 && index2 < size2) {
+        if (array1[index1] == array2[index2]) {
+            count++;
+            index1++;
+            index2++;
+        } else if (array1[index1] < array2[index2]) {
+            index1++;
+        } else {
+            index2++;
+        }
+    }
+    return count;
+}
+
+uint64_t bitmap_and_count(const struct bitmap *bm1, const struct bitmap *bm2) {
+
+    uint64_t count = 0;
+    uint32_t index1 = 0, index2 = 0;
+
+    while (index1 < bm1->count && index2 < bm2->count) {
+        const struct bitmap_container *c1 = bm1->containers + index1;
+        const struct bitmap_container *c2 = bm2->containers + index2;
+
+        if (c1->high < c2->high) {
+            index1++;
+            continue;
+        }
+        if (c1->high > c2->high) {
+            index2++;
+            continue;
+        }
+
+        const uint64_t *data1 = bm1->data + c1->offset;
+        const uint64_t *data2 = bm2->data + c2->offset;
+
+        if (is_bitset(c1) && is_bitset(c2)) {
+            count += and_count_bitsets(data1, data2);
+        } else if (is_bitset(c1)) {
+            count += and_count_array_bitset((const uint16_t *)data2, c2->cardinality, data1);
+        } else if (is_bitset(c2)) {
+            count += and_count_array_bitset((const uint16_t *)data1, c1->cardinality, data2);
+        } else {
+            count += and_count_arrays((const uint16_t *)data1, c1->cardinality, (const uint16_t *)data2, c2->cardinality);
+        }
+
+        index1++;
+        index2++;
+    }
+
+    return count;
+}
+
+void bitmap_free(struct bitmap *bm, struct memtrack *mem) {
+    mem_free(mem, bm->containers, bm->count * sizeof(struct bitmap_container));
+    mem_free(mem, bm->data, bm->words * sizeof(uint64_t));
+    memset(bm, 0, sizeof(struct bitmap));
+}
@@ -0,0 +1,80 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define BITMAP_CHUNK_BITS 16          // low bits of an ID stored in a container
+#define BITMAP_ARRAY_MAX 4096         // containers with more IDs are stored as bitsets
+#define BITMAP_WORDS 1024             // 64-bit words of a bitset container
+
+/**
+ * @brief A container of the IDs sharing their high 16 bits.
+ *
+ * Sparse containers are sorted arrays of the low 16 bits of their IDs, dense
+ * ones (more than `BITMAP_ARRAY_MAX` IDs) bitsets of 2^16 bits, so that a
+ * container never takes more than 8 kB.
+ */
+struct bitmap_container {
+    uint16_t high;
+    uint32_t cardinality;
+    uint64_t offset; // first word of the container in the data of the bitmap
+};
+
+/**
+ * @brief A Roaring-style compressed bitmap of 32-bit IDs.
+ *
+ * The containers and their data are allocated once, when the bitmap is built
+ * from a sorted list of IDs, and the bitmap is not modified afterwards.
+ */
+struct bitmap {
+    struct bitmap_container *containers;
+    uint64_t *data;
+    uint32_t count; // containers
+    uint64_t words; // 64-bit words of the data
+    uint64_t cardinality;
+};
+
+/**
+ * @brief Builds a bitmap from sorted, distinct IDs.
+ *
+ * @param bm Pointer to the bitmap to be filled.
+ * @param mem Pointer to the memory tracker the buffers are charged to.
+ * @param ids Sorted IDs without repeats.
+ * @param len Number of IDs.
+ * @return 1 on success, 0 if the buffers could not be allocated.
+ */
+int bitmap_build(struct bitmap *bm, struct memtrack *mem, const uint32_t *ids, uint64_t len);
+
+/**
+ * @brief Counts the IDs that are in both bitmaps.
+ *
+ * Containers are matched by their high bits. Two bitsets are intersected by
+ * AND and popcount word by word, an array and a bitset by testing the bits of
+ * the array, and two arrays by merging them.
+ *
+ * @param bm1 Pointer to the first bitmap.
+ * @param bm2 Pointer to the second bitmap.
+ * @return Size of the intersection.
+ */
+uint64_t bitmap_and_count(const struct bitmap *bm1, const struct bitmap *bm2);
+
+/**
+ * @brief Bytes taken by the containers and the data of a bitmap.
+ */
+static inline uint64_t bitmap_bytes(const struct bitmap *bm) {
+    return bm->count * sizeof(struct bitmap_container) + bm->words * sizeof(uint64_t);
+}
+
+/**
+ * @brief Frees the buffers of a bitmap.
+ *
+ * @param bm Pointer to the bitmap.
+ * @param mem Pointer to the memory tracker the buffers were charged to.
+ */
+void bitmap_free(struct bitmap *bm, struct memtrack *mem);
+
+#endif
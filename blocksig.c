@@ -0,0 +1,199 @@
+#include "blocksig.h"
+
+static inline uint64_t get_key(const void *keys, uint64_t i, size_t size) {
+    return size == sizeof(uint64_t) ? ((const uint64_t *)keys)[i] : ((const uint32_t *)keys)[i];
+}
+
+static inline uint32_t bit_width(uint64_t value) {
+    return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+static inline uint64_t gap_words(uint32_t count, uint32_t width) {
+    return ((uint64_t)(count - 1) * width + 63) / 64;
+}
+
+/**
+ * Width of the largest gap of the block starting at the given key.
+ */
+static uint32_t block_width(const void *keys, uint64_t begin, uint64_t end, size_t size) {
+    uint64_t max_gap = 0;
+    for (uint64_t i=begin+1; i<end; i++) {
+        uint64_t gap = get_key(keys, i, size) - get_key(keys, i-1, size) - 1;
+        max_gap |= gap;
+    }
+    return bit_width(max_gap);
+}
+
+int blocksig_build(struct blocksig *bs, struct memtrack *mem, const void *keys, uint64_t len, size_t size) {
+
+    memset(bs, 0, sizeof(struct blocksig));
+
+    if (len == 0) {
+        return 1;
+    }
+
+    uint64_t block_count = (len + BLOCKSIG_SIZE - 1) / BLOCKSIG_SIZE;
+    bs->blocks = (struct sig_block *)mem_malloc(mem, block_count * sizeof(struct sig_block));
+    if (bs->blocks == NULL) {
+        return 0;
+    }
+    bs->block_count = block_count;
+    bs->len = len;
+
+    // first pass: skip entries and the size of the data
+    uint64_t words = 0;
+    for (uint64_t b=0; b<block_count; b++) {
+        uint64_t begin = b * BLOCKSIG_SIZE;
+        uint64_t end = begin + BLOCKSIG_SIZE < len ? begin + BLOCKSIG_SIZE : len;
+        struct sig_block *block = bs->blocks + b;
+
+        block->first = get_key(keys, begin, size);
+        block->last = get_key(keys, end - 1, size);
+        block->offset = words;
+        block->count = end - begin;
+        block->width = block_width(keys, begin, end, size);
+        words += gap_words(block->count, block->width);
+    }
+
+    // one more word, so that a gap can always be read from two words
+    bs->data = (uint64_t *)mem_malloc(mem, (words + 1) * sizeof(uint64_t));
+    if (bs->data == NULL) {
+        blocksig_free(bs, mem);
+        return 0;
+    }
+    memset(bs->data, 0, (words + 1) * sizeof(uint64_t));
+    bs->words = words + 1;
+
+    // second pass: pack the gaps
+    for (uint64_t b=0; b<block_count; b++) {
+        const struct sig_block *block = bs->blocks + b;
+        uint64_t *out = bs->data + block->offset;
+        uint64_t begin = b * BLOCKSIG_SIZE;
+        uint64_t pos = 0;
+
+        if (block->width == 0) {
+            continue;
+        }
+
+        for (uint64_t i=begin+1; i<begin+block->count; i++, pos+=block->width) {
+            uint64_t gap = get_key(keys, i, size) - get_key(keys, i-1, size) - 1;
+            out[pos >> 6] |= gap << (pos & 63);
+            if ((pos & 63) + block->width > 64) {
+                out[(pos >> 6) + 1] |= gap >> (64 - (pos & 63));
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Restores the keys of a block.
+ */
+static void decode_block(const struct blocksig *bs, uint64_t b, uint64_t *out) {
+
+    const struct sig_block *block = bs->blocks + b;
+    const uint64_t *in = bs->data + block->offset;
+    uint32_t width = block->width;
+    uint64_t mask = width == 64 ? UINT64_MAX : (1ULL << width) - 1;
+    uint64_t key = block->first;
+    uint64_t pos = 0;
+
+    out[0] = key;
+
+    if (width == 0) {
+        for (uint32_t i=1; i<block->count; i++) {
+            out[i] = ++key;
+        }
+        return;
+    }
+
+    for (uint32_t i=1; i<block->count; i++, pos+=width) {
+        uint64_t gap = in[pos >> 6] >> (pos & 63);
+        if ((pos & 63) + width > 64) {
+            gap |= in[(pos >> 6) + 1] << (64 - (pos & 63));
+        }
+        key += (gap & mask) + 1;
+        out[i] = key;
+    }
+}
+
+/**
+ * Index of the first block at or after `from` whose last key is at least the given key.
+ */
+static uint64_t skip_blocks(const struct blocksig *bs, uint64_t from, uint64_t key) {
+    uint64_t low = from, high = bs->block_count;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (bs->blocks[mid].last < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+uint64_t blocksig_and_count(const struct blocksig *bs1, const struct blocksig *bs2) {
+
+    uint64_t keys1[BLOCKSIG_SIZE], keys2[BLOCKSIG_SIZE];
+    uint64_t decoded1 = UINT64_MAX, decoded2 = UINT64_MAX;
+    uint64_t index1 = 0, index2 = 0; // blocks
+    uint32_t pos1 = 0, pos2 = 0; // keys in the current blocks
+    uint64_t count = 0;
+
+    while (index1 < bs1->block_count && index2 < bs2->block_count) {
+        const struct sig_block *block1 = bs1->blocks + index1;
+        const struct sig_block *block2 = bs2->blocks + index2;
+
+        // blocks that end before the other one starts have no common keys
+        if (block1->last < block2->first) {
+            index1 = skip_blocks(bs1, index1 + 1, block2->first);
+            pos1 = 0;
+            continue;
+        }
+        if (block2->last < block1->first) {
+            index2 = skip_blocks(bs2, index2 + 1, block1->first);
+            pos2 = 0;
+            continue;
+        }
+
+        if (decoded1 != index1) {
+            decode_block(bs1, index1, keys1);
+            decoded1 = index1;
+        }
+        if (decoded2 != index2) {
+            decode_block(bs2, index2, keys2);
+            decoded2 = index2;
+        }
+
+        while (pos1 < block1->count && pos2 < block2->count) {
+            if (keys1[pos1] == keys2[pos2]) {
+                count++;
+                pos1++;
+                pos2++;
+            } else if (keys1[pos1] < keys2[pos2]) {
+                pos1++;
+            } else {
+                pos2++;
+            }
+        }
+
+        if (pos1 == block1->count) {
+            index1++;
+            pos1 = 0;
+        }
+        if (pos2 == block2->count) {
+            index2++;
+            pos2 = 0;
+        }
+    }
+
+    return count;
+}
+
+void blocksig_free(struct blocksig *bs, struct memtrack *mem) {
+    mem_free(mem, bs->blocks, bs->block_count * sizeof(struct sig_block));
+    mem_free(mem, bs->data, bs->words * sizeof(uint64_t));
+    memset(bs, 0, sizeof(struct blocksig));
+}
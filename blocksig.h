@@ -0,0 +1,81 @@
+#ifndef BLOCKSIG_H
+#define BLOCKSIG_H
+
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define BLOCKSIG_SIZE 128  // keys of a block, 1 kB when decoded
+
+/**
+ * @brief Skip entry of a block of a compressed signature.
+ *
+ * The first key of a block is stored here, the other keys as the gaps to their
+ * predecessor minus one, packed with the bits of the largest gap of the block.
+ */
+struct sig_block {
+    uint64_t first;
+    uint64_t last;
+    uint64_t offset; // first word of the packed gaps in the data of the signature
+    uint32_t count; // keys
+    uint32_t width; // bits per gap
+};
+
+/**
+ * @brief A sorted signature compressed into blocks of `BLOCKSIG_SIZE` keys.
+ *
+ * Keys of either width are stored as 64-bit values. The skip entries hold the
+ * range of every block, so that blocks of one signature that cannot overlap
+ * the other one are skipped without being decoded.
+ */
+struct blocksig {
+    struct sig_block *blocks;
+    uint64_t *data;
+    uint64_t block_count;
+    uint64_t words; // 64-bit words of the data
+    uint64_t len; // keys
+};
+
+/**
+ * @brief Compresses sorted, distinct keys into blocks.
+ *
+ * @param bs Pointer to the compressed signature to be filled.
+ * @param mem Pointer to the memory tracker the buffers are charged to.
+ * @param keys Sorted keys without repeats.
+ * @param len Number of keys.
+ * @param size Bytes of a key, 8 or 4 (see `key_size`).
+ * @return 1 on success, 0 if the buffers could not be allocated.
+ */
+int blocksig_build(struct blocksig *bs, struct memtrack *mem, const void *keys, uint64_t len, size_t size);
+
+/**
+ * @brief Counts the keys that are in both compressed signatures.
+ *
+ * Blocks are decoded only when their range overlaps a block of the other
+ * signature. Runs of blocks ending before the current block of the other
+ * signature are skipped by a binary search on their skip entries.
+ *
+ * @param bs1 Pointer to the first compressed signature.
+ * @param bs2 Pointer to the second compressed signature.
+ * @return Size of the intersection.
+ */
+uint64_t blocksig_and_count(const struct blocksig *bs1, const struct blocksig *bs2);
+
+/**
+ * @brief Bytes taken by the skip entries and the data of a compressed signature.
+ */
+static inline uint64_t blocksig_bytes(const struct blocksig *bs) {
+    return bs->block_count * sizeof(struct sig_block) + bs->words * sizeof(uint64_t);
+}
+
+/**
+ * @brief Frees the buffers of a compressed signature.
+ *
+ * @param bs Pointer to the compressed signature.
+ * @param mem Pointer to the memory tracker the buffers were charged to.
+ */
+void blocksig_free(struct blocksig *bs, struct memtrack *mem);
+
+#endif
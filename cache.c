@@ -0,0 +1,212 @@
+#include "cache.h"
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline uint64_t hash_avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+ * Hashes the content of a file using four independent lanes over 32-byte stripes, 
+ * so that the hash keeps up with sequential disk reads.
+ */
+static int hash_file(const char *filename, uint64_t *hash) {
+
+    FILE *in = fopen(filename, "rb");
+    if (in == NULL) {
+        log1(ERROR, "Error opening file %s for hashing", filename);
+        return 0;
+    }
+
+    unsigned char *buffer = (unsigned char *)malloc(CACHE_HASH_BUFFER_SIZE);
+    if (buffer == NULL) {
+        log1(ERROR, "Memory allocation failed for hash buffer.");
+        fclose(in);
+        return 0;
+    }
+
+    uint64_t lanes[4] = {PRIME1 + PRIME2, PRIME2, 0, -PRIME1};
+    uint64_t total = 0;
+    uint64_t tail = 0;
+    size_t n;
+
+    while ((n = fread(buffer, 1, CACHE_HASH_BUFFER_SIZE, in)) > 0) {
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            uint64_t v[4];
+            memcpy(v, buffer + i, 32);
+            lanes[0] = hash_round(lanes[0], v[0]);
+            lanes[1] = hash_round(lanes[1], v[1]);
+            lanes[2] = hash_round(lanes[2], v[2]);
+            lanes[3] = hash_round(lanes[3], v[3]);
+        }
+        // remaining bytes only occur at the end of the file since buffer size is a multiple of 32
+        for (; i < n; i++) {
+            tail = hash_round(tail, buffer[i]);
+        }
+        total += n;
+    }
+
+    free(buffer);
+
+    if (ferror(in)) {
+        log1(ERROR, "Error reading file %s for hashing", filename);
+        fclose(in);
+        return 0;
+    }
+    fclose(in);
+
+    uint64_t h = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) + rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+    h = hash_round(h, tail);
+    h = hash_round(h, total);
+    *hash = hash_avalanche(h);
+
+    return 1;
+}
+
+static void entry_path(const struct gargs *genome_arguments, const struct cache_key *key, char buffer[1024]) {
+    snprintf(buffer, 1024, "%s/%016lx.%016lx.gcs", genome_arguments->cache_dir, key->content, key->params);
+}
+
+int cache_key(const struct gargs *genome_arguments, cache_tag tag, struct cache_key *key) {
+
+    // hashing would consume the stream
+    if (is_stream_input(genome_arguments->inFileName)) {
+        return 0;
+    }
+
+    if (!hash_file(genome_arguments->inFileName, &(key->content))) {
+        return 0;
+    }
+
+    // thresholds only change the signature if filtering is applied
+    uint64_t p = PRIME3;
+    p = hash_round(p, (uint64_t)tag);
+    p = hash_round(p, (uint64_t)genome_arguments->lcp_level);
+    p = hash_round(p, (uint64_t)genome_arguments->sct);
+    p = hash_round(p, (uint64_t)genome_arguments->apply_filter);
+    if (genome_arguments->key != KEY_CORE) {
+        p = hash_round(p, (uint64_t)genome_arguments->key);
+    }
+    if (genome_arguments->lcp_window || genome_arguments->n_split || genome_arguments->drop_masked) {
+        p = hash_round(p, genome_arguments->lcp_window);
+        p = hash_round(p, genome_arguments->n_split);
+        p = hash_round(p, (uint64_t)genome_arguments->drop_masked);
+    }
+    if (genome_arguments->apply_filter) {
+        if (genome_arguments->auto_cc) {
+            p = hash_round(p, (uint64_t)genome_arguments->auto_cc);
+        }
+        p = hash_round(p, (uint64_t)genome_arguments->min_cc);
+        p = hash_round(p, (uint64_t)genome_arguments->max_cc);
+    }
+    key->params = hash_avalanche(p);
+
+    return 1;
+}
+
+int cache_load(struct gargs *genome_arguments, const struct cache_key *key) {
+
+    char filename_buffer[1024];
+    entry_path(genome_arguments, key, filename_buffer);
+
+    FILE *in = fopen(filename_buffer, "rb");
+    if (in == NULL) {
+        return 0;
+    }
+
+    struct cache_header header;
+    struct stat st;
+    size_t size = key_size(genome_arguments->key);
+
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        header.magic != CACHE_MAGIC ||
+        header.content != key->content ||
+        header.params != key->params ||
+        fstat(fileno(in), &st) != 0 ||
+        (uint64_t)st.st_size != sizeof(header) + header.cores_len * size) {
+        log1(WARN, "Ignoring invalid cache entry %s", filename_buffer);
+        fclose(in);
+        return 0;
+    }
+
+    void *cores = NULL;
+
+    if (header.cores_len) {
+        mem_stage(&(genome_arguments->mem), STAGE_CACHE);
+        cores = mem_malloc(&(genome_arguments->mem), header.cores_len * size);
+        if (cores == NULL) {
+            log1(ERROR, "Memory allocation failed for cached cores of %s", genome_arguments->inFileName);
+            fclose(in);
+            return 0;
+        }
+        if (fread(cores, size, header.cores_len, in) != header.cores_len) {
+            log1(WARN, "Ignoring truncated cache entry %s", filename_buffer);
+            mem_free(&(genome_arguments->mem), cores, header.cores_len * size);
+            fclose(in);
+            return 0;
+        }
+    }
+
+    fclose(in);
+
+    genome_arguments->cores = cores;
+    genome_arguments->cores_len = header.cores_len;
+    genome_arguments->cores_capacity = header.cores_len;
+    genome_arguments->total_len = header.total_len;
+
+    return 1;
+}
+
+int cache_store(const struct gargs *genome_arguments, const struct cache_key *key) {
+
+    char filename_buffer[1024];
+    char tmp_filename_buffer[1100];
+    entry_path(genome_arguments, key, filename_buffer);
+    snprintf(tmp_filename_buffer, sizeof(tmp_filename_buffer), "%s.%lx.tmp", filename_buffer, (unsigned long)pthread_self());
+
+    FILE *out = fopen(tmp_filename_buffer, "wb");
+    if (out == NULL) {
+        log1(WARN, "Could not create cache entry %s", tmp_filename_buffer);
+        return 0;
+    }
+
+    struct cache_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CACHE_MAGIC;
+    header.content = key->content;
+    header.params = key->params;
+    header.cores_len = genome_arguments->cores_len;
+    header.total_len = genome_arguments->total_len;
+
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    if (ok && header.cores_len) {
+        ok = fwrite(genome_arguments->cores, key_size(genome_arguments->key), header.cores_len, out) == header.cores_len;
+    }
+    ok = (fclose(out) == 0) && ok;
+
+    if (!ok || rename(tmp_filename_buffer, filename_buffer) != 0) {
+        log1(WARN, "Could not write cache entry %s", filename_buffer);
+        remove(tmp_filename_buffer);
+        return 0;
+    }
+
+    return 1;
+}
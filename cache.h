@@ -0,0 +1,91 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "args.h"
+#include "utils.h" // logging
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC 0x4743534947303032ULL // "GCSIG002"
+#define CACHE_HASH_BUFFER_SIZE (1 << 20)
+
+/**
+ * @brief Identifies which reader produced a cached signature.
+ *
+ * FASTA and FASTQ inputs are parsed differently (e.g., reverse complements 
+ * are processed for reads), so the same file content yields different 
+ * signatures depending on the reader.
+ */
+typedef enum {
+    CACHE_FA = 1,
+    CACHE_FQ = 2
+} cache_tag;
+
+/**
+ * @brief Key of a signature cache entry.
+ *
+ * The key consists of a hash of the input file content and a hash of every 
+ * parameter that affects the resulting signature. The same file under a 
+ * different name maps to the same entry.
+ */
+struct cache_key {
+    uint64_t content;
+    uint64_t params;
+};
+
+/**
+ * @brief Header written at the beginning of every cache entry.
+ */
+struct cache_header {
+    uint64_t magic;
+    uint64_t content;
+    uint64_t params;
+    uint64_t cores_len;
+    double total_len;
+};
+
+/**
+ * @brief Computes the cache key of a genome.
+ *
+ * Streams the input file once to compute a 64-bit content hash, and combines 
+ * the reader type with `lcp_level`, filtering thresholds, similarity 
+ * calculation type and sequence segmentation (LCP window, N runs and masking, 
+ * if any) into the parameter hash.
+ *
+ * @param genome_arguments Pointer to the genome arguments of the input.
+ * @param tag The reader that processes the input.
+ * @param key Pointer to the key to be filled.
+ * @return 1 on success, 0 if the input could not be hashed.
+ */
+int cache_key(const struct gargs *genome_arguments, cache_tag tag, struct cache_key *key);
+
+/**
+ * @brief Loads the signature of a genome from the cache if a valid entry exists.
+ *
+ * An entry is valid if its header matches the key and its size matches the 
+ * number of cores it claims to store. On success, `cores`, `cores_len` and 
+ * `total_len` of the genome are set as if `genSign` had been run.
+ *
+ * @param genome_arguments Pointer to the genome arguments to be filled.
+ * @param key Pointer to the key computed by `cache_key`.
+ * @return 1 on cache hit, 0 otherwise.
+ */
+int cache_load(struct gargs *genome_arguments, const struct cache_key *key);
+
+/**
+ * @brief Stores the signature of a genome into the cache.
+ *
+ * The entry is written to a temporary file and renamed into place, so that 
+ * an interrupted run never leaves a partially written entry behind.
+ *
+ * @param genome_arguments Pointer to the genome arguments holding the signature.
+ * @param key Pointer to the key computed by `cache_key`.
+ * @return 1 on success, 0 otherwise.
+ */
+int cache_store(const struct gargs *genome_arguments, const struct cache_key *key);
+
+#endif
@@ -0,0 +1,173 @@
+#include "dict.h"
+
+static inline uint64_t hash_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static inline uint64_t get_key(const void *keys, uint64_t i, key_type key) {
+    return key == KEY_CORE ? ((const uint64_t *)keys)[i] : ((const uint32_t *)keys)[i];
+}
+
+static inline int shard_of(uint64_t hash) {
+    return hash >> 58; // log2(COREDICT_SHARDS) high bits
+}
+
+/**
+ * Allocates the slots of a shard, rehashing its keys if it had any.
+ */
+static int shard_grow(struct coredict_shard *shard, uint64_t capacity) {
+
+    uint64_t *keys = (uint64_t *)mem_malloc(&(shard->mem), capacity * sizeof(uint64_t));
+    uint32_t *ids = (uint32_t *)mem_malloc(&(shard->mem), capacity * sizeof(uint32_t));
+
+    if (keys == NULL || ids == NULL) {
+        mem_free(&(shard->mem), keys, capacity * sizeof(uint64_t));
+        mem_free(&(shard->mem), ids, capacity * sizeof(uint32_t));
+        return 0;
+    }
+
+    memset(ids, 0xFF, capacity * sizeof(uint32_t));
+
+    for (uint64_t s=0; s<shard->capacity; s++) {
+        if (shard->ids[s] == COREDICT_EMPTY) {
+            continue;
+        }
+        uint64_t slot = hash_key(shard->keys[s]) & (capacity - 1);
+        while (ids[slot] != COREDICT_EMPTY) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        keys[slot] = shard->keys[s];
+        ids[slot] = shard->ids[s];
+    }
+
+    mem_free(&(shard->mem), shard->keys, shard->capacity * sizeof(uint64_t));
+    mem_free(&(shard->mem), shard->ids, shard->capacity * sizeof(uint32_t));
+
+    shard->keys = keys;
+    shard->ids = ids;
+    shard->capacity = capacity;
+
+    return 1;
+}
+
+/**
+ * Returns the ID of a key, adding it if it is new. The shard has to be locked.
+ */
+static uint32_t shard_lookup(struct coredict *dict, struct coredict_shard *shard, uint64_t key, uint64_t hash) {
+
+    // keep the load below 0.7
+    if ((shard->count + 1) * 10 > shard->capacity * 7 && !shard_grow(shard, shard->capacity ? shard->capacity * 2 : COREDICT_INITIAL_SLOTS)) {
+        return COREDICT_EMPTY;
+    }
+
+    uint64_t slot = hash & (shard->capacity - 1);
+    while (shard->ids[slot] != COREDICT_EMPTY) {
+        if (shard->keys[slot] == key) {
+            return shard->ids[slot];
+        }
+        slot = (slot + 1) & (shard->capacity - 1);
+    }
+
+    uint64_t id = atomic_fetch_add_explicit(&(dict->next_id), 1, memory_order_relaxed);
+    if (id >= COREDICT_EMPTY) {
+        return COREDICT_EMPTY;
+    }
+
+    shard->keys[slot] = key;
+    shard->ids[slot] = (uint32_t)id;
+    shard->count++;
+
+    return (uint32_t)id;
+}
+
+void coredict_init(struct coredict *dict) {
+    memset(dict, 0, sizeof(struct coredict));
+    for (int s=0; s<COREDICT_SHARDS; s++) {
+        pthread_mutex_init(&(dict->shards[s].mutex), NULL);
+    }
+    atomic_init(&(dict->next_id), 0);
+    atomic_init(&(dict->rotation), 0);
+}
+
+int coredict_encode(struct coredict *dict, const void *keys, uint64_t len, key_type key, uint32_t *ids, struct memtrack *mem) {
+
+    if (len == 0) {
+        return 1;
+    }
+
+    // group the positions of the keys by their shard
+    uint64_t first[COREDICT_SHARDS + 1] = {0};
+    uint64_t *order = (uint64_t *)mem_malloc(mem, len * sizeof(uint64_t));
+    if (order == NULL) {
+        log1(ERROR, "Memory allocation failed for encoding cores.");
+        return 0;
+    }
+
+    for (uint64_t i=0; i<len; i++) {
+        first[shard_of(hash_key(get_key(keys, i, key))) + 1]++;
+    }
+    for (int s=0; s<COREDICT_SHARDS; s++) {
+        first[s+1] += first[s];
+    }
+
+    uint64_t next[COREDICT_SHARDS];
+    memcpy(next, first, sizeof(next));
+    for (uint64_t i=0; i<len; i++) {
+        order[next[shard_of(hash_key(get_key(keys, i, key)))]++] = i;
+    }
+
+    int start = atomic_fetch_add_explicit(&(dict->rotation), 1, memory_order_relaxed) % COREDICT_SHARDS;
+    int ok = 1;
+
+    for (int t=0; t<COREDICT_SHARDS && ok; t++) {
+        int s = (start + t) % COREDICT_SHARDS;
+        struct coredict_shard *shard = dict->shards + s;
+
+        if (first[s] == first[s+1]) {
+            continue;
+        }
+
+        pthread_mutex_lock(&(shard->mutex));
+        for (uint64_t k=first[s]; k<first[s+1]; k++) {
+            uint64_t value = get_key(keys, order[k], key);
+            uint32_t id = shard_lookup(dict, shard, value, hash_key(value));
+            if (id == COREDICT_EMPTY) {
+                ok = 0;
+                break;
+            }
+            ids[order[k]] = id;
+        }
+        pthread_mutex_unlock(&(shard->mutex));
+    }
+
+    mem_free(mem, order, len * sizeof(uint64_t));
+
+    if (!ok) {
+        log1(ERROR, "Could not add cores to the core dictionary, it is out of memory or IDs.");
+    }
+
+    return ok;
+}
+
+uint64_t coredict_bytes(const struct coredict *dict) {
+    uint64_t bytes = 0;
+    for (int s=0; s<COREDICT_SHARDS; s++) {
+        bytes += dict->shards[s].capacity * (sizeof(uint64_t) + sizeof(uint32_t));
+    }
+    return bytes;
+}
+
+void coredict_free(struct coredict *dict) {
+    for (int s=0; s<COREDICT_SHARDS; s++) {
+        struct coredict_shard *shard = dict->shards + s;
+        mem_free(&(shard->mem), shard->keys, shard->capacity * sizeof(uint64_t));
+        mem_free(&(shard->mem), shard->ids, shard->capacity * sizeof(uint32_t));
+        pthread_mutex_destroy(&(shard->mutex));
+    }
+    memset(dict, 0, sizeof(struct coredict));
+}
@@ -0,0 +1,88 @@
+#ifndef DICT_H
+#define DICT_H
+
+#include "args.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define COREDICT_SHARDS 64            // independently locked hash tables
+#define COREDICT_INITIAL_SLOTS 1024   // slots of a shard before its first growth
+#define COREDICT_EMPTY UINT32_MAX     // ID of an empty slot
+
+/**
+ * @brief One of the hash tables of a dictionary, holding the keys whose hash
+ *        has the index of the shard in its high bits.
+ */
+struct coredict_shard {
+    pthread_mutex_t mutex;
+    uint64_t *keys;
+    uint32_t *ids;
+    uint64_t capacity; // slots, a power of 2
+    uint64_t count;
+    struct memtrack mem;
+};
+
+/**
+ * @brief A dictionary of the distinct cores of a run, mapping every core to a
+ *        dense 32-bit ID.
+ *
+ * IDs are handed out in the order the cores are first seen, so the cores
+ * shared by closely related genomes get IDs close to each other and the
+ * bitmaps of the genomes over these IDs are dense. The dictionary is split
+ * into shards with their own locks so that genomes finishing at the same
+ * time are encoded concurrently.
+ */
+struct coredict {
+    struct coredict_shard shards[COREDICT_SHARDS];
+    _Atomic uint64_t next_id;
+    _Atomic uint32_t rotation; // first shard of the next encoding
+};
+
+/**
+ * @brief Initializes an empty dictionary.
+ *
+ * @param dict Pointer to the dictionary.
+ */
+void coredict_init(struct coredict *dict);
+
+/**
+ * @brief Maps keys to their IDs, adding the keys that are not in the dictionary.
+ *
+ * Keys are grouped by their shard first, so that every shard is locked once
+ * per call. Different calls start at different shards to spread the contention.
+ *
+ * @param dict Pointer to the dictionary.
+ * @param keys Keys of `key_size(key)` bytes.
+ * @param len Number of keys.
+ * @param key Type of the keys.
+ * @param ids Output array of `len` IDs.
+ * @param mem Pointer to the memory tracker temporary buffers are charged to.
+ * @return 1 on success, 0 if memory could not be allocated or the IDs are exhausted (logged).
+ */
+int coredict_encode(struct coredict *dict, const void *keys, uint64_t len, key_type key, uint32_t *ids, struct memtrack *mem);
+
+/**
+ * @brief Number of distinct cores in a dictionary.
+ */
+static inline uint64_t coredict_size(struct coredict *dict) {
+    return atomic_load(&(dict->next_id));
+}
+
+/**
+ * @brief Bytes taken by the tables of a dictionary.
+ */
+uint64_t coredict_bytes(const struct coredict *dict);
+
+/**
+ * @brief Frees the tables of a dictionary.
+ *
+ * @param dict Pointer to the dictionary.
+ */
+void coredict_free(struct coredict *dict);
+
+#endif
@@ -4,6 +4,11 @@
 #include "rfasta.h"
 #include "rfastq.h"
 #include "rload.h"
+#include "stats.h"
+#include "mem.h"
+#include "sigdb.h"
+#include "serve.h"
+#include "shard.h"
 
 int main(int argc, char **argv) {
 
@@ -11,29 +16,128 @@ int main(int argc, char **argv) {
     struct gargs *genome_arguments;
     struct pargs program_arguments;
 
+    run_stats.start_ns = stats_now();
+
+    // write log messages from a background thread
+    log_init(INFO);
+
     parse(argc, argv, &genome_arguments, &program_arguments);
 
+    // answer queries against a signature database until stopped
+    if (program_arguments.mode == SERVE) {
+        LCP_INIT();
+        serve(&program_arguments);
+        return 0;
+    }
+
+    // assemble the matrices from the shards of a sharded run
+    if (program_arguments.mode == MERGE) {
+        merge_shards(&program_arguments);
+        return 0;
+    }
+
+    // sample resident memory over the run if it will be reported
+    if (program_arguments.stats_file != NULL || genome_arguments[0].verbose) {
+        mem_sampler_start(RSS_SAMPLE_INTERVAL_MS);
+    }
+
+    // report progress of long runs
+    if (program_arguments.progress_interval > 0 || program_arguments.status_file != NULL) {
+        progress_start(program_arguments.progress_interval, program_arguments.status_file);
+    }
+
     // initialize coefficient arrays
     LCP_INIT();
 
     // process files program
+    thread_func_t reader = NULL;
+
     switch (program_arguments.mode) {
     case FA:
-        read_fastas(genome_arguments, &program_arguments);
+        reader = read_fasta;
         break;
     case FQ:
-        read_fastqs(genome_arguments, &program_arguments);
+        reader = read_fastq;
         break;
     case LOAD:
-        read_lcpts(genome_arguments, &program_arguments);
+        reader = read_lcpt;
+        break;
+    case SKETCH:
+        reader = program_arguments.input_mode == FQ ? read_fastq : read_fasta;
+        break;
+    case DIST:
+        // signatures are loaded while parsing
         break;
     default:
         log1(ERROR, "Invalid program mode provided. It should not happen.");
         exit(1);
     }
+
+    // compare pairs as soon as both signatures are ready, unless distances are
+    // left to dist, the shards need all signature sizes to be planned or the
+    // bucket boundaries of partitions are sampled from all signatures
+    int pipelined = reader != NULL && program_arguments.mode != SKETCH && !program_arguments.shard_count && genome_arguments[0].partitions == 1;
+
+    if (pipelined) {
+        calcPipelinedDistances(genome_arguments, &program_arguments, reader);
+    } else if (reader != NULL) {
+        run_genomes(genome_arguments, &program_arguments, reader);
+    } else if (genome_arguments[0].dict != NULL || genome_arguments[0].compress) {
+        // loaded signatures are encoded before they are compared
+        encodeSignatures(genome_arguments, &program_arguments);
+    }
+
+    if (genome_arguments[0].partitions > 1 && program_arguments.mode != SKETCH) {
+        partitionSignatures(genome_arguments, program_arguments.number_of_genomes);
+    }
+
+    if ((genome_arguments[0].dict != NULL || genome_arguments[0].compress) && genome_arguments[0].verbose) {
+        uint64_t bytes = 0, keys = 0;
+        for (int i=0; i<program_arguments.number_of_genomes; i++) {
+            bytes += signature_bytes(&(genome_arguments[i]));
+            keys += genome_arguments[i].cores_len * key_size(genome_arguments[i].key);
+        }
+        if (genome_arguments[0].dict != NULL) {
+            log1(INFO, "Core dictionary: %lu distinct cores in %.2f MB, signature bitmaps: %.2f MB", coredict_size(genome_arguments[0].dict), 
+                coredict_bytes(genome_arguments[0].dict) / 1048576.0, bytes / 1048576.0);
+        } else {
+            log1(INFO, "Compressed signatures: %.2f MB, %.2f MB as keys", bytes / 1048576.0, keys / 1048576.0);
+        }
+    }
     
+    if (genome_arguments[0].auto_cc && writeCCHistograms(genome_arguments, &program_arguments)) {
+        log1(INFO, "Core abundance histograms are written to %s.cc.hist", program_arguments.prefix);
+    }
+
+    // store the signatures so that they can be served
+    if (program_arguments.db_file != NULL) {
+        if (sigdb_write(program_arguments.db_file, genome_arguments, program_arguments.number_of_genomes, program_arguments.input_mode)) {
+            log1(INFO, "Signatures are written to %s", program_arguments.db_file);
+        } else if (program_arguments.mode == SKETCH) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
     // calculate distances and store them in files
-    calcDistances(genome_arguments, &program_arguments);
+    if (program_arguments.mode != SKETCH && !pipelined) {
+        if (program_arguments.shard_count) {
+            calcShardDistances(genome_arguments, &program_arguments);
+        } else {
+            calcDistances(genome_arguments, &program_arguments);
+        }
+    }
+
+    mem_sampler_stop();
+    progress_stop();
+
+    if (genome_arguments[0].verbose) {
+        log1(INFO, "Peak tracked memory: %.2f MB, peak RSS: %.2f MB", atomic_load(&(mem_stats.peak)) / 1048576.0, mem_stats.rss_peak / 1048576.0);
+    }
+
+    // write statistics of the run
+    if (program_arguments.stats_file != NULL && stats_write(program_arguments.stats_file, genome_arguments, &program_arguments)) {
+        log1(INFO, "Statistics are written to %s", program_arguments.stats_file);
+    }
 
     // cleanup
     free_args(genome_arguments, &program_arguments);
@@ -6,6 +6,10 @@ void printUsage() {
     printf("\tfa:   Processing assembled genomes.\n");
     printf("\tfq:   Processing genomes' reads.\n");
     printf("\tld:   Processing precomputed cores.\n");
+    printf("\tserve: Serving distance queries against a signature database.\n");
+    printf("\tmerge: Merging distance shards into distance matrices.\n");
+    printf("\tsketch: Writing signatures of genomes to a file.\n");
+    printf("\tdist: Calculating distances of signature files.\n");
 }
 
 void printFaUsage() {
@@ -13,13 +17,28 @@ void printFaUsage() {
     printf("Options:\n");
     printf("\t-i [filename]   The file contains filenames of genomes.\n\n");
     printf("\t-l [num]        Lcp-level. [Default: 4]\n\n");
+    printf("\t--window [num]  Process sequences in windows of the given bases, at least 32768. [Default: 0, at once]\n\n");
+    printf("\t--split-n [num] Split sequences at runs of at least the given number of Ns. [Default: 0, no split]\n\n");
+    printf("\t--drop-masked   Skip soft-masked (lowercase) regions. [Default: false]\n\n");
     printf("\t-t [num]        Number of threads. [Default: 8]\n\n");
     printf("\t--min-cc [num]  Minimum frequency (core count) for a core. [Default: 1]\n\n");
     printf("\t--max-cc [num]  Maximum frequency (core count) for a core. [Default: UINT32_MAX]\n\n");
     printf("\t[--set|--vec]   Distances based or set or vector of cores. [Default: set]\n\n");
+    printf("\t--key [type]    Key cores are compared by: core (64-bit label and length), label (32-bit) or hash (32-bit hash of both). [Default: core]\n\n");
+    printf("\t--dict          Encode signatures as bitmaps over a dictionary of the cores of all genomes. [Default: false]\n\n");
+    printf("\t--compress      Keep signatures compressed in blocks of bit-packed gaps. [Default: false]\n\n");
+    printf("\t--partitions [num] Split signatures into the given power of 2 of buckets, compared in parallel. [Default: 1]\n\n");
     printf("\t-o [filename]   Store cores.\n\n");
     printf("\t-p [prefix]     Prefix for the results. [Default: gc]\n\n");
     printf("\t-s [filename]   Set short names of input files. Default is first 10 characters of input file names.\n\n");
+    printf("\t--cache-dir [dir] Reuse signatures of unchanged inputs from the directory.\n\n");
+    printf("\t--pin           Pin threads to cpus over NUMA nodes. [Default: false]\n\n");
+    printf("\t--stats [filename] Write timing and throughput statistics as JSON.\n\n");
+    printf("\t--log-level [level] Lowest level of logged messages: info, warn or error. [Default: info]\n\n");
+    printf("\t--progress [sec] Report progress, throughput and ETA every given seconds.\n\n");
+    printf("\t--status-file [filename] Keep the latest progress report in the file as JSON.\n\n");
+    printf("\t--db [filename] Write the signatures into a database that can be served.\n\n");
+    printf("\t--shard [i/n]   Compute only the i-th of n distance shards, to be merged with merge.\n\n");
     printf("\t-v              Verbose. [Default: false]\n\n");
 }
 
@@ -28,13 +47,95 @@ void printFqUsage() {
     printf("Options:\n");
     printf("\t-i [filename]   The file contains filenames of genomes.\n\n");
     printf("\t-l [num]        Lcp-level. [Default: 4]\n\n");
+    printf("\t--window [num]  Process sequences in windows of the given bases, at least 32768. [Default: 0, at once]\n\n");
+    printf("\t--split-n [num] Split sequences at runs of at least the given number of Ns. [Default: 0, no split]\n\n");
+    printf("\t--drop-masked   Skip soft-masked (lowercase) regions. [Default: false]\n\n");
     printf("\t-t [num]        Number of threads. [Default: 8]\n\n");
     printf("\t--min-cc [num]  Minimum frequency (core count) for a core. [Default: 15]\n\n");
     printf("\t--max-cc [num]  Maximum frequency (core count) for a core. [Default: 256]\n\n");
+    printf("\t--auto-cc       Pick min-cc and max-cc per input from its core abundance histogram, --min-cc and\n");
+    printf("\t                --max-cc are only kept for inputs without an error trough. [Default: false]\n\n");
     printf("\t[--set|--vec]   Distances based or set or vector of cores. [Default: set]\n\n");
+    printf("\t--key [type]    Key cores are compared by: core (64-bit label and length), label (32-bit) or hash (32-bit hash of both). [Default: core]\n\n");
+    printf("\t--dict          Encode signatures as bitmaps over a dictionary of the cores of all genomes. [Default: false]\n\n");
+    printf("\t--compress      Keep signatures compressed in blocks of bit-packed gaps. [Default: false]\n\n");
+    printf("\t--partitions [num] Split signatures into the given power of 2 of buckets, compared in parallel. [Default: 1]\n\n");
     printf("\t-o [filename]   Store cores.\n\n");
     printf("\t-p [prefix]     Prefix for the results. [Default: gc]\n\n");
     printf("\t-s [filename]   Set short names of input files. Default is first 10 characters of input file names.\n\n");
+    printf("\t--cache-dir [dir] Reuse signatures of unchanged inputs from the directory.\n\n");
+    printf("\t--pin           Pin threads to cpus over NUMA nodes. [Default: false]\n\n");
+    printf("\t--stats [filename] Write timing and throughput statistics as JSON.\n\n");
+    printf("\t--log-level [level] Lowest level of logged messages: info, warn or error. [Default: info]\n\n");
+    printf("\t--progress [sec] Report progress, throughput and ETA every given seconds.\n\n");
+    printf("\t--status-file [filename] Keep the latest progress report in the file as JSON.\n\n");
+    printf("\t--db [filename] Write the signatures into a database that can be served.\n\n");
+    printf("\t--shard [i/n]   Compute only the i-th of n distance shards, to be merged with merge.\n\n");
+    printf("\t-v              Verbose. [Default: false]\n\n");
+}
+
+void printServeUsage() {
+    printf("Usage: ./gencore serve [OPTIONS]\n\n");
+    printf("Options:\n");
+    printf("\t--db [filename]  Signature database written by fa or fq with --db.\n\n");
+    printf("\t--socket [path]  Unix socket to listen on. [Default: gencore.sock]\n\n");
+    printf("\t-t [num]         Number of threads. [Default: 8]\n\n");
+    printf("\t--pin            Pin threads to cpus over NUMA nodes. [Default: false]\n\n");
+    printf("\t--log-level [level] Lowest level of logged messages: info, warn or error. [Default: info]\n\n");
+    printf("\t-v               Verbose, logs every query. [Default: false]\n\n");
+}
+
+void printMergeUsage() {
+    printf("Usage: ./gencore merge [OPTIONS]\n\n");
+    printf("Options:\n");
+    printf("\t-i [filename]   The file contains filenames of distance shards.\n\n");
+    printf("\t-p [prefix]     Prefix for the results. [Default: gc]\n\n");
+    printf("\t--log-level [level] Lowest level of logged messages: info, warn or error. [Default: info]\n\n");
+}
+
+void printSketchUsage() {
+    printf("Usage: ./gencore sketch [OPTIONS]\n\n");
+    printf("Options:\n");
+    printf("\t-i [filename]   The file contains filenames of genomes.\n\n");
+    printf("\t--fq            Inputs are reads, with the defaults of fq. [Default: assemblies]\n\n");
+    printf("\t--db [filename] Signature file to write. [Default: [prefix].gsdb]\n\n");
+    printf("\t-l [num]        Lcp-level. [Default: 4]\n\n");
+    printf("\t--window [num]  Process sequences in windows of the given bases, at least 32768. [Default: 0, at once]\n\n");
+    printf("\t--split-n [num] Split sequences at runs of at least the given number of Ns. [Default: 0, no split]\n\n");
+    printf("\t--drop-masked   Skip soft-masked (lowercase) regions. [Default: false]\n\n");
+    printf("\t-t [num]        Number of threads. [Default: 8]\n\n");
+    printf("\t--min-cc [num]  Minimum frequency (core count) for a core. [Default: 1, 15 with --fq]\n\n");
+    printf("\t--max-cc [num]  Maximum frequency (core count) for a core. [Default: UINT32_MAX, 256 with --fq]\n\n");
+    printf("\t--auto-cc       Pick min-cc and max-cc per input from its core abundance histogram, with --fq. --min-cc\n");
+    printf("\t                and --max-cc are only kept for inputs without an error trough. [Default: false]\n\n");
+    printf("\t[--set|--vec]   Distances based or set or vector of cores. [Default: set]\n\n");
+    printf("\t--key [type]    Key cores are compared by: core (64-bit label and length), label (32-bit) or hash (32-bit hash of both). [Default: core]\n\n");
+    printf("\t-p [prefix]     Prefix for the results. [Default: gc]\n\n");
+    printf("\t-s [filename]   Set short names of input files. Default is first 10 characters of input file names.\n\n");
+    printf("\t--cache-dir [dir] Reuse signatures of unchanged inputs from the directory.\n\n");
+    printf("\t--pin           Pin threads to cpus over NUMA nodes. [Default: false]\n\n");
+    printf("\t--stats [filename] Write timing and throughput statistics as JSON.\n\n");
+    printf("\t--log-level [level] Lowest level of logged messages: info, warn or error. [Default: info]\n\n");
+    printf("\t--progress [sec] Report progress, throughput and ETA every given seconds.\n\n");
+    printf("\t--status-file [filename] Keep the latest progress report in the file as JSON.\n\n");
+    printf("\t-v              Verbose. [Default: false]\n\n");
+}
+
+void printDistUsage() {
+    printf("Usage: ./gencore dist [OPTIONS]\n\n");
+    printf("Options:\n");
+    printf("\t-i [filename]   The file contains filenames of signature files written by sketch.\n\n");
+    printf("\t-t [num]        Number of threads. [Default: 8]\n\n");
+    printf("\t--dict          Encode signatures as bitmaps over a dictionary of the cores of all genomes. [Default: false]\n\n");
+    printf("\t--compress      Keep signatures compressed in blocks of bit-packed gaps. [Default: false]\n\n");
+    printf("\t--partitions [num] Split signatures into the given power of 2 of buckets, compared in parallel. [Default: 1]\n\n");
+    printf("\t-p [prefix]     Prefix for the results. [Default: gc]\n\n");
+    printf("\t--shard [i/n]   Compute only the i-th of n distance shards, to be merged with merge.\n\n");
+    printf("\t--pin           Pin threads to cpus over NUMA nodes. [Default: false]\n\n");
+    printf("\t--stats [filename] Write timing and throughput statistics as JSON.\n\n");
+    printf("\t--log-level [level] Lowest level of logged messages: info, warn or error. [Default: info]\n\n");
+    printf("\t--progress [sec] Report progress, throughput and ETA every given seconds.\n\n");
+    printf("\t--status-file [filename] Keep the latest progress report in the file as JSON.\n\n");
     printf("\t-v              Verbose. [Default: false]\n\n");
 }
 
@@ -46,6 +147,18 @@ void printUsage2(program_mode mode) {
     case FQ:
         printFqUsage();
         break;
+    case SERVE:
+        printServeUsage();
+        break;
+    case MERGE:
+        printMergeUsage();
+        break;
+    case SKETCH:
+        printSketchUsage();
+        break;
+    case DIST:
+        printDistUsage();
+        break;
     default:
         break;
     }
@@ -135,6 +248,94 @@ void free_targs(struct gargs **genome_arguments, struct pargs *program_arguments
     }
 }
 
+struct coredict *create_dict() {
+    struct coredict *dict = (struct coredict *)malloc(sizeof(struct coredict));
+    if (dict == NULL) {
+        log1(ERROR, "Memory allocation failed for the core dictionary.");
+        exit(EXIT_FAILURE);
+    }
+    coredict_init(dict);
+    return dict;
+}
+
+void parse_signatures(const char *filename, struct gargs **genome_arguments, struct pargs *program_arguments, int use_dict, int compress, uint32_t partitions, int verbose) {
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        log1(ERROR, "Could not open file: %s", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    char buffer[1024];
+    int files = 0;
+
+    *genome_arguments = NULL;
+    program_arguments->number_of_genomes = 0;
+
+    while (fgets(buffer, sizeof(buffer), file)) {
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        if (buffer[0] == '\0') {
+            continue;
+        }
+        if (!sigdb_load(buffer, genome_arguments, &(program_arguments->number_of_genomes), &(program_arguments->input_mode))) {
+            fclose(file);
+            exit(EXIT_FAILURE);
+        }
+        files++;
+    }
+
+    fclose(file);
+
+    if (program_arguments->number_of_genomes == 0) {
+        log1(ERROR, "No signatures are given in %s", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((use_dict || compress) && (*genome_arguments)[0].sct == VECTOR) {
+        log1(ERROR, "Signatures can only be encoded with %s for set distances.", use_dict ? "--dict" : "--compress");
+        exit(EXIT_FAILURE);
+    }
+
+    struct coredict *dict = use_dict ? create_dict() : NULL;
+
+    for (int i=0; i<program_arguments->number_of_genomes; i++) {
+        (*genome_arguments)[i].dict = dict;
+        (*genome_arguments)[i].compress = compress;
+        (*genome_arguments)[i].partitions = partitions;
+        (*genome_arguments)[i].partition_offsets = NULL;
+        (*genome_arguments)[i].outFileName = NULL;
+        (*genome_arguments)[i].cache_dir = NULL;
+        (*genome_arguments)[i].write_lcpt = 0;
+        (*genome_arguments)[i].verbose = verbose;
+    }
+
+    program_arguments->thread_number = program_arguments->thread_number < program_arguments->number_of_genomes ? program_arguments->thread_number : program_arguments->number_of_genomes;
+
+    log1(INFO, "Program mode: DIST");
+    log1(INFO, "Signatures: %d from %d files", program_arguments->number_of_genomes, files);
+    log1(INFO, "Thread number: %d", program_arguments->thread_number);
+    log1(INFO, "Prefix: %s", program_arguments->prefix);
+    log1(INFO, "LCP level: %d", (*genome_arguments)[0].lcp_level);
+    log1(INFO, "Distance calculation mode: %s", ((*genome_arguments)[0].sct == SET ? "set" : "vector"));
+    log1(INFO, "Core keys: %s", key_name((*genome_arguments)[0].key));
+
+    if (dict != NULL) {
+        log1(INFO, "Signatures are encoded with a core dictionary");
+    }
+
+    if (compress) {
+        log1(INFO, "Signatures are compressed in blocks of %d cores", BLOCKSIG_SIZE);
+    }
+
+    if (partitions > 1) {
+        log1(INFO, "Signatures are split into %u partitions", partitions);
+    }
+
+    if (program_arguments->shard_count) {
+        log1(INFO, "Distance shard: %d/%d", program_arguments->shard_index, program_arguments->shard_count);
+    }
+}
+
 void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs *program_arguments) {
 
     if (argc < 2) {
@@ -148,16 +349,43 @@ void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs
 
     if (strcmp(argv[1], "fa") == 0) {
         program_arguments->mode = FA;
+        program_arguments->input_mode = FA;
         min_cc = 0;
         max_cc = UINT32_MAX;
         apply_filter = 0;
     } else if (strcmp(argv[1], "fq") == 0) {
         program_arguments->mode = FQ;
+        program_arguments->input_mode = FQ;
         min_cc = 15;
         max_cc = 256;
         apply_filter = 1;
     } else if (strcmp(argv[1], "ld") == 0) {
         program_arguments->mode = LOAD;
+        program_arguments->input_mode = LOAD;
+        min_cc = 0;
+        max_cc = UINT32_MAX;
+        apply_filter = 0;
+    } else if (strcmp(argv[1], "serve") == 0) {
+        program_arguments->mode = SERVE;
+        program_arguments->input_mode = FA;
+        min_cc = 0;
+        max_cc = UINT32_MAX;
+        apply_filter = 0;
+    } else if (strcmp(argv[1], "merge") == 0) {
+        program_arguments->mode = MERGE;
+        program_arguments->input_mode = FA;
+        min_cc = 0;
+        max_cc = UINT32_MAX;
+        apply_filter = 0;
+    } else if (strcmp(argv[1], "sketch") == 0) {
+        program_arguments->mode = SKETCH;
+        program_arguments->input_mode = FA;
+        min_cc = 0;
+        max_cc = UINT32_MAX;
+        apply_filter = 0;
+    } else if (strcmp(argv[1], "dist") == 0) {
+        program_arguments->mode = DIST;
+        program_arguments->input_mode = FA;
         min_cc = 0;
         max_cc = UINT32_MAX;
         apply_filter = 0;
@@ -171,6 +399,15 @@ void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs
     program_arguments->thread_number = 8;
     program_arguments->prefix = "gc";
     program_arguments->number_of_genomes = 0;
+    program_arguments->pin = 0;
+    program_arguments->stats_file = NULL;
+    program_arguments->progress_interval = 0;
+    program_arguments->status_file = NULL;
+    program_arguments->db_file = NULL;
+    program_arguments->socket_path = SERVE_DEFAULT_SOCKET;
+    program_arguments->shard_index = 0;
+    program_arguments->shard_count = 0;
+    program_arguments->shard_list = NULL;
 
     struct option long_options[] = {
         {"min-cc", required_argument, NULL, 1},
@@ -179,6 +416,24 @@ void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs
         {"max-cc-file", required_argument, NULL, 4},
         {"set", no_argument, NULL, 5},
         {"vec", no_argument, NULL, 6},
+        {"cache-dir", required_argument, NULL, 7},
+        {"pin", no_argument, NULL, 8},
+        {"stats", required_argument, NULL, 9},
+        {"log-level", required_argument, NULL, 10},
+        {"progress", required_argument, NULL, 11},
+        {"status-file", required_argument, NULL, 12},
+        {"db", required_argument, NULL, 13},
+        {"socket", required_argument, NULL, 14},
+        {"shard", required_argument, NULL, 15},
+        {"fq", no_argument, NULL, 16},
+        {"window", required_argument, NULL, 17},
+        {"split-n", required_argument, NULL, 18},
+        {"drop-masked", no_argument, NULL, 19},
+        {"key", required_argument, NULL, 20},
+        {"dict", no_argument, NULL, 21},
+        {"compress", no_argument, NULL, 22},
+        {"partitions", required_argument, NULL, 23},
+        {"auto-cc", no_argument, NULL, 24},
         {NULL, 0, NULL, 0}
     };
 
@@ -187,10 +442,21 @@ void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs
     char *filename_inputs = NULL;
     char *filename_names = NULL;
     char *filename_outputs = NULL;
+    char *cache_dir = NULL;
     sim_calculation_type sct = SET;
+    key_type key = KEY_CORE;
     int lcp_level = 4;
+    uint64_t lcp_window = 0;
+    uint64_t n_split = 0;
+    int drop_masked = 0;
+    int use_dict = 0;
+    int compress = 0;
+    uint32_t partitions = 1;
+    int auto_cc = 0;
     int write_lcpt = 0;
     int verbose = 0;
+    int min_cc_given = 0;
+    int max_cc_given = 0;
 
     int opt;
     int long_index;
@@ -223,18 +489,22 @@ void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs
                 break;
             case 1: // --min-cc
                 min_cc = (uint32_t)strtol(optarg, &endptr, 10);
+                min_cc_given = 1;
                 apply_filter = 1;
                 break;
             case 2: // --min-cc-file
                 filename_min_cc = optarg;
+                min_cc_given = 1;
                 apply_filter = 1;
                 break;
             case 3: // --max-cc
                 max_cc = (uint32_t)strtol(optarg, &endptr, 10);
+                max_cc_given = 1;
                 apply_filter = 1;
                 break;
             case 4: // --max-cc-file
                 filename_max_cc = optarg;
+                max_cc_given = 1;
                 apply_filter = 1;
                 break;
             case 5: // --set
@@ -243,17 +513,223 @@ void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs
             case 6: // --vec
                 sct = VECTOR;
                 break;
+            case 7: // --cache-dir
+                cache_dir = optarg;
+                break;
+            case 8: // --pin
+                program_arguments->pin = 1;
+                break;
+            case 9: // --stats
+                program_arguments->stats_file = optarg;
+                break;
+            case 10: // --log-level
+                if (strcmp(optarg, "info") == 0) {
+                    log_set_level(INFO);
+                } else if (strcmp(optarg, "warn") == 0) {
+                    log_set_level(WARN);
+                } else if (strcmp(optarg, "error") == 0) {
+                    log_set_level(ERROR);
+                } else {
+                    log1(ERROR, "Invalid log level '%s', it should be info, warn or error.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 11: // --progress
+                program_arguments->progress_interval = atoi(optarg);
+                if (program_arguments->progress_interval <= 0) {
+                    log1(ERROR, "Progress interval should be a positive number of seconds.");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 12: // --status-file
+                program_arguments->status_file = optarg;
+                break;
+            case 13: // --db
+                program_arguments->db_file = optarg;
+                break;
+            case 14: // --socket
+                program_arguments->socket_path = optarg;
+                break;
+            case 15: // --shard
+                if (sscanf(optarg, "%d/%d", &(program_arguments->shard_index), &(program_arguments->shard_count)) != 2 ||
+                    program_arguments->shard_count < 1 || program_arguments->shard_index < 1 ||
+                    program_arguments->shard_index > program_arguments->shard_count) {
+                    log1(ERROR, "Invalid shard '%s', it should be i/n with 1 <= i <= n.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 16: // --fq
+                if (program_arguments->mode != SKETCH) {
+                    log1(ERROR, "--fq is only used by sketch.");
+                    exit(EXIT_FAILURE);
+                }
+                program_arguments->input_mode = FQ;
+                break;
+            case 17: // --window
+                lcp_window = strtoull(optarg, &endptr, 10);
+                if (*endptr != '\0') {
+                    log1(ERROR, "Invalid window '%s', it should be a number of bases.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                // smaller windows would spend most of LCP on the margins
+                if (lcp_window != 0 && lcp_window < 2 * LCP_WINDOW_MARGIN) {
+                    log1(ERROR, "Window %s is too small, it should be 0 or at least %d bases.", optarg, 2 * LCP_WINDOW_MARGIN);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 18: // --split-n
+                n_split = strtoull(optarg, &endptr, 10);
+                if (*endptr != '\0') {
+                    log1(ERROR, "Invalid N run length '%s', it should be a number of bases.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 19: // --drop-masked
+                drop_masked = 1;
+                break;
+            case 20: // --key
+                if (strcmp(optarg, "core") == 0) {
+                    key = KEY_CORE;
+                } else if (strcmp(optarg, "label") == 0) {
+                    key = KEY_LABEL;
+                } else if (strcmp(optarg, "hash") == 0) {
+                    key = KEY_HASH;
+                } else {
+                    log1(ERROR, "Invalid key type '%s', it should be core, label or hash.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 21: // --dict
+                use_dict = 1;
+                break;
+            case 22: // --compress
+                compress = 1;
+                break;
+            case 23: // --partitions
+                partitions = strtoul(optarg, &endptr, 10);
+                if (*endptr != '\0' || partitions == 0 || partitions > MAX_PARTITIONS || (partitions & (partitions - 1))) {
+                    log1(ERROR, "Invalid partitions '%s', it should be a power of 2 up to %d.", optarg, MAX_PARTITIONS);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 24: // --auto-cc
+                auto_cc = 1;
+                break;
             default:
                 exit(EXIT_FAILURE);
         }
     }
 
+    program_arguments->verbose = verbose;
+
+    // sketching reads uses the defaults of fq
+    if (program_arguments->mode == SKETCH && program_arguments->input_mode == FQ) {
+        min_cc = min_cc_given ? min_cc : 15;
+        max_cc = max_cc_given ? max_cc : 256;
+        apply_filter = 1;
+    }
+
+    // thresholds are picked from the coverage of reads
+    if (auto_cc) {
+        if (program_arguments->input_mode != FQ) {
+            log1(ERROR, "Core-count thresholds are only picked with --auto-cc for reads (fq or sketch --fq).");
+            exit(EXIT_FAILURE);
+        }
+        // --min-cc and --max-cc are the fallback of every input, per-input files would be ignored
+        if (filename_min_cc != NULL || filename_max_cc != NULL) {
+            log1(ERROR, "--min-cc-file and --max-cc-file cannot be used with --auto-cc.");
+            exit(EXIT_FAILURE);
+        }
+        apply_filter = 1;
+    }
+
+    if (program_arguments->mode == SKETCH && program_arguments->shard_count) {
+        log1(ERROR, "Distance shards are computed by fa, fq, ld or dist, not by sketch.");
+        exit(EXIT_FAILURE);
+    }
+
+    // sketch always writes its signatures
+    if (program_arguments->mode == SKETCH && program_arguments->db_file == NULL) {
+        size_t len = strlen(program_arguments->prefix) + strlen(".gsdb") + 1;
+        program_arguments->db_file = (char *)malloc(len);
+        if (program_arguments->db_file == NULL) {
+            log1(ERROR, "Memory allocation failed.");
+            exit(EXIT_FAILURE);
+        }
+        snprintf(program_arguments->db_file, len, "%s.gsdb", program_arguments->prefix);
+    }
+
+    // the server only needs its database
+    if (program_arguments->mode == SERVE) {
+        if (program_arguments->db_file == NULL) {
+            log1(ERROR, "Please provide the signature database to serve");
+            printUsage2(program_arguments->mode);
+            exit(EXIT_FAILURE);
+        }
+        *genome_arguments = NULL;
+        return;
+    }
+
+    // merging only needs the list of shards
+    if (program_arguments->mode == MERGE) {
+        if (filename_inputs == NULL) {
+            log1(ERROR, "Please provide the list of distance shards");
+            printUsage2(program_arguments->mode);
+            exit(EXIT_FAILURE);
+        }
+        program_arguments->shard_list = filename_inputs;
+        *genome_arguments = NULL;
+        return;
+    }
+
+    if (cache_dir != NULL && program_arguments->mode == LOAD) {
+        log1(WARN, "Signature cache is not used for precomputed cores.");
+        cache_dir = NULL;
+    }
+
+    if (cache_dir != NULL && mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+        log1(ERROR, "Could not create cache directory: %s", cache_dir);
+        exit(EXIT_FAILURE);
+    }
+
     if (filename_inputs == NULL) {
         log1(ERROR, "Please provide input function");
         printUsage2(program_arguments->mode);
         exit(EXIT_FAILURE);
     }
 
+    if (use_dict && compress) {
+        log1(ERROR, "Signatures can either be encoded with --dict or compressed with --compress.");
+        exit(EXIT_FAILURE);
+    }
+
+    if (partitions > 1 && (use_dict || compress)) {
+        log1(ERROR, "Signatures encoded with %s cannot be partitioned.", use_dict ? "--dict" : "--compress");
+        exit(EXIT_FAILURE);
+    }
+
+    // encoded signatures have no keys left to be written
+    if ((use_dict || compress) && program_arguments->db_file != NULL) {
+        log1(ERROR, "Signatures encoded with %s cannot be written to a signature database.", use_dict ? "--dict" : "--compress");
+        exit(EXIT_FAILURE);
+    }
+
+    // distances of signatures sketched before
+    if (program_arguments->mode == DIST) {
+        parse_signatures(filename_inputs, genome_arguments, program_arguments, use_dict, compress, partitions, verbose);
+        return;
+    }
+
+    if ((use_dict || compress) && sct == VECTOR) {
+        log1(ERROR, "Signatures can only be encoded with %s for set distances.", use_dict ? "--dict" : "--compress");
+        exit(EXIT_FAILURE);
+    }
+
+    struct coredict *dict = NULL;
+    if (use_dict) {
+        dict = create_dict();
+    }
+
     program_arguments->number_of_genomes = get_line_count(filename_inputs);
 
     if (program_arguments->number_of_genomes == -1) {
@@ -270,14 +746,37 @@ void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs
         (*genome_arguments)[i].apply_filter = apply_filter;
         (*genome_arguments)[i].min_cc = min_cc;
         (*genome_arguments)[i].max_cc = max_cc;
+        (*genome_arguments)[i].auto_cc = auto_cc;
+        (*genome_arguments)[i].fallback_min_cc = min_cc;
+        (*genome_arguments)[i].fallback_max_cc = max_cc;
+        (*genome_arguments)[i].cc_hist = NULL;
         (*genome_arguments)[i].inFileName = NULL;
         (*genome_arguments)[i].shortName = NULL;
         (*genome_arguments)[i].outFileName = NULL;
+        (*genome_arguments)[i].cache_dir = cache_dir;
         (*genome_arguments)[i].cores_len = 0;
+        (*genome_arguments)[i].cores_capacity = 0;
         (*genome_arguments)[i].cores = NULL;
         (*genome_arguments)[i].total_len = 0.0;
+        (*genome_arguments)[i].failed = 0;
+        (*genome_arguments)[i].dict = dict;
+        memset(&((*genome_arguments)[i].ids), 0, sizeof(struct bitmap));
+        (*genome_arguments)[i].compress = compress;
+        memset(&((*genome_arguments)[i].blocks), 0, sizeof(struct blocksig));
+        (*genome_arguments)[i].partitions = partitions;
+        (*genome_arguments)[i].partition_offsets = NULL;
+        (*genome_arguments)[i].work_estimate = 0;
+        (*genome_arguments)[i].work_seconds = 0.0;
+        (*genome_arguments)[i].numa_node = -1;
+        memset(&((*genome_arguments)[i].stats), 0, sizeof(struct gstats));
+        memset(&((*genome_arguments)[i].mem), 0, sizeof(struct memtrack));
         (*genome_arguments)[i].sct = sct;
+        (*genome_arguments)[i].key = key;
+        (*genome_arguments)[i].core_bases = 0;
         (*genome_arguments)[i].lcp_level = lcp_level;
+        (*genome_arguments)[i].lcp_window = lcp_window;
+        (*genome_arguments)[i].n_split = n_split;
+        (*genome_arguments)[i].drop_masked = drop_masked;
         (*genome_arguments)[i].write_lcpt = write_lcpt;
         (*genome_arguments)[i].verbose = verbose;
     }
@@ -294,6 +793,7 @@ void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs
         }
 
         char buffer[1024];
+        int stdin_inputs = 0;
  
         for (int i=0; i<program_arguments->number_of_genomes; i++) {
             if (read_line(file, buffer, &((*genome_arguments)[i].inFileName)) == -1) {
@@ -302,6 +802,13 @@ void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs
                 fclose(file);
                 exit(EXIT_FAILURE);
             }
+            if (strcmp((*genome_arguments)[i].inFileName, STDIN_INPUT) == 0 && stdin_inputs++) {
+                log1(ERROR, "Standard input (%s) can only be given once in the input list.", STDIN_INPUT);
+                free_targs(genome_arguments, program_arguments);
+                free(*genome_arguments);
+                fclose(file);
+                exit(EXIT_FAILURE);
+            }
         }
 
         fclose(file);
@@ -378,7 +885,9 @@ void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs
     } else {
         for (int i=0; i<program_arguments->number_of_genomes; i++) {
             (*genome_arguments)[i].shortName = strdup((*genome_arguments)[i].inFileName);
-            (*genome_arguments)[i].shortName[10] = '\0';
+            if (strlen((*genome_arguments)[i].shortName) > 10) {
+                (*genome_arguments)[i].shortName[10] = '\0';
+            }
         }
     }
 
@@ -406,25 +915,68 @@ void parse(int argc, char **argv, struct gargs **genome_arguments, struct pargs
     }
 
     // log parameters
-    if (strcmp(argv[1], "fa") == 0) {
+    // argv is permuted by getopt_long, so the mode is taken from the arguments
+    if (program_arguments->mode == FA) {
         log1(INFO, "Program mode: FA");
-    } else if (strcmp(argv[1], "fq") == 0) {
+    } else if (program_arguments->mode == FQ) {
         log1(INFO, "Program mode: FQ");
-    } else if (strcmp(argv[1], "bam") == 0) {
-        log1(INFO, "Program mode: BAM");
-    } else if (strcmp(argv[1], "ld") == 0) {
+    } else if (program_arguments->mode == LOAD) {
         log1(INFO, "Program mode: LOAD");
+    } else if (program_arguments->mode == SKETCH) {
+        log1(INFO, "Program mode: SKETCH (%s)", program_arguments->input_mode == FQ ? "reads" : "assemblies");
+        log1(INFO, "Signatures are written to: %s", program_arguments->db_file);
     }
 
     log1(INFO, "Thread number: %d", program_arguments->thread_number);
     log1(INFO, "Prefix: %s", program_arguments->prefix);
     log1(INFO, "LCP level: %d", (*genome_arguments)[0].lcp_level);
     log1(INFO, "Distance calculation mode: %s", ((*genome_arguments)[0].sct == SET ? "set" : "vector"));
+    log1(INFO, "Core keys: %s", key_name(key));
+
+    if (auto_cc) {
+        log1(INFO, "Core-count thresholds are picked from the core abundance histograms, with min-cc %u and max-cc %u if a histogram has no error trough", min_cc, max_cc);
+    }
+
+    if (dict != NULL) {
+        log1(INFO, "Signatures are encoded with a core dictionary");
+    }
+
+    if (compress) {
+        log1(INFO, "Signatures are compressed in blocks of %d cores", BLOCKSIG_SIZE);
+    }
+
+    if (partitions > 1) {
+        log1(INFO, "Signatures are split into %u partitions", partitions);
+    }
+
+    if (lcp_window) {
+        log1(INFO, "LCP window: %lu bases, with %d bases of context on both sides", lcp_window, LCP_WINDOW_MARGIN);
+    }
+
+    if (n_split) {
+        log1(INFO, "Sequences are split at runs of at least %lu Ns", n_split);
+    }
+
+    if (drop_masked) {
+        log1(INFO, "Soft-masked regions are skipped");
+    }
 
     if ((*genome_arguments)[0].write_lcpt) { 
         log1(INFO, "Program will write cores to files.");
     }
 
+    if (cache_dir != NULL) {
+        log1(INFO, "Signature cache: %s", cache_dir);
+    }
+
+    if (program_arguments->pin) {
+        log1(INFO, "Threads are pinned to cpus.");
+    }
+
+    if (program_arguments->shard_count) {
+        log1(INFO, "Distance shard: %d/%d", program_arguments->shard_index, program_arguments->shard_count);
+    }
+
     if ((*genome_arguments)[0].verbose) {
         for (int i=0; i<program_arguments->number_of_genomes; i++) {
             if ((*genome_arguments)[i].apply_filter) {
@@ -3,10 +3,14 @@
 
 #include "args.h"
 #include "utils.h" // logging
+#include "serve.h" // default socket
+#include "sigdb.h" // signature files of dist
+#include "sink.h" // window margin
 #include <stdio.h>
 #include <errno.h> // errno
 #include <limits.h> // UINT32_MAX
 #include <getopt.h>
+#include <sys/stat.h> // mkdir
 
 #ifndef THREAD_NUMBER
 #define THREAD_NUMBER 8
@@ -20,8 +24,8 @@
 #define PREFIX "gc"
 #endif
 
-#ifndef COMPRESSION_RATIO
-#define COMPRESSION_RATIO 4
+#ifndef MAX_PARTITIONS
+#define MAX_PARTITIONS 4096 // buckets a signature can be split into with --partitions
 #endif
 
 /**
@@ -0,0 +1,200 @@
+// Kernels over sorted core keys, specialized for one key width.
+//
+// This file is included once per width with `KEY_T` set to the key type and
+// `KEY_SUFFIX` to the suffix of the generated functions, e.g.
+//
+//     #define KEY_T uint32_t
+//     #define KEY_SUFFIX 32
+//     #include "keykernels.h"
+//
+// which defines `radix_sort_32`, `ui_size_32`, `count_keys_32`,
+// `filter_keys_32`, `unique_keys_32` and `lower_bound_32`. There is deliberately no include guard.
+
+#define KEY_CONCAT_(name, suffix) name##_##suffix
+#define KEY_CONCAT(name, suffix) KEY_CONCAT_(name, suffix)
+#define KEY_FUNC(name) KEY_CONCAT(name, KEY_SUFFIX)
+
+#ifndef KEY_RADIX_SMALL
+#define KEY_RADIX_SMALL 64 // buckets of at most this many keys are sorted by insertion
+#endif
+
+/**
+ * In-place MSD radix sort on bytes, starting at the given shift. Buckets are
+ * permuted in place by cycles, so no second buffer is needed, and a byte
+ * shared by all keys of a bucket is skipped without a pass over them.
+ */
+static void KEY_FUNC(radix_sort)(KEY_T *keys, uint64_t len, int shift) {
+
+    if (len <= KEY_RADIX_SMALL) {
+        for (uint64_t i=1; i<len; i++) {
+            KEY_T key = keys[i];
+            uint64_t j = i;
+            for (; j>0 && keys[j-1]>key; j--) {
+                keys[j] = keys[j-1];
+            }
+            keys[j] = key;
+        }
+        return;
+    }
+
+    uint64_t count[256] = {0};
+    for (uint64_t i=0; i<len; i++) {
+        count[(keys[i] >> shift) & 0xFF]++;
+    }
+
+    if (count[(keys[0] >> shift) & 0xFF] == len) {
+        if (shift) {
+            KEY_FUNC(radix_sort)(keys, len, shift - 8);
+        }
+        return;
+    }
+
+    uint64_t head[256], tail[256];
+    uint64_t sum = 0;
+    for (int b=0; b<256; b++) {
+        head[b] = sum;
+        sum += count[b];
+        tail[b] = sum;
+    }
+
+    for (int b=0; b<256; b++) {
+        while (head[b] < tail[b]) {
+            KEY_T key = keys[head[b]];
+            int digit = (key >> shift) & 0xFF;
+            while (digit != b) {
+                KEY_T temp = keys[head[digit]];
+                keys[head[digit]++] = key;
+                key = temp;
+                digit = (key >> shift) & 0xFF;
+            }
+            keys[head[b]++] = key;
+        }
+    }
+
+    if (shift) {
+        for (int b=0; b<256; b++) {
+            if (count[b] > 1) {
+                KEY_FUNC(radix_sort)(keys + tail[b] - count[b], count[b], shift - 8);
+            }
+        }
+    }
+}
+
+/**
+ * Sizes of the intersection and union of two sorted key arrays, by merging.
+ */
+static void KEY_FUNC(ui_size)(const KEY_T *keys1, uint64_t size1, const KEY_T *keys2, uint64_t size2, uint64_t *interSize, uint64_t *unionSize) {
+
+    uint64_t is = 0;
+    uint64_t us = 0;
+    uint64_t index1 = 0;
+    uint64_t index2 = 0;
+
+    while (index1 < size1 && index2 < size2) {
+        us++;
+
+        if (keys1[index1] == keys2[index2]) {
+            is++;
+            index1++;
+            index2++;
+        } else if (keys1[index1] < keys2[index2]) {
+            index1++;
+        } else {
+            index2++;
+        }
+    }
+
+    us += (size1-index1);
+    us += (size2-index2);
+
+    *interSize = is;
+    *unionSize = us;
+}
+
+/**
+ * Adds the number of distinct keys of a sorted array occurring `c` times to
+ * `hist[c]`. Counts of `bins - 1` and more are added to the last bin.
+ */
+static void KEY_FUNC(count_keys)(const KEY_T *keys, uint64_t len, uint64_t *hist, uint32_t bins) {
+
+    uint64_t i = 0;
+
+    while (i<len) {
+        uint64_t freq = 1;
+
+        for (uint64_t j=i+1; j<len && keys[i]==keys[j]; j++, freq++);
+
+        hist[freq < bins ? freq : bins - 1]++;
+        i += freq;
+    }
+}
+
+/**
+ * Keeps the keys of a sorted array that occur between `min_cc` and `max_cc`
+ * times, with all their occurrences. Returns the number of keys kept.
+ */
+static uint64_t KEY_FUNC(filter_keys)(KEY_T *keys, uint64_t len, uint32_t min_cc, uint32_t max_cc) {
+
+    uint64_t index = 0;
+    uint64_t i = 0;
+
+    while (i<len) {
+        uint64_t freq = 1;
+
+        for (uint64_t j=i+1; j<len && keys[i]==keys[j]; j++, freq++);
+
+        if (min_cc<=freq && freq<=max_cc) {
+            memmove(&(keys[index]), &(keys[i]), freq * sizeof(KEY_T));
+            index += freq;
+        }
+
+        i += freq;
+    }
+
+    return index;
+}
+
+/**
+ * Removes repeated keys of a sorted array. Returns the number of distinct keys.
+ */
+static uint64_t KEY_FUNC(unique_keys)(KEY_T *keys, uint64_t len) {
+
+    if (len == 0) {
+        return 0;
+    }
+
+    uint64_t index = 0;
+
+    for (uint64_t i=1; i<len; i++) {
+        if (keys[index] != keys[i]) {
+            keys[++index] = keys[i];
+        }
+    }
+
+    return index + 1;
+}
+
+/**
+ * Index of the first key of a sorted array that is not less than the given value.
+ */
+static uint64_t KEY_FUNC(lower_bound)(const KEY_T *keys, uint64_t len, uint64_t value) {
+
+    uint64_t low = 0, high = len;
+
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (keys[mid] < value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+#undef KEY_FUNC
+#undef KEY_CONCAT
+#undef KEY_CONCAT_
+#undef KEY_T
+#undef KEY_SUFFIX
@@ -0,0 +1,249 @@
+#include "log.h"
+#include <stdlib.h>
+#include <sched.h>
+
+static struct logger logger = {
+    .level = INFO,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+static pthread_mutex_t sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *level_name(LogLevel level) {
+    switch (level) {
+        case INFO:
+            return "INFO";
+        case WARN:
+            return "WARN";
+        case ERROR:
+            return "ERROR";
+    }
+    return "";
+}
+
+/**
+ * Writes a message with its prefix. The formatted prefix is reused while
+ * messages of the same second are written.
+ */
+static void write_message(FILE *out, time_t now, LogLevel level, const char *message) {
+    static _Thread_local time_t last = -1;
+    static _Thread_local char prefix[32];
+
+    if (now != last) {
+        struct tm local;
+        localtime_r(&now, &local);
+        strftime(prefix, sizeof(prefix), "[%d-%m-%Y %H:%M:%S]", &local);
+        last = now;
+    }
+
+    fprintf(out, "%s [%s] %s\n", prefix, level_name(level), message);
+}
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// MARK: Drainer
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+/**
+ * Writes out every message that is ready and returns how many there were.
+ */
+static uint64_t log_drain() {
+    uint64_t tail = atomic_load_explicit(&(logger.tail), memory_order_relaxed);
+    uint64_t count = 0;
+
+    for (;;) {
+        struct log_slot *slot = &(logger.slots[tail & (LOG_RING_SIZE-1)]);
+        if (atomic_load_explicit(&(slot->seq), memory_order_acquire) != tail+1) {
+            break;
+        }
+
+        write_message(logger.out, slot->time, slot->level, slot->message);
+
+        // hand the slot to the producer one lap ahead
+        atomic_store_explicit(&(slot->seq), tail+LOG_RING_SIZE, memory_order_release);
+        tail++;
+        count++;
+        atomic_store_explicit(&(logger.tail), tail, memory_order_release);
+    }
+
+    if (count) {
+        fflush(logger.out);
+    }
+
+    return count;
+}
+
+static void *log_drainer(void *arg) {
+    (void)arg;
+
+    while (atomic_load_explicit(&(logger.running), memory_order_acquire)) {
+        if (log_drain()) {
+            continue;
+        }
+
+        // producers only signal while the drainer sleeps, the timeout bounds
+        // the latency of a wakeup that raced with going to sleep
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_IDLE_WAIT_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        pthread_mutex_lock(&(logger.mutex));
+        atomic_store(&(logger.sleeping), 1);
+        if (atomic_load(&(logger.head)) == atomic_load_explicit(&(logger.tail), memory_order_relaxed) && atomic_load(&(logger.running))) {
+            pthread_cond_timedwait(&(logger.cond), &(logger.mutex), &deadline);
+        }
+        atomic_store(&(logger.sleeping), 0);
+        pthread_mutex_unlock(&(logger.mutex));
+    }
+
+    log_drain();
+
+    return NULL;
+}
+
+/**
+ * Wakes up the drainer if it sleeps. The mutex is not taken, so producers
+ * never wait for each other or for the drainer; a signal that comes before
+ * the drainer waits is lost, and the timeout of its wait picks the message up.
+ */
+static void log_wake() {
+    if (atomic_load(&(logger.sleeping))) {
+        pthread_cond_signal(&(logger.cond));
+    }
+}
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// MARK: Interface
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+void log_init(LogLevel level) {
+    static int registered = 0;
+
+    log_set_level(level);
+
+    if (atomic_load(&(logger.running))) {
+        return;
+    }
+
+    logger.out = stdout;
+    if (logger.slots == NULL) {
+        logger.slots = (struct log_slot *)malloc(LOG_RING_SIZE * sizeof(struct log_slot));
+    }
+    if (logger.slots == NULL) {
+        return; // messages are written synchronously
+    }
+
+    uint64_t head = atomic_load(&(logger.head));
+    for (uint64_t i=0; i<LOG_RING_SIZE; i++) {
+        atomic_init(&(logger.slots[(head+i) & (LOG_RING_SIZE-1)].seq), head+i);
+    }
+    atomic_store(&(logger.tail), head);
+    atomic_store(&(logger.running), 1);
+
+    if (pthread_create(&(logger.drainer), NULL, log_drainer, NULL) != 0) {
+        atomic_store(&(logger.running), 0);
+        return;
+    }
+
+    if (!registered) {
+        atexit(log_shutdown);
+        registered = 1;
+    }
+}
+
+void log_set_level(LogLevel level) {
+    atomic_store(&(logger.level), level);
+}
+
+void log_flush() {
+    if (!atomic_load(&(logger.running))) {
+        return;
+    }
+
+    uint64_t head = atomic_load(&(logger.head));
+    while (atomic_load_explicit(&(logger.tail), memory_order_acquire) < head && atomic_load(&(logger.running))) {
+        log_wake();
+        sched_yield();
+    }
+}
+
+void log_shutdown() {
+    if (!atomic_exchange(&(logger.running), 0)) {
+        return;
+    }
+
+    pthread_mutex_lock(&(logger.mutex));
+    pthread_cond_signal(&(logger.cond));
+    pthread_mutex_unlock(&(logger.mutex));
+
+    pthread_join(logger.drainer, NULL);
+
+    // the ring is kept, a thread still logging during exit may be writing to it
+    log_drain();
+}
+
+int log1(LogLevel level, const char *format, ...) {
+    if ((int)level < atomic_load_explicit(&(logger.level), memory_order_relaxed)) {
+        return 1;
+    }
+
+    va_list args;
+    va_start(args, format);
+
+    if (!atomic_load_explicit(&(logger.running), memory_order_acquire)) {
+        char message[LOG_MESSAGE_SIZE];
+        vsnprintf(message, sizeof(message), format, args);
+        va_end(args);
+
+        pthread_mutex_lock(&sync_mutex);
+        write_message(stdout, time(NULL), level, message);
+        fflush(stdout);
+        pthread_mutex_unlock(&sync_mutex);
+
+        return 1;
+    }
+
+    // claim a slot
+    struct log_slot *slot;
+    uint64_t pos = atomic_load_explicit(&(logger.head), memory_order_relaxed);
+
+    for (;;) {
+        slot = &(logger.slots[pos & (LOG_RING_SIZE-1)]);
+        uint64_t seq = atomic_load_explicit(&(slot->seq), memory_order_acquire);
+        int64_t diff = (int64_t)(seq - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&(logger.head), &pos, pos+1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the ring is full
+            log_wake();
+            sched_yield();
+            pos = atomic_load_explicit(&(logger.head), memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&(logger.head), memory_order_relaxed);
+        }
+    }
+
+    slot->time = time(NULL);
+    slot->level = level;
+    vsnprintf(slot->message, LOG_MESSAGE_SIZE, format, args);
+    va_end(args);
+
+    atomic_store_explicit(&(slot->seq), pos+1, memory_order_release);
+
+    log_wake();
+
+    if (level == ERROR) {
+        log_flush();
+    }
+
+    return 1;
+}
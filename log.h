@@ -0,0 +1,100 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#define LOG_RING_SIZE 4096 // number of slots, must be a power of two
+#define LOG_MESSAGE_SIZE 256 // longer messages are truncated
+#define LOG_IDLE_WAIT_MS 10
+
+typedef enum {
+    INFO,
+    WARN,
+    ERROR
+} LogLevel;
+
+/**
+ * @brief A formatted message waiting in the ring buffer.
+ *
+ * The sequence number tells whose turn it is on the slot: it equals the
+ * position when the slot is free to be written at that position and the
+ * position plus one once the message there is ready to be drained.
+ */
+struct log_slot {
+    _Atomic uint64_t seq;
+    time_t time;
+    LogLevel level;
+    char message[LOG_MESSAGE_SIZE];
+};
+
+/**
+ * @brief Bounded multi-producer single-consumer ring of log messages.
+ *
+ * Threads format their messages into a slot they claim with a single CAS on
+ * the head and a background thread writes them out in batches, so logging
+ * never holds a lock shared between workers. Waking up the sleeping drainer
+ * only signals its condition variable, a wakeup lost to the race with going
+ * to sleep delays the message by at most `LOG_IDLE_WAIT_MS`. A full ring makes producers
+ * yield until the drainer frees a slot; messages are never dropped.
+ */
+struct logger {
+    struct log_slot *slots;
+    _Atomic uint64_t head __attribute__((aligned(64))); // next position to write
+    _Atomic uint64_t tail __attribute__((aligned(64))); // next position to drain
+    _Atomic int level;
+    _Atomic int running;
+    _Atomic int sleeping;
+    pthread_t drainer;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    FILE *out;
+};
+
+/**
+ * @brief Starts the background thread that writes log messages.
+ *
+ * Messages logged before the logger is started or after it is shut down
+ * are written synchronously. The logger is shut down at exit, so messages
+ * logged right before `exit` are not lost.
+ *
+ * @param level Messages below this level are discarded.
+ */
+void log_init(LogLevel level);
+
+/**
+ * @brief Sets the lowest level of messages that are logged.
+ *
+ * @param level The minimum log level.
+ */
+void log_set_level(LogLevel level);
+
+/**
+ * @brief Waits until all messages logged so far are written.
+ */
+void log_flush();
+
+/**
+ * @brief Writes out the pending messages and stops the background thread.
+ */
+void log_shutdown();
+
+/**
+ * @brief Logs a formatted message with a timestamp and log level.
+ *
+ * The message is formatted by the calling thread into the ring buffer and
+ * written with the timestamp and level prefix by the background thread.
+ * Errors are flushed before returning.
+ *
+ * @param level The log level (INFO, WARN, or ERROR) to categorize the log message.
+ * @param format A `printf`-style format string for the log message.
+ * @param ... Additional arguments for the format string.
+ * @return Always returns 1 upon completion.
+ */
+int log1(LogLevel level, const char *format, ...);
+
+#endif
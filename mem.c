@@ -0,0 +1,149 @@
+#include "mem.h"
+
+struct memstats mem_stats = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+/**
+ * Records a change of tracked bytes for the genome and for the whole process.
+ */
+static void mem_account(struct memtrack *mt, int64_t delta) {
+    mt->current += delta;
+    if (mt->current > mt->peak) {
+        mt->peak = mt->current;
+    }
+    if (mt->current > mt->stage_peak[mt->stage]) {
+        mt->stage_peak[mt->stage] = mt->current;
+    }
+
+    uint64_t current = atomic_fetch_add_explicit(&(mem_stats.current), delta, memory_order_relaxed) + delta;
+    uint64_t peak = atomic_load_explicit(&(mem_stats.peak), memory_order_relaxed);
+    while (current > peak && !atomic_compare_exchange_weak_explicit(&(mem_stats.peak), &peak, current, memory_order_relaxed, memory_order_relaxed));
+}
+
+void *mem_malloc(struct memtrack *mt, size_t size) {
+    void *ptr = malloc(size);
+    if (ptr != NULL) {
+        mem_account(mt, size);
+    }
+    return ptr;
+}
+
+void *mem_realloc(struct memtrack *mt, void *ptr, size_t old_size, size_t new_size) {
+    void *new_ptr = realloc(ptr, new_size);
+    if (new_ptr != NULL || new_size == 0) {
+        mem_account(mt, (int64_t)new_size - (int64_t)old_size);
+    }
+    return new_ptr;
+}
+
+void mem_free(struct memtrack *mt, void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+    free(ptr);
+    mem_account(mt, -(int64_t)size);
+}
+
+uint64_t mem_rss() {
+    FILE *in = fopen("/proc/self/statm", "r");
+    unsigned long size, resident;
+
+    if (in == NULL) {
+        return 0;
+    }
+    if (fscanf(in, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(in);
+
+    return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * Takes a sample of the RSS, keeping it in the timeline if it is due or the
+ * last one.
+ */
+static void mem_sample(uint64_t start_ns, int last) {
+    uint64_t rss = mem_rss();
+
+    if (rss > mem_stats.rss_peak) {
+        mem_stats.rss_peak = rss;
+    }
+
+    if (mem_stats.samples == NULL) {
+        return;
+    }
+    if (mem_stats.sample_skip && !last) {
+        mem_stats.sample_skip--;
+        return;
+    }
+
+    // halve the resolution of the full timeline
+    if (mem_stats.sample_cnt == RSS_TIMELINE_SAMPLES) {
+        for (size_t i=0; i<RSS_TIMELINE_SAMPLES/2; i++) {
+            mem_stats.samples[i] = mem_stats.samples[2*i];
+        }
+        mem_stats.sample_cnt = RSS_TIMELINE_SAMPLES/2;
+        mem_stats.sample_stride *= 2;
+    }
+
+    mem_stats.samples[mem_stats.sample_cnt].seconds = (stats_now() - start_ns) / 1e9;
+    mem_stats.samples[mem_stats.sample_cnt].bytes = rss;
+    mem_stats.sample_cnt++;
+    mem_stats.sample_skip = mem_stats.sample_stride - 1;
+}
+
+static int sampler_interval_ms;
+
+static void *mem_sampler(void *arg) {
+    (void)arg;
+    uint64_t start_ns = run_stats.start_ns;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&(mem_stats.mutex));
+    while (mem_stats.running) {
+        mem_sample(start_ns, 0);
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)sampler_interval_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        // wakes up early when the sampler is stopped
+        pthread_cond_timedwait(&(mem_stats.cond), &(mem_stats.mutex), &deadline);
+    }
+    mem_sample(start_ns, 1);
+    pthread_mutex_unlock(&(mem_stats.mutex));
+
+    return NULL;
+}
+
+void mem_sampler_start(int interval_ms) {
+    sampler_interval_ms = interval_ms > 0 ? interval_ms : RSS_SAMPLE_INTERVAL_MS;
+
+    // without a timeline, only the peak is recorded
+    mem_stats.samples = (struct rss_sample *)malloc(RSS_TIMELINE_SAMPLES * sizeof(struct rss_sample));
+    mem_stats.sample_cnt = 0;
+    mem_stats.sample_stride = 1;
+    mem_stats.sample_skip = 0;
+    mem_stats.running = 1;
+
+    if (pthread_create(&(mem_stats.sampler), NULL, mem_sampler, NULL) != 0) {
+        mem_stats.running = 0;
+    }
+}
+
+void mem_sampler_stop() {
+    pthread_mutex_lock(&(mem_stats.mutex));
+    if (!mem_stats.running) {
+        pthread_mutex_unlock(&(mem_stats.mutex));
+        return;
+    }
+    mem_stats.running = 0;
+    pthread_cond_signal(&(mem_stats.cond));
+    pthread_mutex_unlock(&(mem_stats.mutex));
+
+    pthread_join(mem_stats.sampler, NULL);
+}
@@ -0,0 +1,118 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include "stats.h" // stages
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define RSS_SAMPLE_INTERVAL_MS 100
+#define RSS_TIMELINE_SAMPLES 1024 // samples kept, every other one is dropped when they are full
+
+/**
+ * @brief Current and peak bytes of the tracked buffers of a genome.
+ *
+ * Buffers of a genome are only (re)allocated by the thread processing it, 
+ * so the counters are updated without synchronization. The peak is also 
+ * recorded for the stage that is active when it is reached.
+ */
+struct memtrack {
+    uint64_t current;
+    uint64_t peak;
+    uint64_t stage_peak[STAGE_COUNT];
+    stats_stage stage;
+};
+
+/**
+ * @brief A sample of the resident set size of the process.
+ */
+struct rss_sample {
+    double seconds; // since the sampler was started
+    uint64_t bytes;
+};
+
+/**
+ * @brief Sampled RSS timeline and process-wide tracked memory.
+ *
+ * The timeline holds at most `RSS_TIMELINE_SAMPLES` samples. Once it is full,
+ * every other sample is dropped and the samples are kept half as often, so
+ * long runs are covered evenly at a coarser resolution. The peak is taken
+ * from every sample, including the dropped ones.
+ */
+struct memstats {
+    _Atomic uint64_t current; // tracked bytes over all genomes
+    _Atomic uint64_t peak;
+    struct rss_sample *samples;
+    size_t sample_cnt;
+    size_t sample_stride; // samples taken per sample kept
+    size_t sample_skip; // samples to take before the next one is kept
+    uint64_t rss_peak;
+    pthread_t sampler;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int running;
+};
+
+extern struct memstats mem_stats;
+
+/**
+ * @brief Sets the stage that subsequent allocations of the genome are charged to.
+ *
+ * @param mt Pointer to the tracker of the genome.
+ * @param stage The active stage.
+ */
+static inline void mem_stage(struct memtrack *mt, stats_stage stage) {
+    mt->stage = stage;
+}
+
+/**
+ * @brief Allocates a tracked buffer.
+ *
+ * @param mt Pointer to the tracker of the genome.
+ * @param size Size of the buffer in bytes.
+ * @return Pointer to the buffer or NULL on failure.
+ */
+void *mem_malloc(struct memtrack *mt, size_t size);
+
+/**
+ * @brief Resizes a tracked buffer.
+ *
+ * @param mt Pointer to the tracker of the genome.
+ * @param ptr Pointer to the buffer, may be NULL.
+ * @param old_size Current size of the buffer in bytes.
+ * @param new_size New size of the buffer in bytes.
+ * @return Pointer to the resized buffer or NULL on failure, in which case 
+ *         the original buffer is left untouched.
+ */
+void *mem_realloc(struct memtrack *mt, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * @brief Frees a tracked buffer.
+ *
+ * @param mt Pointer to the tracker of the genome.
+ * @param ptr Pointer to the buffer, may be NULL.
+ * @param size Size of the buffer in bytes.
+ */
+void mem_free(struct memtrack *mt, void *ptr, size_t size);
+
+/**
+ * @brief Returns the current resident set size of the process in bytes.
+ */
+uint64_t mem_rss();
+
+/**
+ * @brief Starts a background thread sampling the RSS of the process.
+ *
+ * @param interval_ms Sampling interval in milliseconds.
+ */
+void mem_sampler_start(int interval_ms);
+
+/**
+ * @brief Stops the RSS sampler, taking one last sample.
+ */
+void mem_sampler_stop();
+
+#endif
@@ -0,0 +1,220 @@
+#include "packed.h"
+
+static const char packed_bases[4] = {'T', 'C', 'A', 'G'};
+
+// characters of the 4 bases of every byte, built by the preprocessor
+#define PACKED_BASE(code) ((code) == 0 ? 'T' : (code) == 1 ? 'C' : (code) == 2 ? 'A' : 'G')
+#define PACKED_BYTE(b) {PACKED_BASE(((b) >> 6) & 3), PACKED_BASE(((b) >> 4) & 3), PACKED_BASE(((b) >> 2) & 3), PACKED_BASE((b) & 3)}
+#define PACKED_BYTES4(b) PACKED_BYTE(b), PACKED_BYTE((b) + 1), PACKED_BYTE((b) + 2), PACKED_BYTE((b) + 3)
+#define PACKED_BYTES16(b) PACKED_BYTES4(b), PACKED_BYTES4((b) + 4), PACKED_BYTES4((b) + 8), PACKED_BYTES4((b) + 12)
+#define PACKED_BYTES64(b) PACKED_BYTES16(b), PACKED_BYTES16((b) + 16), PACKED_BYTES16((b) + 32), PACKED_BYTES16((b) + 48)
+
+static const char packed_bytes[256][4] = {
+    PACKED_BYTES64(0), PACKED_BYTES64(64), PACKED_BYTES64(128), PACKED_BYTES64(192)
+};
+
+static inline uint8_t packed_code(char c) {
+    switch (c) {
+        case 'T': case 't': return 0;
+        case 'C': case 'c': return 1;
+        case 'A': case 'a': return 2;
+        case 'G': case 'g': return 3;
+        default: return PACKED_AMBIGUOUS;
+    }
+}
+
+/**
+ * Extends the last run of the list if the position follows it with the same
+ * character, otherwise starts a new run.
+ */
+static int add_run(struct memtrack *mem, struct seq_run **runs, uint64_t *count, uint64_t *capacity, uint64_t pos, uint64_t len, char base) {
+
+    if (*count) {
+        struct seq_run *last = *runs + *count - 1;
+        if (last->start + last->len == pos && last->base == base) {
+            last->len += len;
+            return 1;
+        }
+    }
+
+    if (*count == *capacity) {
+        uint64_t new_capacity = *capacity ? *capacity * 2 : 64;
+        struct seq_run *temp = (struct seq_run *)mem_realloc(mem, *runs, *capacity * sizeof(struct seq_run), new_capacity * sizeof(struct seq_run));
+        if (temp == NULL) {
+            return 0;
+        }
+        *runs = temp;
+        *capacity = new_capacity;
+    }
+
+    (*runs)[(*count)++] = (struct seq_run){pos, len, base};
+
+    return 1;
+}
+
+/**
+ * Index of the first run ending after the position.
+ */
+static uint64_t find_run(const struct seq_run *runs, uint64_t count, uint64_t pos) {
+    uint64_t low = 0, high = count;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (runs[mid].start + runs[mid].len <= pos) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+int packed_init(struct packed_seq *seq, struct memtrack *mem, uint64_t capacity) {
+
+    memset(seq, 0, sizeof(struct packed_seq));
+    seq->mem = mem;
+    seq->capacity = (capacity + 3) & ~(uint64_t)3;
+
+    if (seq->capacity == 0) {
+        return 1;
+    }
+
+    seq->bases = (uint8_t *)mem_malloc(mem, seq->capacity / 4);
+
+    if (seq->bases == NULL) {
+        seq->capacity = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+int packed_reserve(struct packed_seq *seq, uint64_t capacity) {
+
+    capacity = (capacity + 3) & ~(uint64_t)3;
+
+    if (capacity <= seq->capacity) {
+        return 1;
+    }
+
+    uint8_t *temp = (uint8_t *)mem_realloc(seq->mem, seq->bases, seq->capacity / 4, capacity / 4);
+    if (temp == NULL) {
+        return 0;
+    }
+    seq->bases = temp;
+    seq->capacity = capacity;
+
+    return 1;
+}
+
+int packed_append(struct packed_seq *seq, const char *str, uint64_t len) {
+
+    if (seq->len + len > seq->capacity) {
+        uint64_t new_capacity = (seq->capacity + seq->capacity / 2 + len + 3) & ~(uint64_t)3;
+        uint8_t *temp = (uint8_t *)mem_realloc(seq->mem, seq->bases, seq->capacity / 4, new_capacity / 4);
+        if (temp == NULL) {
+            return 0;
+        }
+        seq->bases = temp;
+        seq->capacity = new_capacity;
+    }
+
+    uint64_t pos = seq->len;
+
+    for (uint64_t i=0; i<len; i++, pos++) {
+        char c = str[i];
+        uint8_t code = packed_code(c);
+
+        if (code == PACKED_AMBIGUOUS) {
+            code = 0;
+            // lowercase ambiguity codes are ambiguous and masked
+            char upper = c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c;
+            if (!add_run(seq->mem, &(seq->ambiguous), &(seq->ambiguous_count), &(seq->ambiguous_capacity), pos, 1, upper)) {
+                return 0;
+            }
+        }
+
+        if (c >= 'a' && c <= 'z' && !add_run(seq->mem, &(seq->masked), &(seq->masked_count), &(seq->masked_capacity), pos, 1, 0)) {
+            return 0;
+        }
+
+        uint8_t shift = 6 - 2 * (pos & 3);
+        if ((pos & 3) == 0) {
+            seq->bases[pos >> 2] = code << shift;
+        } else {
+            seq->bases[pos >> 2] |= code << shift;
+        }
+    }
+
+    seq->len = pos;
+
+    return 1;
+}
+
+void packed_map(struct packed_seq *seq, const uint8_t *bases, uint64_t len) {
+
+    if (!seq->mapped) {
+        mem_free(seq->mem, seq->bases, seq->capacity / 4);
+    }
+
+    seq->bases = (uint8_t *)bases;
+    seq->len = len;
+    seq->capacity = 0;
+    seq->mapped = 1;
+    seq->ambiguous_count = 0;
+    seq->masked_count = 0;
+}
+
+int packed_add_ambiguous(struct packed_seq *seq, uint64_t start, uint64_t len, char base) {
+    return add_run(seq->mem, &(seq->ambiguous), &(seq->ambiguous_count), &(seq->ambiguous_capacity), start, len, base);
+}
+
+int packed_add_masked(struct packed_seq *seq, uint64_t start, uint64_t len) {
+    return add_run(seq->mem, &(seq->masked), &(seq->masked_count), &(seq->masked_capacity), start, len, 0);
+}
+
+void packed_unpack(const struct packed_seq *seq, uint64_t begin, uint64_t end, char *out) {
+
+    uint64_t pos = begin;
+
+    // bases up to the first whole byte
+    for (; pos<end && (pos & 3); pos++) {
+        out[pos - begin] = packed_bases[(seq->bases[pos >> 2] >> (6 - 2 * (pos & 3))) & 3];
+    }
+    for (; pos+4<=end; pos+=4) {
+        memcpy(out + pos - begin, packed_bytes[seq->bases[pos >> 2]], 4);
+    }
+    for (; pos<end; pos++) {
+        out[pos - begin] = packed_bases[(seq->bases[pos >> 2] >> (6 - 2 * (pos & 3))) & 3];
+    }
+    out[end - begin] = '\0';
+
+    for (uint64_t i=find_run(seq->ambiguous, seq->ambiguous_count, begin); i<seq->ambiguous_count && seq->ambiguous[i].start<end; i++) {
+        uint64_t from = seq->ambiguous[i].start > begin ? seq->ambiguous[i].start : begin;
+        uint64_t to = seq->ambiguous[i].start + seq->ambiguous[i].len < end ? seq->ambiguous[i].start + seq->ambiguous[i].len : end;
+        memset(out + from - begin, seq->ambiguous[i].base, to - from);
+    }
+
+    for (uint64_t i=find_run(seq->masked, seq->masked_count, begin); i<seq->masked_count && seq->masked[i].start<end; i++) {
+        uint64_t from = seq->masked[i].start > begin ? seq->masked[i].start : begin;
+        uint64_t to = seq->masked[i].start + seq->masked[i].len < end ? seq->masked[i].start + seq->masked[i].len : end;
+        for (uint64_t pos=from; pos<to; pos++) {
+            char c = out[pos - begin];
+            out[pos - begin] = c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+        }
+    }
+}
+
+void packed_clear(struct packed_seq *seq) {
+    seq->len = 0;
+    seq->ambiguous_count = 0;
+    seq->masked_count = 0;
+}
+
+void packed_free(struct packed_seq *seq) {
+    if (!seq->mapped) {
+        mem_free(seq->mem, seq->bases, seq->capacity / 4);
+    }
+    mem_free(seq->mem, seq->ambiguous, seq->ambiguous_capacity * sizeof(struct seq_run));
+    mem_free(seq->mem, seq->masked, seq->masked_capacity * sizeof(struct seq_run));
+    memset(seq, 0, sizeof(struct packed_seq));
+}
@@ -0,0 +1,143 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define PACKED_AMBIGUOUS 4 // code of characters other than ACGT
+
+/**
+ * @brief A run of equal characters in a packed sequence.
+ */
+struct seq_run {
+    uint64_t start;
+    uint64_t len;
+    char base; // character of ambiguous runs, unused for masked runs
+};
+
+/**
+ * @brief A DNA sequence packed into 2 bits per base.
+ *
+ * Bases are encoded like in the UCSC .2bit format (T=0, C=1, A=2, G=3), four
+ * per byte with the first base in the most significant bits. Characters other
+ * than ACGT (N and other ambiguity codes) are stored as T and recorded in the
+ * sorted list of ambiguous runs, lowercase (soft-masked) characters in the
+ * sorted list of masked runs, so that the sequence can be restored exactly.
+ *
+ * Buffers are tracked by the memory tracker of the genome they belong to. 
+ * The bases can also be a view of a mapped .2bit file (see `packed_map`).
+ */
+struct packed_seq {
+    uint8_t *bases;
+    uint64_t len; // bases
+    uint64_t capacity; // bases the buffer can hold, a multiple of 4
+    struct seq_run *ambiguous;
+    uint64_t ambiguous_count;
+    uint64_t ambiguous_capacity;
+    struct seq_run *masked;
+    uint64_t masked_count;
+    uint64_t masked_capacity;
+    struct memtrack *mem;
+    int mapped; // bases belong to a mapped file and are not freed
+};
+
+/**
+ * @brief Initializes an empty packed sequence.
+ *
+ * @param seq Pointer to the packed sequence.
+ * @param mem Pointer to the memory tracker the buffers are charged to.
+ * @param capacity Initial capacity in bases, 0 for views (see `packed_map`).
+ * @return 1 on success, 0 if the buffer could not be allocated.
+ */
+int packed_init(struct packed_seq *seq, struct memtrack *mem, uint64_t capacity);
+
+/**
+ * @brief Grows the buffer of a packed sequence to hold at least the given number of bases.
+ *
+ * @param seq Pointer to the packed sequence, not a view.
+ * @param capacity Capacity in bases.
+ * @return 1 on success, 0 if the buffer could not be grown.
+ */
+int packed_reserve(struct packed_seq *seq, uint64_t capacity);
+
+/**
+ * @brief Appends characters to a packed sequence, growing it if needed.
+ *
+ * @param seq Pointer to the packed sequence.
+ * @param str Characters to be appended.
+ * @param len Number of characters.
+ * @return 1 on success, 0 if a buffer could not be grown.
+ */
+int packed_append(struct packed_seq *seq, const char *str, uint64_t len);
+
+/**
+ * @brief Makes a packed sequence a view of bases packed elsewhere.
+ *
+ * The bases are used in place and are not copied or freed, e.g. the packed 
+ * DNA of a sequence of a mapped .2bit file. The runs are emptied and have to 
+ * be added with `packed_add_ambiguous` and `packed_add_masked`. A sequence 
+ * that is a view cannot be appended to.
+ *
+ * @param seq Pointer to the packed sequence.
+ * @param bases Pointer to the bases, in the encoding of `packed_seq`.
+ * @param len Number of bases.
+ */
+void packed_map(struct packed_seq *seq, const uint8_t *bases, uint64_t len);
+
+/**
+ * @brief Adds a run of an ambiguous character to a packed sequence.
+ *
+ * Runs have to be added in order of their positions.
+ *
+ * @param seq Pointer to the packed sequence.
+ * @param start First position of the run.
+ * @param len Length of the run.
+ * @param base Character of the run.
+ * @return 1 on success, 0 if the list could not be grown.
+ */
+int packed_add_ambiguous(struct packed_seq *seq, uint64_t start, uint64_t len, char base);
+
+/**
+ * @brief Adds a soft-masked run to a packed sequence.
+ *
+ * Runs have to be added in order of their positions.
+ *
+ * @param seq Pointer to the packed sequence.
+ * @param start First position of the run.
+ * @param len Length of the run.
+ * @return 1 on success, 0 if the list could not be grown.
+ */
+int packed_add_masked(struct packed_seq *seq, uint64_t start, uint64_t len);
+
+/**
+ * @brief Restores the characters of a range of a packed sequence.
+ *
+ * Whole bytes are decoded with a lookup table, then the ambiguous and masked
+ * runs overlapping the range are applied. Restoring in blocks of a few
+ * kilobytes keeps the output in cache for the consumer.
+ *
+ * @param seq Pointer to the packed sequence.
+ * @param begin First base of the range.
+ * @param end One past the last base of the range.
+ * @param out Buffer of at least `end - begin + 1` characters, terminated with '\0'.
+ */
+void packed_unpack(const struct packed_seq *seq, uint64_t begin, uint64_t end, char *out);
+
+/**
+ * @brief Empties a packed sequence, keeping its buffers for the next one.
+ *
+ * @param seq Pointer to the packed sequence.
+ */
+void packed_clear(struct packed_seq *seq);
+
+/**
+ * @brief Frees the buffers of a packed sequence.
+ *
+ * @param seq Pointer to the packed sequence.
+ */
+void packed_free(struct packed_seq *seq);
+
+#endif
@@ -0,0 +1,172 @@
+#include "progress.h"
+#include "log.h"
+
+struct progress progress = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+static const char *phase_name(int phase) {
+    switch (phase) {
+        case PROGRESS_SIGNATURES:
+            return "signatures";
+        case PROGRESS_DISTANCES:
+            return "distances";
+        case PROGRESS_DONE:
+            return "done";
+        default:
+            return "idle";
+    }
+}
+
+static void format_eta(char *buffer, size_t size, double seconds) {
+    if (seconds < 0) {
+        snprintf(buffer, size, "unknown");
+        return;
+    }
+    uint64_t s = (uint64_t)(seconds + 0.5);
+    snprintf(buffer, size, "%02lu:%02lu:%02lu", s / 3600, s / 60 % 60, s % 60);
+}
+
+static void write_status(int phase, double elapsed, double rate, double eta) {
+    char filename[4096];
+    if (snprintf(filename, sizeof(filename), "%s.tmp", progress.status_file) >= (int)sizeof(filename)) {
+        return;
+    }
+
+    FILE *out = fopen(filename, "w");
+    if (out == NULL) {
+        return;
+    }
+
+    fprintf(out, "{\"phase\": \"%s\", \"elapsed_seconds\": %.3f, ", phase_name(phase), elapsed);
+    fprintf(out, "\"genomes_done\": %lu, \"genomes_total\": %lu, \"bytes_done\": %lu, \"bytes_total\": %lu, \"reads\": %lu, ", 
+        atomic_load_explicit(&(progress.genomes), memory_order_relaxed), progress.genomes_total, 
+        atomic_load_explicit(&(progress.bytes), memory_order_relaxed), progress.bytes_total, 
+        atomic_load_explicit(&(progress.reads), memory_order_relaxed));
+    fprintf(out, "\"pairs_done\": %lu, \"pairs_total\": %lu, \"rate\": %.3f, \"eta_seconds\": %.1f}\n", 
+        atomic_load_explicit(&(progress.pairs), memory_order_relaxed), progress.pairs_total, rate, eta);
+
+    if (fclose(out) == 0) {
+        rename(filename, progress.status_file);
+    }
+}
+
+/**
+ * Logs the progress of the running phase. The rate is bytes per second for
+ * signatures and pairs per second for distances, the ETA assumes it stays.
+ */
+static void progress_report() {
+    int phase = atomic_load(&(progress.phase));
+    if (phase != PROGRESS_SIGNATURES && phase != PROGRESS_DISTANCES) {
+        return;
+    }
+
+    double elapsed = (stats_now() - progress.phase_start_ns) / 1e9;
+    uint64_t done, total;
+    char eta_buffer[32];
+
+    if (phase == PROGRESS_SIGNATURES) {
+        done = atomic_load_explicit(&(progress.bytes), memory_order_relaxed);
+        total = progress.bytes_total;
+    } else {
+        done = atomic_load_explicit(&(progress.pairs), memory_order_relaxed);
+        total = progress.pairs_total;
+    }
+
+    double rate = elapsed > 0 ? (done - progress.phase_start_done) / elapsed : 0.0;
+    double eta = done >= total ? 0.0 : rate > 0 ? (total - done) / rate : -1.0;
+    double percent = total ? 100.0 * (done < total ? done : total) / total : 0.0;
+
+    format_eta(eta_buffer, sizeof(eta_buffer), eta);
+
+    if (phase == PROGRESS_SIGNATURES) {
+        log1(INFO, "Signatures: %lu/%lu genomes, %.1f/%.1f MB (%.1f%%), %lu reads, %.2f MB/s, ETA %s", 
+            atomic_load_explicit(&(progress.genomes), memory_order_relaxed), progress.genomes_total, 
+            done / 1048576.0, total / 1048576.0, percent, 
+            atomic_load_explicit(&(progress.reads), memory_order_relaxed), rate / 1048576.0, eta_buffer);
+    } else {
+        log1(INFO, "Distances: %lu/%lu pairs (%.1f%%), %.0f pairs/s, ETA %s", done, total, percent, rate, eta_buffer);
+    }
+
+    if (progress.status_file != NULL) {
+        write_status(phase, elapsed, rate, eta);
+    }
+}
+
+static void *progress_reporter(void *arg) {
+    (void)arg;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&(progress.mutex));
+    while (progress.running) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += progress.interval;
+
+        if (pthread_cond_timedwait(&(progress.cond), &(progress.mutex), &deadline) != 0 && progress.running) {
+            progress_report();
+        }
+    }
+    pthread_mutex_unlock(&(progress.mutex));
+
+    return NULL;
+}
+
+void progress_start(int interval, const char *status_file) {
+    progress.interval = interval > 0 ? interval : PROGRESS_DEFAULT_INTERVAL;
+    progress.status_file = status_file;
+    progress.running = 1;
+
+    if (pthread_create(&(progress.reporter), NULL, progress_reporter, NULL) != 0) {
+        log1(WARN, "Could not start the progress reporter.");
+        progress.running = 0;
+    }
+}
+
+void progress_begin(progress_phase phase, uint64_t genomes_total, uint64_t bytes_total, uint64_t pairs_total) {
+    pthread_mutex_lock(&(progress.mutex));
+
+    if (phase == PROGRESS_SIGNATURES) {
+        atomic_store(&(progress.bytes), 0);
+        atomic_store(&(progress.reads), 0);
+        atomic_store(&(progress.genomes), 0);
+        progress.genomes_total = genomes_total;
+        progress.bytes_total = bytes_total;
+    } else if (phase == PROGRESS_DISTANCES) {
+        atomic_store(&(progress.pairs), 0);
+        progress.pairs_total = pairs_total;
+    }
+    progress.phase_start_ns = stats_now();
+    progress.phase_start_done = 0;
+    atomic_store(&(progress.phase), phase);
+
+    pthread_mutex_unlock(&(progress.mutex));
+}
+
+void progress_switch(progress_phase phase) {
+    pthread_mutex_lock(&(progress.mutex));
+
+    progress.phase_start_ns = stats_now();
+    progress.phase_start_done = atomic_load(phase == PROGRESS_SIGNATURES ? &(progress.bytes) : &(progress.pairs));
+    atomic_store(&(progress.phase), phase);
+
+    pthread_mutex_unlock(&(progress.mutex));
+}
+
+void progress_stop() {
+    pthread_mutex_lock(&(progress.mutex));
+    if (!progress.running) {
+        pthread_mutex_unlock(&(progress.mutex));
+        return;
+    }
+    progress.running = 0;
+    pthread_cond_signal(&(progress.cond));
+    pthread_mutex_unlock(&(progress.mutex));
+
+    pthread_join(progress.reporter, NULL);
+
+    atomic_store(&(progress.phase), PROGRESS_DONE);
+    if (progress.status_file != NULL) {
+        write_status(PROGRESS_DONE, (stats_now() - run_stats.start_ns) / 1e9, 0.0, 0.0);
+    }
+}
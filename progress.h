@@ -0,0 +1,97 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include "stats.h" // stats_now
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define PROGRESS_DEFAULT_INTERVAL 10 // seconds between reports
+#define PROGRESS_BATCH_READS 4096    // reads counted locally before they are published
+
+typedef enum {
+    PROGRESS_IDLE,
+    PROGRESS_SIGNATURES,
+    PROGRESS_DISTANCES,
+    PROGRESS_DONE
+} progress_phase;
+
+/**
+ * @brief Counters of the running phase and the state of the reporter thread.
+ *
+ * Workers only add to the counters with relaxed atomics, in batches of a
+ * chromosome, a few thousand reads or a distance row, and the reporter
+ * reads them periodically. The totals are set before the phase starts.
+ */
+struct progress {
+    _Atomic uint64_t bytes;   // input bytes consumed
+    _Atomic uint64_t reads;   // sequences (chromosomes or reads) processed
+    _Atomic uint64_t genomes; // genomes whose signature is done
+    _Atomic uint64_t pairs;   // genome pairs whose distances are done
+    _Atomic int phase;
+    uint64_t bytes_total;
+    uint64_t genomes_total;
+    uint64_t pairs_total;
+    uint64_t phase_start_ns;
+    uint64_t phase_start_done; // counter of the phase when it was reported first
+    int interval;
+    const char *status_file;
+    pthread_t reporter;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int running;
+};
+
+extern struct progress progress;
+
+/**
+ * @brief Adds to a progress counter.
+ *
+ * @param counter Pointer to one of the counters of `progress`.
+ * @param value Amount to add.
+ */
+static inline void progress_add(_Atomic uint64_t *counter, uint64_t value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+/**
+ * @brief Starts the thread that periodically reports progress.
+ *
+ * Reports are logged and, if a status file is given, also written to it as
+ * JSON. The file is replaced atomically so readers never see a partial one.
+ *
+ * @param interval Seconds between reports.
+ * @param status_file Path of the status file or NULL.
+ */
+void progress_start(int interval, const char *status_file);
+
+/**
+ * @brief Begins a phase, resetting its counters and setting its totals.
+ *
+ * Counters of the previous phase are kept for the status file, totals that
+ * do not belong to the phase are ignored.
+ *
+ * @param phase The phase that starts.
+ * @param genomes_total Number of genomes to process in the signature phase.
+ * @param bytes_total Input bytes to consume in the signature phase.
+ * @param pairs_total Number of pairs to compare in the distance phase.
+ */
+void progress_begin(progress_phase phase, uint64_t genomes_total, uint64_t bytes_total, uint64_t pairs_total);
+
+/**
+ * @brief Switches the reported phase without resetting its counters.
+ *
+ * Used when phases overlap and the counters of the next phase are already
+ * running. Rates and the ETA only count the progress made after the switch.
+ *
+ * @param phase The phase that is reported from now on.
+ */
+void progress_switch(progress_phase phase);
+
+/**
+ * @brief Stops the reporter, marking the run as done in the status file.
+ */
+void progress_stop();
+
+#endif
@@ -1,46 +1,61 @@
 #include "rfasta.h"
 
-pthread_mutex_t console_mutex_rfasta;
-
 void read_fastas(struct gargs *genome_arguments, struct pargs *program_arguments) {
-    
-    struct tpool *tm;
-
-    tm = tpool_create(program_arguments->thread_number);
-
-    for (int i=0; i<program_arguments->number_of_genomes; i++) {
-        tpool_add_work(tm, read_fasta, genome_arguments+i);
-    }
 
-    tpool_wait(tm);
-
-    tpool_destroy(tm);
+    run_genomes(genome_arguments, program_arguments, read_fasta);
 }
 
 void read_fasta(void *arg) {
 
     struct gargs *genome_arguments = (struct gargs *)arg;
 
-    // open fasta file
-    FILE *in = fopen(genome_arguments->inFileName, "r");
-
-    if (in == NULL) {
-        log1(ERROR, "Error opening file %s", genome_arguments->inFileName);
+    // reuse the signature of an unchanged input if it is cached
+    uint64_t start = stats_now();
+    struct cache_key key;
+    int use_cache = genome_arguments->cache_dir != NULL && cache_key(genome_arguments, CACHE_FA, &key);
+
+    if (use_cache && !genome_arguments->write_lcpt && cache_load(genome_arguments, &key)) {
+        genome_arguments->stats.ns[STAGE_CACHE] += stats_now() - start;
+        genome_arguments->stats.cache_hit = 1;
+        progress_add(&(progress.bytes), get_file_size(genome_arguments->inFileName));
+        if (genome_arguments->verbose) {
+            log1(INFO, "Thread ID: %ld loaded %s from cache, size: %ld", pthread_self(), genome_arguments->inFileName, genome_arguments->cores_len);
+        }
         return;
     }
 
-    fseek(in, 0, SEEK_END); // seek to end of file
-    uint64_t size = ftell(in); // get current file pointer
-    fseek(in, 0, SEEK_SET); // seek back to beginning of fil
+    genome_arguments->stats.ns[STAGE_CACHE] += stats_now() - start;
+
+    // open fasta file, .2bit files are mapped instead
+    int stream = is_stream_input(genome_arguments->inFileName);
+    struct twobit twobit;
+    int is_2bit = !stream && is_twobit(genome_arguments->inFileName);
+    FILE *in = NULL;
+
+    if (is_2bit) {
+        if (!twobit_open(genome_arguments->inFileName, &twobit)) {
+            return;
+        }
+    } else {
+        in = strcmp(genome_arguments->inFileName, STDIN_INPUT) == 0 ? stdin : fopen(genome_arguments->inFileName, "r");
+
+        if (in == NULL) {
+            log1(ERROR, "Error opening file %s", genome_arguments->inFileName);
+            return;
+        }
+    }
+
+    // streams start small and grow, files are sized from the bases they hold
+    uint64_t size = stream ? 0 : get_file_size(genome_arguments->inFileName) * (is_2bit ? TWOBIT_BASES_PER_BYTE : 1);
+    uint64_t estimated_core_size = stream ? STREAM_INITIAL_CORES : (uint64_t)(size / pow(MAGIC_LCP_FA_CONSTANT, genome_arguments->lcp_level));
 
-    uint64_t estimated_core_size = (int)(size / pow(MAGIC_LCP_FA_CONSTANT, genome_arguments->lcp_level));
+    mem_stage(&(genome_arguments->mem), STAGE_PARSE);
     
-    genome_arguments->cores = (simple_core*)malloc(estimated_core_size * sizeof(simple_core));
+    genome_arguments->cores = mem_malloc(&(genome_arguments->mem), estimated_core_size * key_size(genome_arguments->key));
+    genome_arguments->cores_capacity = genome_arguments->cores != NULL ? estimated_core_size : 0;
 
     if (genome_arguments->cores == NULL) {
-        pthread_mutex_lock(&console_mutex_rfasta);
         log1(INFO, "Thread ID: %ld couldn't allocate memory of size %ld for cores", pthread_self(), size);
-        pthread_mutex_unlock(&console_mutex_rfasta);
     }
 
     // create file for writing cores
@@ -55,55 +70,25 @@ void read_fasta(void *arg) {
     }
 
     if (genome_arguments->verbose) {
-        pthread_mutex_lock(&console_mutex_rfasta);
         log1(INFO, "Thread ID: %ld, in: %s, cc: %ld", pthread_self(), genome_arguments->inFileName, estimated_core_size);
-        pthread_mutex_unlock(&console_mutex_rfasta);
     }
 
-    // read file
-    char *sequence = (char*)malloc(INITIAL_SEQUENCE_SIZE);
-    if (!sequence) {
-        pthread_mutex_lock(&console_mutex_rfasta);
-        log1(ERROR, "Memory allocation failed for sequence buffer\n");
-        exit(EXIT_FAILURE);
-    }
-    uint64_t sequence_size = 0;
-    uint64_t sequence_capacity = INITIAL_SEQUENCE_SIZE;
-
-    char line[1024];
-
-    while (fgets(line, sizeof(line), in)) {
-
-        line[strcspn(line, "\n")] = '\0';
-
-        if (line[0] == '>') {
-            if (sequence_size != 0) {
-                process_chrom(sequence, sequence_size, &estimated_core_size, genome_arguments, out);
-                sequence_size = 0;
-            }
-        } else {
-            size_t line_len = strlen(line);
-
-            while (sequence_size + line_len >= sequence_capacity) {
-                sequence_capacity = (size_t)(sequence_capacity * 1.5);
-                sequence = realloc(sequence, sequence_capacity);
-                if (!sequence) {
-                    log1(ERROR, "Memory reallocation failed\n");
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            memcpy(sequence + sequence_size, line, line_len);
-            sequence_size += line_len;
+    // parsing time is the time of the loop minus the time spent in LCP
+    start = stats_now();
+    uint64_t lcp_ns = genome_arguments->stats.ns[STAGE_INIT_LPS] + genome_arguments->stats.ns[STAGE_DEEPEN];
+
+    if (is_2bit) {
+        genome_arguments->stats.bytes += read_twobit(&twobit, genome_arguments, out);
+        twobit_close(&twobit);
+    } else {
+        genome_arguments->stats.bytes += read_fasta_text(in, stream, size, genome_arguments, out);
+        if (in != stdin) {
+            fclose(in);
         }
     }
 
-    if (sequence_size != 0) {
-        process_chrom(sequence, sequence_size, &estimated_core_size, genome_arguments, out);
-    }
-
-    free(sequence);
-    fclose(in);
+    lcp_ns = genome_arguments->stats.ns[STAGE_INIT_LPS] + genome_arguments->stats.ns[STAGE_DEEPEN] - lcp_ns;
+    genome_arguments->stats.ns[STAGE_PARSE] += stats_now() - start - lcp_ns;
 
     // end writing cores to file if user specified to do so
     if (genome_arguments->write_lcpt) {
@@ -113,54 +98,127 @@ void read_fasta(void *arg) {
 
     // log ending of reading fasta
     if (genome_arguments->verbose) {
-        pthread_mutex_lock(&console_mutex_rfasta);
         log1(INFO, "Thread ID: %ld ended reading %s, size: %ld", pthread_self(), genome_arguments->inFileName, genome_arguments->cores_len);
-        pthread_mutex_unlock(&console_mutex_rfasta);
     }
 
     // sort and filter the cores
     genSign(genome_arguments, genome_arguments->sct);
 
+    // a signature that misses cores is never cached
+    if (use_cache && !genome_arguments->failed) {
+        start = stats_now();
+        cache_store(genome_arguments, &key);
+        genome_arguments->stats.ns[STAGE_CACHE] += stats_now() - start;
+    }
+
     // log ending of processing fasta
     if (genome_arguments->verbose) {
-        pthread_mutex_lock(&console_mutex_rfasta);
-        log1(INFO, "Thread ID: %ld ended processing %s, size: %ld", pthread_self(), genome_arguments->inFileName, genome_arguments->cores_len);
-        pthread_mutex_unlock(&console_mutex_rfasta);
+        log1(INFO, "Thread ID: %ld ended processing %s, size: %ld, peak memory: %.2f MB", pthread_self(), genome_arguments->inFileName, genome_arguments->cores_len, genome_arguments->mem.peak / 1048576.0);
     }
 }
 
-void process_chrom(char *sequence, size_t seq_size, uint64_t *capacity, struct gargs *genome_arguments, FILE *out) {
-    // struct lps str;
-    // init_lps4(&str, sequence, seq_size, genome_arguments->lcp_level, 10000000);
-    struct lps str;
-    init_lps(&str, sequence, seq_size);
-    lps_deepen(&str, genome_arguments->lcp_level);
+uint64_t read_fasta_text(FILE *in, int stream, uint64_t size, struct gargs *genome_arguments, FILE *out) {
 
-    if (genome_arguments->write_lcpt) {
-        save(out, &str);
+    // read file, packing bases as they stream in
+    // no chromosome is longer than the file
+    uint64_t sequence_capacity = stream ? STREAM_SEQUENCE_SIZE : size < INITIAL_SEQUENCE_SIZE ? size + 1 : INITIAL_SEQUENCE_SIZE;
+
+    // the buffer of the thread is kept from previous chromosomes and genomes
+    struct scratch *scratch = scratch_get();
+    if (scratch == NULL || !packed_reserve(&(scratch->sequence), sequence_capacity)) {
+        log1(ERROR, "Memory allocation failed for sequence buffer of %s", genome_arguments->inFileName);
+        genome_arguments->failed = 1;
+        return 0;
     }
 
-    uint64_t len = genome_arguments->cores_len;
+    struct packed_seq *sequence = &(scratch->sequence);
+    packed_clear(sequence);
 
-    if (*capacity <= len+str.size) {
-        *capacity = *capacity * 1.5;
-        simple_core* temp = (simple_core*)realloc(genome_arguments->cores, *capacity);
-        if (temp == NULL) {
-            log1(ERROR, "Couldn't increase cores array size.");
-            return;
+    char line[1024];
+
+    uint64_t consumed = 0; // bytes read, streams cannot tell their position
+    uint64_t reported = 0; // bytes published to the progress counters
+
+    while (fgets(line, sizeof(line), in)) {
+
+        size_t line_len = strlen(line);
+        consumed += line_len;
+
+        if (line_len && line[line_len-1] == '\n') {
+            line[--line_len] = '\0';
         }
-        genome_arguments->cores = temp;
+
+        if (line[0] == '>') {
+            if (sequence->len != 0) {
+                process_chrom(sequence, genome_arguments, out);
+                packed_clear(sequence);
+
+                progress_add(&(progress.bytes), consumed - reported);
+                progress_add(&(progress.reads), 1);
+                reported = consumed;
+            }
+        } else if (!packed_append(sequence, line, line_len)) {
+            log1(ERROR, "Memory reallocation failed for sequence buffer of %s", genome_arguments->inFileName);
+            genome_arguments->failed = 1;
+            break;
+        }
+    }
+
+    if (sequence->len != 0 && !genome_arguments->failed) {
+        process_chrom(sequence, genome_arguments, out);
+        progress_add(&(progress.reads), 1);
     }
+    progress_add(&(progress.bytes), consumed - reported);
+
+    return consumed;
+}
+
+uint64_t read_twobit(struct twobit *twobit, struct gargs *genome_arguments, FILE *out) {
 
-    simple_core *cores = genome_arguments->cores;
+    struct packed_seq sequence;
+    packed_init(&sequence, &(genome_arguments->mem), 0);
 
-    for (int i=0; i<str.size; i++) {
-        cores[len] = ((uint64_t)str.cores[i].label << 32) + (str.cores[i].end-str.cores[i].start);
-        // cores[len] = ((uint64_t)str.cores[i].label);
-        len++;
+    uint64_t reported = 0; // bytes published to the progress counters
+    int status;
+
+    while ((status = twobit_next(twobit, &sequence)) == 1) {
+        if (sequence.len != 0) {
+            process_chrom(&sequence, genome_arguments, out);
+        }
+
+        if (twobit->end > reported) {
+            progress_add(&(progress.bytes), twobit->end - reported);
+            reported = twobit->end;
+        }
+        progress_add(&(progress.reads), 1);
+    }
+
+    // the sequences after the corrupted one are missing from the signature
+    if (status < 0) {
+        log1(ERROR, "Stopped reading %s at a corrupted sequence", genome_arguments->inFileName);
+        genome_arguments->failed = 1;
+    }
+
+    if (twobit->map_size > reported) {
+        progress_add(&(progress.bytes), twobit->map_size - reported);
     }
 
-    genome_arguments->cores_len = len;
+    packed_free(&sequence);
 
-    free_lps(&str);
-}
\ No newline at end of file
+    return twobit->map_size;
+}
+
+void process_chrom(const struct packed_seq *sequence, struct gargs *genome_arguments, FILE *out) {
+
+    genome_arguments->stats.bases += sequence->len;
+    genome_arguments->stats.reads++;
+
+    // cores of the last level go straight into the cores array
+    struct core_sink sink = {sink_to_genome, genome_arguments};
+
+    mem_stage(&(genome_arguments->mem), STAGE_DEEPEN);
+
+    lcp_stream_packed(sequence, 0, genome_arguments, &sink, out);
+
+    mem_stage(&(genome_arguments->mem), STAGE_PARSE);
+}
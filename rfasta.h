@@ -4,10 +4,15 @@
 #include "args.h"
 #include "utils.h"
 #include "tpool.h"
+#include "cache.h"
 #include "lps.h"
+#include "sink.h"
+#include "twobit.h"
+#include "scratch.h"
 #include <stdint.h>
 
-#define INITIAL_SEQUENCE_SIZE 300000000
+#define INITIAL_SEQUENCE_SIZE 300000000 // bases, packed into a quarter of the bytes
+#define STREAM_SEQUENCE_SIZE 1048576 // initial sequence buffer of inputs of unknown size
 
 /**
  * @brief Reads multiple FASTA files concurrently using a pool of threads.
@@ -18,6 +23,8 @@
  * a FASTA file using the `read_fasta` function, which operates on the provided 
  * thread arguments and shared program settings. 
  * 
+ * Genomes are submitted largest estimated work first (see `run_genomes`).
+ * 
  * @param genome_arguments A reference to a array of `gargs` structures 
  *        representing the arguments specific to each genome.
  * @param program_arguments A constant reference to a `pargs` structure 
@@ -34,25 +41,58 @@ void read_fastas(struct gargs *genome_arguments, struct pargs *program_arguments
  * logging for verbose output, tracks the size of processed sequences, and handles thread-safe 
  * operations, as it is designed to be run in a multithreaded environment.
  * 
+ * UCSC .2bit files are recognized by their signature and are memory-mapped 
+ * and read with `read_twobit` instead.
+ * 
  * @param args A reference to the `gargs` structure that contains the genome-specific 
  *        arguments, including the input FASTA file name, the output data structures.
  */
 void read_fasta(void *arg);
 
+/**
+ * @brief Reads the sequences of a FASTA text file and processes them.
+ *
+ * Lines are packed into 2 bits per base as they are read, and every sequence
+ * is processed with `process_chrom` once the next header or the end of the 
+ * file is reached.
+ *
+ * @param in The opened input.
+ * @param stream 1 if the input is a stream of unknown size, 0 otherwise.
+ * @param size Size of the file, which bounds the length of a sequence.
+ * @param genome_arguments Pointer to the genome arguments.
+ * @param out The output file pointer to save the processed results.
+ * @return Number of bytes read.
+ */
+uint64_t read_fasta_text(FILE *in, int stream, uint64_t size, struct gargs *genome_arguments, FILE *out);
+
+/**
+ * @brief Processes the sequences of a mapped .2bit file.
+ *
+ * Sequences are processed in place from the mapping (see `twobit_next`), 
+ * without parsing text or copying bases. Reading stops at a corrupted record.
+ *
+ * @param twobit Pointer to the mapped file.
+ * @param genome_arguments Pointer to the genome arguments.
+ * @param out The output file pointer to save the processed results.
+ * @return Size of the file in bytes.
+ */
+uint64_t read_twobit(struct twobit *twobit, struct gargs *genome_arguments, FILE *out);
+
 /**
  * @brief Processes a DNA sequence with LCP technique and extracts cores.
  *
  * This function processes a given DNA sequence and initializes the `lps` structure 
  * for as strand, deepens the `lps` structure based on the specified LCP level, 
- * and saves the processed result if the `write_lcpt` flag is set.
+ * and saves the processed result if the `write_lcpt` flag is set. Cores of the 
+ * last level are streamed into the cores array of the genome (see `lcp_stream`), 
+ * in windows if the genome has an LCP window. The sequence is kept packed and 
+ * is restored one window at a time (see `lcp_stream_packed`).
  *
- * @param sequence A pointer to the DNA sequence to be processed.
- * @param seq_size The length of the DNA sequence.
- * @param capacity The pointer to the capacity value of the cores array.
+ * @param sequence A pointer to the packed DNA sequence to be processed.
  * @param genome_arguments Pointer to the genome arguments structure, which 
  *        contains settings such as the LCP level and whether to save results.
  * @param out The output file pointer to save the processed results.
  */
-void process_chrom(char *sequence, size_t seq_size, uint64_t *capacity, struct gargs *genome_arguments, FILE *out);
+void process_chrom(const struct packed_seq *sequence, struct gargs *genome_arguments, FILE *out);
 
 #endif
\ No newline at end of file
@@ -1,29 +1,36 @@
 #include "rfastq.h"
 
-pthread_mutex_t console_mutex_rfastq;
-
 KSEQ_INIT(gzFile, gzread)
 
 void read_fastqs(struct gargs *genome_arguments, struct pargs *program_arguments) {
-    
-    struct tpool *tm;
-
-    tm = tpool_create(program_arguments->thread_number);
-
-    for (int i=0; i<program_arguments->number_of_genomes; i++) {
-        tpool_add_work(tm, read_fastq, genome_arguments+i);
-    }
-
-    tpool_wait(tm);
 
-    tpool_destroy(tm);
+    run_genomes(genome_arguments, program_arguments, read_fastq);
 }
 
 void read_fastq(void *arg) {
 
     struct gargs *genome_arguments = (struct gargs *)arg;
 
-    gzFile in = gzopen(genome_arguments->inFileName, "r");
+    // reuse the signature of an unchanged input if it is cached
+    uint64_t start = stats_now();
+    struct cache_key key;
+    int use_cache = genome_arguments->cache_dir != NULL && cache_key(genome_arguments, CACHE_FQ, &key);
+
+    if (use_cache && !genome_arguments->write_lcpt && cache_load(genome_arguments, &key)) {
+        genome_arguments->stats.ns[STAGE_CACHE] += stats_now() - start;
+        genome_arguments->stats.cache_hit = 1;
+        progress_add(&(progress.bytes), get_file_size(genome_arguments->inFileName));
+        if (genome_arguments->verbose) {
+            log1(INFO, "Thread ID: %ld loaded %s from cache, size: %ld", pthread_self(), genome_arguments->inFileName, genome_arguments->cores_len);
+        }
+        return;
+    }
+
+    genome_arguments->stats.ns[STAGE_CACHE] += stats_now() - start;
+
+    // the descriptor of stdin is duplicated so that gzclose leaves it open
+    int stream = is_stream_input(genome_arguments->inFileName);
+    gzFile in = strcmp(genome_arguments->inFileName, STDIN_INPUT) == 0 ? gzdopen(dup(STDIN_FILENO), "r") : gzopen(genome_arguments->inFileName, "r");
     if (in == NULL) {
         log1(ERROR, "Error opening file %s", genome_arguments->inFileName);
         return;
@@ -40,42 +47,63 @@ void read_fastq(void *arg) {
         }
     }
 
-    // estimate core counts and make array allocation
-    struct stat st;
-    if (stat(genome_arguments->inFileName, &st) != 0) {
-        log1(ERROR, "Error getting file size of %s", genome_arguments->inFileName);
-        return;
-    }
-    uint64_t file_size = st.st_size;
+    // estimate core counts and make array allocation, streams start small and grow
+    uint64_t estimated_core_size = STREAM_INITIAL_CORES;
+
+    if (!stream) {
+        uint64_t estimated_uncompressed_size = estimate_input_size(genome_arguments->inFileName);
+        if (estimated_uncompressed_size == 0) {
+            log1(ERROR, "Error getting file size of %s", genome_arguments->inFileName);
+            return;
+        }
 
-    uint64_t estimated_uncompressed_size = file_size; // default assumption
-    if (strstr(genome_arguments->inFileName, ".gz")) {
-        // estimate uncompressed size using typical compression ratio (~4:1 for FASTQ)
-        estimated_uncompressed_size = file_size * 4;
+        uint64_t estimated_bp_count = estimated_uncompressed_size / 2;
+        estimated_core_size = (uint64_t)(estimated_bp_count / pow(MAGIC_LCP_FQ_CONSTANT, genome_arguments->lcp_level));
     }
 
-    uint64_t estimated_bp_count = estimated_uncompressed_size / 2;
-    uint64_t estimated_core_size = (int)(estimated_bp_count / pow(MAGIC_LCP_FQ_CONSTANT, genome_arguments->lcp_level));
-    genome_arguments->cores = (simple_core*)malloc(estimated_core_size * sizeof(simple_core));
+    mem_stage(&(genome_arguments->mem), STAGE_PARSE);
+
+    genome_arguments->cores = mem_malloc(&(genome_arguments->mem), estimated_core_size * key_size(genome_arguments->key));
+    genome_arguments->cores_capacity = genome_arguments->cores != NULL ? estimated_core_size : 0;
 
     if (genome_arguments->cores == NULL) {
-        pthread_mutex_lock(&console_mutex_rfastq);
         log1(INFO, "Thread ID: %ld couldn't allocate memory of size %ld for cores", pthread_self(), estimated_core_size);
-        pthread_mutex_unlock(&console_mutex_rfastq);
     }
 
     if (genome_arguments->verbose) {
-        pthread_mutex_lock(&console_mutex_rfastq);
         log1(INFO, "Thread ID: %ld, in: %s, cc: %ld", pthread_self(), genome_arguments->inFileName, estimated_core_size);
-        pthread_mutex_unlock(&console_mutex_rfastq);
     }
 
     kseq_t *seq = kseq_init(in);
 
+    // parsing time is the time of the loop minus the time spent in LCP
+    start = stats_now();
+    uint64_t lcp_ns = genome_arguments->stats.ns[STAGE_INIT_LPS] + genome_arguments->stats.ns[STAGE_DEEPEN];
+
+    uint64_t reported = 0; // bytes published to the progress counters
+    uint64_t reads = 0;
+
     while (kseq_read(seq) >= 0) {
-        process_read(seq->seq.s, seq->seq.l, &estimated_core_size, genome_arguments, out);
+        process_read(seq->seq.s, seq->seq.l, genome_arguments, out);
+
+        if (++reads == PROGRESS_BATCH_READS) {
+            // streams cannot tell their compressed position, so they count uncompressed bytes
+            uint64_t offset = stream ? gztell(in) : gzoffset(in);
+            progress_add(&(progress.bytes), offset - reported);
+            progress_add(&(progress.reads), reads);
+            reported = offset;
+            reads = 0;
+        }
     }
 
+    uint64_t offset = stream ? gztell(in) : gzoffset(in);
+    progress_add(&(progress.bytes), offset - reported);
+    progress_add(&(progress.reads), reads);
+
+    lcp_ns = genome_arguments->stats.ns[STAGE_INIT_LPS] + genome_arguments->stats.ns[STAGE_DEEPEN] - lcp_ns;
+    genome_arguments->stats.ns[STAGE_PARSE] += stats_now() - start - lcp_ns;
+    genome_arguments->stats.bytes += offset;
+
     kseq_destroy(seq);
     gzclose(in);
 
@@ -87,84 +115,39 @@ void read_fastq(void *arg) {
 
     // log ending of reading fasta
     if (genome_arguments->verbose) {
-        pthread_mutex_lock(&console_mutex_rfastq);
         log1(INFO, "Thread ID: %ld ended reading %s, size: %ld", pthread_self(), genome_arguments->inFileName, genome_arguments->cores_len);
-        pthread_mutex_unlock(&console_mutex_rfastq);
     }
 
     // sort and filter the cores
     genSign(genome_arguments, genome_arguments->sct);
 
+    // a signature that misses cores is never cached
+    if (use_cache && !genome_arguments->failed) {
+        start = stats_now();
+        cache_store(genome_arguments, &key);
+        genome_arguments->stats.ns[STAGE_CACHE] += stats_now() - start;
+    }
+
     // log ending of processing fasta
     if (genome_arguments->verbose) {
-        pthread_mutex_lock(&console_mutex_rfastq);
-        log1(INFO, "Thread ID: %ld ended processing %s, size: %ld", pthread_self(), genome_arguments->inFileName, genome_arguments->cores_len);
-        pthread_mutex_unlock(&console_mutex_rfastq);
+        log1(INFO, "Thread ID: %ld ended processing %s, size: %ld, peak memory: %.2f MB", pthread_self(), genome_arguments->inFileName, genome_arguments->cores_len, genome_arguments->mem.peak / 1048576.0);
     }
 }
 
-void process_read(char *sequence, size_t seq_size, uint64_t *capacity, struct gargs *genome_arguments, FILE *out) {
-
-    uint64_t cap = *capacity;
-
-    // process forward
-    struct lps str_fwd;
-    init_lps(&str_fwd, sequence, seq_size);
-    lps_deepen(&str_fwd, genome_arguments->lcp_level);
-
-    if (genome_arguments->write_lcpt) {
-        save(out, &str_fwd);
-    }
-
-    uint64_t len = genome_arguments->cores_len;
-
-    if (cap <= len+str_fwd.size) {
-        cap = cap * 1.5;
-        simple_core* temp = (simple_core*)realloc(genome_arguments->cores, cap);
-        if (temp == NULL) {
-            log1(ERROR, "Couldn't increase cores array size.");
-            return;
-        }
-        genome_arguments->cores = temp;
-    }
-
-    simple_core *cores = genome_arguments->cores;
+void process_read(char *sequence, size_t seq_size, struct gargs *genome_arguments, FILE *out) {
 
-    for (int i=0; i<str_fwd.size; i++) {
-        cores[len] = ((uint64_t)str_fwd.cores[i].label << 32) + (str_fwd.cores[i].end-str_fwd.cores[i].start);
-        len++;
-    }
-    
-    free_lps(&str_fwd);
+    genome_arguments->stats.bases += seq_size;
+    genome_arguments->stats.reads++;
 
-    // process reverse complement
-    struct lps str_rev;
-    init_lps2(&str_rev, sequence, seq_size);
-    lps_deepen(&str_rev, genome_arguments->lcp_level);
+    // cores of the last level go straight into the cores array
+    struct core_sink sink = {sink_to_genome, genome_arguments};
 
-    if (genome_arguments->write_lcpt) {
-        save(out, &str_rev);
-    }
+    mem_stage(&(genome_arguments->mem), STAGE_DEEPEN);
 
-    if (*capacity <= len+str_rev.size) {
-        *capacity = *capacity * 1.5;
-        simple_core* temp = (simple_core*)realloc(genome_arguments->cores, *capacity);
-        if (temp == NULL) {
-            log1(ERROR, "Couldn't increase cores array size.");
-            return;
-        }
-        genome_arguments->cores = temp;
+    // process forward and reverse complement
+    if (lcp_stream(sequence, seq_size, 0, genome_arguments, &sink, out)) {
+        lcp_stream(sequence, seq_size, 1, genome_arguments, &sink, out);
     }
 
-    cores = genome_arguments->cores;
-
-    for (int i=0; i<str_rev.size; i++) {
-        cores[len] = ((uint64_t)str_rev.cores[i].label << 32) + (str_rev.cores[i].end-str_rev.cores[i].start);
-        len++;
-    }
-
-    genome_arguments->cores_len = len;
-    *capacity = cap;
-
-    free_lps(&str_rev);
-}
\ No newline at end of file
+    mem_stage(&(genome_arguments->mem), STAGE_PARSE);
+}
@@ -4,12 +4,15 @@
 #include "args.h"
 #include "utils.h"
 #include "tpool.h"
+#include "cache.h"
 #include "lps.h"
+#include "sink.h"
 #include <htslib/kseq.h>
 #include <sys/stat.h>
 #include <zlib.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 /**
  * @brief Reads multiple FASTQ files concurrently using a pool of threads.
@@ -20,6 +23,8 @@
  * a FASTQ file using the `read_fastq` function, which operates on the provided 
  * thread arguments and shared program settings. 
  * 
+ * Genomes are submitted largest estimated work first (see `run_genomes`).
+ * 
  * @param genome_arguments A reference to a vector of `gargs` structures 
  *        representing the arguments specific to each genome.
  * @param program_arguments A constant reference to a `pargs` structure 
@@ -47,16 +52,16 @@ void read_fastq(void *arg);
  * This function processes a given DNA sequence in both its forward and reverse 
  * complement forms. It initializes the `lps` structure for both strands, deepens 
  * the `lps` structure based on the specified LCP level, and saves the processed 
- * result if the `write_lcpt` flag is set. After processing both strands, the 
- * allocated memory for the `lps` structures is freed.
+ * result if the `write_lcpt` flag is set. Cores of the last level are streamed 
+ * into the cores array of the genome (see `lcp_stream`) and the `lps` structures 
+ * are freed right after.
  *
  * @param sequence A pointer to the DNA sequence to be processed.
  * @param seq_size The length of the DNA sequence.
- * @param capacity The pointer to the capacity value of the cores array.
  * @param genome_arguments Pointer to the genome arguments structure, which 
  *        contains settings such as the LCP level and whether to save results.
  * @param out The output file pointer to save the processed results.
  */
-void process_read(char *sequence, size_t seq_size, uint64_t *capacity, struct gargs *genome_arguments, FILE *out);
+void process_read(char *sequence, size_t seq_size, struct gargs *genome_arguments, FILE *out);
 
 #endif
\ No newline at end of file
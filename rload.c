@@ -1,20 +1,8 @@
 #include "rload.h"
 
-pthread_mutex_t console_mutex_rload;
-
 void read_lcpts(struct gargs *genome_arguments, struct pargs *program_arguments) {
 
-    struct tpool *tm;
-
-    tm = tpool_create(program_arguments->thread_number);
-
-    for (int i=0; i<program_arguments->number_of_genomes; i++) {
-        tpool_add_work(tm, read_lcpt, genome_arguments+i);
-    }
-
-    tpool_wait(tm);
-
-    tpool_destroy(tm);
+    run_genomes(genome_arguments, program_arguments, read_lcpt);
 }
 
 void read_lcpt(void *arg) {
@@ -22,9 +10,7 @@ void read_lcpt(void *arg) {
     struct gargs *genome_arguments = (struct gargs *)arg;
 
     if (genome_arguments->verbose) {
-        pthread_mutex_lock(&console_mutex_rload);
         log1(INFO, "Thread ID: %ld started processing %s", pthread_self(), genome_arguments->inFileName);
-        pthread_mutex_unlock(&console_mutex_rload);
     }
 
     // open fasta file
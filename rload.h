@@ -15,6 +15,8 @@
  * parameter in the `program_arguments` structure. Once the reading tasks are completed, the threads are 
  * joined and cleaned up.
  * 
+ * Genomes are submitted largest estimated work first (see `run_genomes`).
+ * 
  * @param genome_arguments A reference to a array of `gargs` structures, where each element contains 
  *        file information (e.g., input file names) and is passed to the respective threads for reading.
  * @param program_arguments A reference to the `pargs` structure, which contains general program settings, 
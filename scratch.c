@@ -0,0 +1,58 @@
+#include "scratch.h"
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Frees the scratch of a thread when it exits.
+ */
+static void scratch_destroy(void *arg) {
+    struct scratch *scratch = (struct scratch *)arg;
+
+    packed_free(&(scratch->sequence));
+    mem_free(&(scratch->mem), scratch->window, scratch->window_size);
+    free(scratch);
+}
+
+static void scratch_key_create() {
+    pthread_key_create(&scratch_key, scratch_destroy);
+}
+
+struct scratch *scratch_get() {
+
+    pthread_once(&scratch_once, scratch_key_create);
+
+    struct scratch *scratch = (struct scratch *)pthread_getspecific(scratch_key);
+    if (scratch != NULL) {
+        return scratch;
+    }
+
+    scratch = (struct scratch *)calloc(1, sizeof(struct scratch));
+    if (scratch == NULL) {
+        return NULL;
+    }
+
+    packed_init(&(scratch->sequence), &(scratch->mem), 0);
+
+    if (pthread_setspecific(scratch_key, scratch) != 0) {
+        free(scratch);
+        return NULL;
+    }
+
+    return scratch;
+}
+
+char *scratch_window(struct scratch *scratch, uint64_t size) {
+
+    if (size <= scratch->window_size) {
+        return scratch->window;
+    }
+
+    // the old characters are not needed, so the buffer is replaced instead of resized
+    mem_free(&(scratch->mem), scratch->window, scratch->window_size);
+
+    scratch->window = (char *)mem_malloc(&(scratch->mem), size);
+    scratch->window_size = scratch->window != NULL ? size : 0;
+
+    return scratch->window;
+}
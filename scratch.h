@@ -0,0 +1,41 @@
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include "mem.h"
+#include "packed.h"
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * @brief Buffers of a thread that outlive the genomes it processes.
+ *
+ * Every thread reading sequences, i.e. every worker of the pool, has its own 
+ * scratch. Its buffers grow to the largest chromosome and window seen by the 
+ * thread and are reused for the following chromosomes and genomes instead of 
+ * being allocated for each of them. They are charged to the tracker of the 
+ * scratch rather than to a genome, and freed when the thread exits.
+ */
+struct scratch {
+    struct memtrack mem;
+    struct packed_seq sequence; // chromosome being read
+    char *window; // characters restored from the sequence
+    uint64_t window_size;
+};
+
+/**
+ * @brief Returns the scratch of the calling thread, creating it on first use.
+ *
+ * @return Pointer to the scratch or NULL if it could not be allocated.
+ */
+struct scratch *scratch_get();
+
+/**
+ * @brief Returns the window buffer of a scratch, grown to at least the given size.
+ *
+ * @param scratch Pointer to the scratch.
+ * @param size Size of the buffer in bytes.
+ * @return Pointer to the buffer or NULL if it could not be grown.
+ */
+char *scratch_window(struct scratch *scratch, uint64_t size);
+
+#endif
@@ -0,0 +1,455 @@
+#include "serve.h"
+#include <errno.h>
+#include <poll.h>
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_signal(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+struct serve_connection {
+    struct serve_state *state;
+    int fd;
+    char buffer[SERVE_LINE_SIZE];
+    size_t len;
+};
+
+struct serve_request {
+    struct serve_state *state;
+    FILE *out;
+    char *line;
+};
+
+struct serve_hit {
+    uint64_t index;
+    double dice;
+    double jaccard;
+    double jukes_cantor;
+};
+
+struct serve_query {
+    const struct gargs *query;
+    const struct sigdb *db;
+    struct serve_hit *hits;
+};
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// MARK: Queries
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+static void serve_query_range(void *arg, size_t begin, size_t end) {
+    struct serve_query *args = (struct serve_query *)arg;
+
+    for (size_t i=begin; i<end; i++) {
+        struct serve_hit *hit = args->hits + i;
+        hit->index = i;
+        calcPairDistances(NULL, args->query, args->db->genomes + i, &(hit->dice), &(hit->jaccard), &(hit->jukes_cantor));
+    }
+}
+
+static int compare_hits(const void *a, const void *b) {
+    const struct serve_hit *hit1 = (const struct serve_hit *)a;
+    const struct serve_hit *hit2 = (const struct serve_hit *)b;
+
+    if (hit1->jaccard != hit2->jaccard) {
+        return hit1->jaccard < hit2->jaccard ? -1 : 1;
+    }
+    return hit1->index < hit2->index ? -1 : hit1->index > hit2->index;
+}
+
+/**
+ * Compares the query against every signature of the database and writes the
+ * k nearest ones.
+ */
+static void answer_query(struct serve_state *state, FILE *out, const struct gargs *query, uint64_t k) {
+    uint64_t n = state->db.header->count;
+
+    struct serve_hit *hits = (struct serve_hit *)malloc((n ? n : 1) * sizeof(struct serve_hit));
+    if (hits == NULL) {
+        fprintf(out, "ERR memory allocation failed\n");
+        return;
+    }
+
+    struct serve_query args = {query, &(state->db), hits};
+    tpool_parallel_for(state->tm, 0, n, SERVE_GRAIN, serve_query_range, &args);
+
+    qsort(hits, n, sizeof(struct serve_hit), compare_hits);
+
+    k = k == 0 || k > n ? n : k;
+    fprintf(out, "OK %lu\n", k);
+    for (uint64_t i=0; i<k; i++) {
+        fprintf(out, "%s\t%.15f\t%.15f\t%.15f\n", state->db.genomes[hits[i].index].shortName,
+            hits[i].dice, hits[i].jaccard, hits[i].jukes_cantor);
+    }
+
+    free(hits);
+}
+
+/**
+ * Generates the signature of a file with the parameters of the database.
+ * Returns 1 on success, 0 if the file cannot be read and -1 if the signature
+ * could not be generated, e.g. as it does not fit in memory.
+ */
+static int generate_query(struct serve_state *state, const char *path, thread_func_t reader, struct gargs *query) {
+    const struct sigdb_header *header = state->db.header;
+
+    memset(query, 0, sizeof(struct gargs));
+    query->inFileName = (char *)path;
+    query->shortName = (char *)path;
+    query->lcp_level = header->lcp_level;
+    query->sct = (sim_calculation_type)header->sct;
+    query->apply_filter = header->apply_filter;
+    query->min_cc = header->min_cc;
+    query->max_cc = header->max_cc;
+    query->auto_cc = header->auto_cc;
+    query->fallback_min_cc = header->min_cc;
+    query->fallback_max_cc = header->max_cc;
+    query->key = (key_type)header->key;
+    query->lcp_window = header->lcp_window;
+    query->n_split = header->n_split;
+    query->drop_masked = header->drop_masked;
+    query->numa_node = -1;
+
+    if (access(path, R_OK) != 0) {
+        return 0;
+    }
+
+    reader(query);
+
+    if (query->failed) {
+        mem_free(&(query->mem), query->cores, query->cores_capacity * key_size(query->key));
+        mem_free(&(query->mem), query->cc_hist, CC_HIST_BINS * sizeof(uint64_t));
+        return -1;
+    }
+
+    return 1;
+}
+
+static void handle_request(struct serve_state *state, FILE *out, char *line) {
+    char *saveptr;
+    char *command = strtok_r(line, " \t\r", &saveptr);
+    char *path = strtok_r(NULL, " \t\r", &saveptr);
+    char *count = strtok_r(NULL, " \t\r", &saveptr);
+    uint64_t k = count != NULL ? strtoull(count, NULL, 10) : 0;
+
+    if (command == NULL) {
+        fprintf(out, "ERR empty request\n");
+        return;
+    }
+
+    if (strcmp(command, "INFO") == 0) {
+        const struct sigdb_header *header = state->db.header;
+        fprintf(out, "OK 8\nsignatures\t%lu\nmode\t%s\nlcp_level\t%d\nsct\t%s\nmin_cc\t%u\nmax_cc\t%u\nauto_cc\t%d\nkey\t%s\n",
+            header->count, header->mode == FQ ? "fq" : "fa", header->lcp_level,
+            header->sct == VECTOR ? "vec" : "set", header->min_cc, header->max_cc,
+            header->auto_cc, key_name((key_type)header->key));
+        return;
+    }
+
+    if (strcmp(command, "FASTA") != 0 && strcmp(command, "FASTQ") != 0 && strcmp(command, "SIG") != 0) {
+        fprintf(out, "ERR unknown command %s\n", command);
+        return;
+    }
+
+    if (path == NULL) {
+        fprintf(out, "ERR missing path\n");
+        return;
+    }
+
+    uint64_t start = stats_now();
+
+    if (strcmp(command, "SIG") == 0) {
+        struct sigdb sig;
+        if (!sigdb_open(path, &sig) || sig.header->count == 0) {
+            fprintf(out, "ERR could not read signature %s\n", path);
+            if (sig.map != NULL) {
+                sigdb_close(&sig);
+            }
+            return;
+        }
+        if (!sigdb_compatible(sig.header, state->db.header)) {
+            fprintf(out, "ERR signature %s was generated with different parameters\n", path);
+            sigdb_close(&sig);
+            return;
+        }
+        answer_query(state, out, sig.genomes, k);
+        sigdb_close(&sig);
+    } else {
+        struct gargs query;
+        int status = generate_query(state, path, strcmp(command, "FASTA") == 0 ? read_fasta : read_fastq, &query);
+        if (status <= 0) {
+            fprintf(out, status == 0 ? "ERR could not read %s\n" : "ERR could not generate the signature of %s\n", path);
+            return;
+        }
+        answer_query(state, out, &query, k);
+        mem_free(&(query.mem), query.cores, query.cores_capacity * key_size(query.key));
+        mem_free(&(query.mem), query.cc_hist, CC_HIST_BINS * sizeof(uint64_t));
+    }
+
+    if (state->verbose) {
+        log1(INFO, "%s %s answered in %.3fs", command, path, (stats_now() - start) / 1e9);
+    }
+}
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// MARK: Connections
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+/**
+ * Reads the next request line. Waits in short polls so that idle
+ * connections notice a shutdown. Returns 1 on a line, 0 when the connection
+ * is closed or the server stops, -1 on errors and overlong lines.
+ */
+static int read_request(struct serve_connection *conn, char *line) {
+    for (;;) {
+        char *newline = (char *)memchr(conn->buffer, '\n', conn->len);
+        if (newline != NULL) {
+            size_t len = newline - conn->buffer;
+            memcpy(line, conn->buffer, len);
+            line[len] = '\0';
+            conn->len -= len + 1;
+            memmove(conn->buffer, newline + 1, conn->len);
+            return 1;
+        }
+
+        if (conn->len == sizeof(conn->buffer)) {
+            return -1;
+        }
+
+        struct pollfd pfd = {conn->fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, SERVE_POLL_SECONDS * 1000);
+        if (serve_stop) {
+            return 0;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        ssize_t got = recv(conn->fd, conn->buffer + conn->len, sizeof(conn->buffer) - conn->len, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return got == 0 ? 0 : -1;
+        }
+        conn->len += got;
+    }
+}
+
+static void serve_request_task(void *arg) {
+    struct serve_request *request = (struct serve_request *)arg;
+    handle_request(request->state, request->out, request->line);
+}
+
+/**
+ * Closes a connection and wakes up the shutdown once the last one is closed.
+ */
+static void close_connection(struct serve_connection *conn) {
+    struct serve_state *state = conn->state;
+
+    free(conn);
+
+    pthread_mutex_lock(&(state->mutex));
+    if (--state->connections == 0) {
+        pthread_cond_signal(&(state->closed));
+    }
+    pthread_mutex_unlock(&(state->mutex));
+}
+
+/**
+ * Thread of a connection. It only waits for requests and writes the replies,
+ * every request runs as a task of the pool while the thread waits for it.
+ */
+static void *serve_connection(void *arg) {
+    struct serve_connection *conn = (struct serve_connection *)arg;
+    char line[SERVE_LINE_SIZE];
+    int status;
+
+    FILE *out = fdopen(conn->fd, "w");
+    if (out == NULL) {
+        close(conn->fd);
+        close_connection(conn);
+        return NULL;
+    }
+
+    while ((status = read_request(conn, line)) == 1) {
+        if (strcmp(line, "QUIT") == 0 || strcmp(line, "QUIT\r") == 0) {
+            break;
+        }
+
+        struct serve_request request = {conn->state, out, line};
+        struct tpool_group group;
+        tpool_group_init(&group, conn->state->tm);
+        if (tpool_group_add_work(&group, serve_request_task, &request)) {
+            tpool_group_wait(&group);
+        } else {
+            fprintf(out, "ERR memory allocation failed\n");
+        }
+
+        if (fflush(out) != 0) {
+            break;
+        }
+    }
+
+    if (status < 0) {
+        fprintf(out, "ERR invalid request\n");
+    }
+
+    fclose(out);
+    close_connection(conn);
+
+    return NULL;
+}
+
+/**
+ * Starts the thread of a new connection, or turns the connection down if
+ * there are too many of them.
+ */
+static void open_connection(struct serve_state *state, int fd) {
+
+    pthread_mutex_lock(&(state->mutex));
+    int full = state->connections >= SERVE_MAX_CONNECTIONS;
+    if (!full) {
+        state->connections++;
+    }
+    pthread_mutex_unlock(&(state->mutex));
+
+    if (full) {
+        const char *reply = "ERR too many connections\n";
+        if (send(fd, reply, strlen(reply), 0) < 0 && state->verbose) {
+            log1(WARN, "Could not turn down a connection.");
+        }
+        close(fd);
+        return;
+    }
+
+    struct serve_connection *conn = (struct serve_connection *)malloc(sizeof(struct serve_connection));
+    if (conn == NULL) {
+        close(fd);
+        pthread_mutex_lock(&(state->mutex));
+        state->connections--;
+        pthread_mutex_unlock(&(state->mutex));
+        return;
+    }
+    conn->state = state;
+    conn->fd = fd;
+    conn->len = 0;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, serve_connection, conn) != 0) {
+        log1(ERROR, "Could not start the thread of a connection.");
+        close(fd);
+        close_connection(conn);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// MARK: Server
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+void serve(struct pargs *program_arguments) {
+
+    struct serve_state state;
+    state.verbose = program_arguments->verbose;
+    state.connections = 0;
+    pthread_mutex_init(&(state.mutex), NULL);
+    pthread_cond_init(&(state.closed), NULL);
+
+    if (!sigdb_open(program_arguments->db_file, &(state.db))) {
+        exit(EXIT_FAILURE);
+    }
+
+    const char *socket_path = program_arguments->socket_path;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        log1(ERROR, "Socket path is too long: %s", socket_path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        log1(ERROR, "Could not create socket.");
+        exit(EXIT_FAILURE);
+    }
+
+    // remove the socket of a previous server that did not shut down cleanly
+    struct stat st;
+    if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path);
+    }
+
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, SERVE_BACKLOG) != 0) {
+        log1(ERROR, "Could not listen on %s", socket_path);
+        close(server);
+        exit(EXIT_FAILURE);
+    }
+
+    // accept is interrupted by the signals instead of being restarted
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = serve_signal;
+    sigemptyset(&(action.sa_mask));
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    state.tm = tpool_create_ex(program_arguments->thread_number, program_arguments->pin ? TPOOL_PIN : 0);
+    if (state.tm == NULL) {
+        log1(ERROR, "Could not start the threads of the pool.");
+        close(server);
+        unlink(socket_path);
+        exit(EXIT_FAILURE);
+    }
+
+    log1(INFO, "Serving %lu signatures on %s with %d threads", state.db.header->count, socket_path, program_arguments->thread_number);
+
+    while (!serve_stop) {
+        int fd = accept(server, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            log1(ERROR, "Could not accept connection.");
+            break;
+        }
+
+        open_connection(&state, fd);
+    }
+
+    log1(INFO, "Shutting down server.");
+
+    close(server);
+    unlink(socket_path);
+
+    // connections notice the shutdown within a poll, after their running request
+    pthread_mutex_lock(&(state.mutex));
+    while (state.connections != 0) {
+        pthread_cond_wait(&(state.closed), &(state.mutex));
+    }
+    pthread_mutex_unlock(&(state.mutex));
+
+    tpool_wait(state.tm);
+    tpool_destroy(state.tm);
+    pthread_mutex_destroy(&(state.mutex));
+    pthread_cond_destroy(&(state.closed));
+    sigdb_close(&(state.db));
+}
@@ -0,0 +1,63 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "args.h"
+#include "utils.h"
+#include "tpool.h"
+#include "sigdb.h"
+#include "rfasta.h"
+#include "rfastq.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SERVE_DEFAULT_SOCKET "gencore.sock"
+#define SERVE_BACKLOG 64
+#define SERVE_LINE_SIZE 4096
+#define SERVE_GRAIN 64 // signatures compared per parallel_for chunk
+#define SERVE_POLL_SECONDS 1 // how often idle connections check for shutdown
+#define SERVE_MAX_CONNECTIONS 1024 // open connections, each has a thread of its own
+
+/**
+ * @brief Shared state of the server.
+ */
+struct serve_state {
+    struct sigdb db;
+    struct tpool *tm;
+    int verbose;
+    pthread_mutex_t mutex;
+    pthread_cond_t closed; // signaled when the last connection is closed
+    int connections; // open connections
+};
+
+/**
+ * @brief Serves distance queries against a signature database.
+ *
+ * The database given with `--db` is mapped once and the server listens on a
+ * Unix-domain socket. Every connection has a thread of its own that waits for
+ * its requests, so idle clients do not hold workers of the pool. A request runs
+ * as a task of the pool, signatures of files are generated by that task, and
+ * each query compares against the database with `tpool_parallel_for`.
+ * Requests and replies are lines of text:
+ *
+ *     FASTA <path> [k]   signature of a FASTA file against the database
+ *     FASTQ <path> [k]   signature of a FASTQ file against the database
+ *     SIG <path> [k]     first signature of a database file against the database
+ *     INFO               number of signatures and the parameters they were made with
+ *     QUIT               closes the connection
+ *
+ * A query is answered with `OK <m>` followed by `m` lines of
+ * `name<TAB>dice<TAB>jaccard<TAB>jukes_cantor`, the `k` nearest signatures by
+ * Jaccard distance (all of them if `k` is 0 or omitted). Failures are answered
+ * with `ERR <message>`. The server runs until SIGINT or SIGTERM.
+ *
+ * @param program_arguments Pointer to the program arguments holding the
+ *                          database, socket path and thread number.
+ */
+void serve(struct pargs *program_arguments);
+
+#endif
@@ -0,0 +1,458 @@
+#include "shard.h"
+
+struct shard_tile {
+    struct shard_block block;
+    uint64_t weight;
+    int index;
+    int shard; // 0-based shard the tile is assigned to
+};
+
+struct shard_row_args {
+    struct tpool *tm;
+    const struct gargs *genome_arguments;
+    const struct shard_block *block;
+    double *values;
+};
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// MARK: Planning
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+static uint64_t block_row_pairs(const struct shard_block *block, int i) {
+    return (uint64_t)((i < block->col_end ? i : block->col_end) - block->col_begin);
+}
+
+static uint64_t block_row_offset(const struct shard_block *block, int i) {
+    uint64_t r = i - block->row_begin;
+    if (block->row_begin == block->col_begin) {
+        return r * (r - 1) / 2;
+    }
+    return r * (block->col_end - block->col_begin);
+}
+
+static int compare_tiles(const void *a, const void *b) {
+    const struct shard_tile *tile1 = (const struct shard_tile *)a;
+    const struct shard_tile *tile2 = (const struct shard_tile *)b;
+
+    if (tile1->weight != tile2->weight) {
+        return tile1->weight > tile2->weight ? -1 : 1;
+    }
+    return tile1->index - tile2->index;
+}
+
+/**
+ * Tiles the lower triangle and assigns the tiles to shards. Returns the
+ * number of tiles, which are sorted by decreasing weight.
+ */
+static int plan_shards(const struct gargs *genome_arguments, int n, int shard_count, struct shard_tile **tiles) {
+
+    int t = (int)ceil(sqrt(2.0 * SHARD_TILES_PER_SHARD * shard_count));
+    t = t < n ? t : n;
+    t = t > 0 ? t : 1;
+
+    int *bounds = (int *)malloc((t + 1) * sizeof(int));
+    uint64_t *sizes = (uint64_t *)calloc(t, sizeof(uint64_t));
+    uint64_t *loads = (uint64_t *)calloc(shard_count, sizeof(uint64_t));
+    *tiles = (struct shard_tile *)malloc(((size_t)t * (t + 1) / 2) * sizeof(struct shard_tile));
+
+    if (bounds == NULL || sizes == NULL || loads == NULL || *tiles == NULL) {
+        log1(ERROR, "Memory allocation failed for distance shards.");
+        exit(EXIT_FAILURE);
+    }
+
+    // a pair costs about the sum of the sizes of its signatures
+    for (int k=0; k<=t; k++) {
+        bounds[k] = (int)((int64_t)n * k / t);
+    }
+    for (int k=0; k<t; k++) {
+        for (int i=bounds[k]; i<bounds[k+1]; i++) {
+            sizes[k] += genome_arguments[i].cores_len + 1;
+        }
+    }
+
+    int count = 0;
+    for (int r=0; r<t; r++) {
+        for (int c=0; c<=r; c++) {
+            struct shard_tile *tile = *tiles + count;
+            tile->block.row_begin = bounds[r];
+            tile->block.row_end = bounds[r+1];
+            tile->block.col_begin = bounds[c];
+            tile->block.col_end = bounds[c+1];
+
+            uint64_t rows = bounds[r+1] - bounds[r];
+            uint64_t cols = bounds[c+1] - bounds[c];
+            if (r == c) {
+                tile->block.pairs = rows * (rows - 1) / 2;
+                tile->weight = rows > 1 ? (rows - 1) * sizes[r] : 0;
+            } else {
+                tile->block.pairs = rows * cols;
+                tile->weight = cols * sizes[r] + rows * sizes[c];
+            }
+
+            if (tile->block.pairs) {
+                tile->index = count++;
+            }
+        }
+    }
+
+    // heaviest tile first to the least loaded shard
+    qsort(*tiles, count, sizeof(struct shard_tile), compare_tiles);
+
+    for (int k=0; k<count; k++) {
+        int best = 0;
+        for (int s=1; s<shard_count; s++) {
+            if (loads[s] < loads[best]) {
+                best = s;
+            }
+        }
+        (*tiles)[k].shard = best;
+        loads[best] += (*tiles)[k].weight;
+    }
+
+    free(bounds);
+    free(sizes);
+    free(loads);
+
+    return count;
+}
+
+static uint64_t fingerprint_signatures(const struct gargs *genome_arguments, int n) {
+
+    // FNV-1a over the names and signature sizes
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (int i=0; i<n; i++) {
+        char name[SHARD_NAME_SIZE] = {0};
+        strncpy(name, genome_arguments[i].shortName, SHARD_NAME_SIZE-1);
+
+        const unsigned char *bytes[3] = {(const unsigned char *)name, (const unsigned char *)&(genome_arguments[i].cores_len), (const unsigned char *)&(genome_arguments[i].total_len)};
+        size_t lens[3] = {SHARD_NAME_SIZE, sizeof(uint64_t), sizeof(double)};
+
+        for (int k=0; k<3; k++) {
+            for (size_t b=0; b<lens[k]; b++) {
+                hash ^= bytes[k][b];
+                hash *= 0x100000001b3ULL;
+            }
+        }
+    }
+
+    return hash;
+}
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// MARK: Shard computation
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+static void calcShardRows(void *arg, size_t begin, size_t end) {
+
+    struct shard_row_args *args = (struct shard_row_args *)arg;
+    const struct gargs *genome_arguments = args->genome_arguments;
+    const struct shard_block *block = args->block;
+    uint64_t pairs = 0;
+    uint64_t start = stats_now();
+
+    for (int i=(int)begin; i<(int)end; i++) {
+        double *values = args->values + 3 * block_row_offset(block, i);
+        uint64_t row_pairs = block_row_pairs(block, i);
+
+        for (uint64_t k=0; k<row_pairs; k++) {
+            calcPairDistances(args->tm, &(genome_arguments[i]), &(genome_arguments[block->col_begin + k]), values, values+1, values+2);
+            values += 3;
+        }
+        pairs += row_pairs;
+    }
+
+    stats_add(STAGE_DISTANCE, stats_now() - start);
+    atomic_fetch_add_explicit(&(run_stats.pairs), pairs, memory_order_relaxed);
+    progress_add(&(progress.pairs), pairs);
+}
+
+void calcShardDistances(const struct gargs *genome_arguments, const struct pargs *program_arguments) {
+
+    uint64_t start = stats_now();
+    int n = program_arguments->number_of_genomes;
+    int shard = program_arguments->shard_index - 1;
+
+    struct shard_tile *tiles;
+    int tile_count = plan_shards(genome_arguments, n, program_arguments->shard_count, &tiles);
+
+    uint64_t block_count = 0;
+    uint64_t shard_pairs = 0;
+    uint64_t max_pairs = 0;
+    for (int k=0; k<tile_count; k++) {
+        if (tiles[k].shard == shard) {
+            block_count++;
+            shard_pairs += tiles[k].block.pairs;
+            max_pairs = tiles[k].block.pairs > max_pairs ? tiles[k].block.pairs : max_pairs;
+        }
+    }
+
+    log1(INFO, "Calculating distance shard %d/%d: %lu blocks, %lu of %lu pairs...", program_arguments->shard_index,
+        program_arguments->shard_count, block_count, shard_pairs, (uint64_t)n * (n-1) / 2);
+
+    char filename[256], tmp_filename[264];
+    if (snprintf(filename, sizeof(filename), "%s.shard%dof%d.bin", program_arguments->prefix, program_arguments->shard_index, program_arguments->shard_count) >= (int)sizeof(filename)) {
+        log1(ERROR, "Filename buffer for distance shard overflow.");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+
+    FILE *out = fopen(tmp_filename, "wb");
+    double *values = (double *)malloc((max_pairs ? max_pairs : 1) * 3 * sizeof(double));
+    char (*names)[SHARD_NAME_SIZE] = calloc(n, SHARD_NAME_SIZE);
+
+    if (out == NULL) {
+        log1(ERROR, "Could not create %s", tmp_filename);
+        exit(EXIT_FAILURE);
+    }
+    if (values == NULL || names == NULL) {
+        log1(ERROR, "Memory allocation failed for distance shard.");
+        exit(EXIT_FAILURE);
+    }
+
+    struct shard_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SHARD_MAGIC;
+    header.shard_index = program_arguments->shard_index;
+    header.shard_count = program_arguments->shard_count;
+    header.n = n;
+    header.lcp_level = genome_arguments[0].lcp_level;
+    header.sct = genome_arguments[0].sct;
+    header.name_size = SHARD_NAME_SIZE;
+    header.block_count = block_count;
+    header.fingerprint = fingerprint_signatures(genome_arguments, n);
+
+    for (int i=0; i<n; i++) {
+        strncpy(names[i], genome_arguments[i].shortName, SHARD_NAME_SIZE-1);
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(names, SHARD_NAME_SIZE, n, out) == (size_t)n;
+
+    struct tpool *tm = tpool_create_ex(program_arguments->thread_number, program_arguments->pin ? TPOOL_PIN : 0);
+    if (tm == NULL) {
+        log1(ERROR, "Could not start the threads of the pool.");
+        exit(EXIT_FAILURE);
+    }
+
+    progress_begin(PROGRESS_DISTANCES, 0, 0, shard_pairs);
+
+    // blocks one after another, the rows of a block in parallel
+    for (int k=0; ok && k<tile_count; k++) {
+        if (tiles[k].shard != shard) {
+            continue;
+        }
+
+        struct shard_row_args args = {tm, genome_arguments, &(tiles[k].block), values};
+        tpool_parallel_for(tm, tiles[k].block.row_begin, tiles[k].block.row_end, 1, calcShardRows, &args);
+
+        uint64_t write_start = stats_now();
+        ok = fwrite(&(tiles[k].block), sizeof(struct shard_block), 1, out) == 1;
+        ok = ok && fwrite(values, 3 * sizeof(double), tiles[k].block.pairs, out) == tiles[k].block.pairs;
+        stats_add(STAGE_WRITE, stats_now() - write_start);
+    }
+
+    tpool_destroy(tm);
+
+    ok = (fclose(out) == 0) && ok;
+
+    if (!ok || rename(tmp_filename, filename) != 0) {
+        log1(ERROR, "Could not write distance shard %s", filename);
+        remove(tmp_filename);
+        exit(EXIT_FAILURE);
+    }
+
+    log1(INFO, "Distance shard is written to %s", filename);
+
+    free(tiles);
+    free(values);
+    free(names);
+
+    run_stats.distances_ns = stats_now() - start;
+}
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// MARK: Merging
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+struct merge_state {
+    struct shard_header first;
+    char (*names)[SHARD_NAME_SIZE];
+    const char **name_ptrs;
+    double *dice;
+    double *jaccard;
+    double *jukes_cantor;
+    char *seen; // per shard
+    uint64_t pairs;
+    double *values;
+    uint64_t values_capacity;
+};
+
+static void merge_fail(const char *filename, const char *reason) {
+    log1(ERROR, "Could not merge %s: %s", filename, reason);
+    exit(EXIT_FAILURE);
+}
+
+static void merge_shard_file(const char *filename, struct merge_state *state) {
+
+    FILE *in = fopen(filename, "rb");
+    if (in == NULL) {
+        merge_fail(filename, "could not open file");
+    }
+
+    struct shard_header header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != SHARD_MAGIC || header.name_size != SHARD_NAME_SIZE) {
+        merge_fail(filename, "not a distance shard");
+    }
+    if (header.shard_count <= 0 || header.shard_index < 1 || header.shard_index > header.shard_count || header.n < 0) {
+        merge_fail(filename, "invalid header");
+    }
+
+    int n = header.n;
+
+    if (state->names == NULL) {
+        state->first = header;
+        state->names = calloc(n ? n : 1, SHARD_NAME_SIZE);
+        state->name_ptrs = (const char **)malloc((n ? n : 1) * sizeof(char *));
+        state->dice = (double *)calloc((size_t)n * n + 1, sizeof(double));
+        state->jaccard = (double *)calloc((size_t)n * n + 1, sizeof(double));
+        state->jukes_cantor = (double *)calloc((size_t)n * n + 1, sizeof(double));
+        state->seen = (char *)calloc(header.shard_count, sizeof(char));
+
+        if (state->names == NULL || state->name_ptrs == NULL || state->dice == NULL || state->jaccard == NULL ||
+            state->jukes_cantor == NULL || state->seen == NULL) {
+            log1(ERROR, "Memory allocation failed for distance matrices.");
+            exit(EXIT_FAILURE);
+        }
+        if (fread(state->names, SHARD_NAME_SIZE, n, in) != (size_t)n) {
+            merge_fail(filename, "truncated names");
+        }
+        for (int i=0; i<n; i++) {
+            state->names[i][SHARD_NAME_SIZE-1] = '\0';
+            state->name_ptrs[i] = state->names[i];
+        }
+    } else {
+        if (header.n != state->first.n || header.shard_count != state->first.shard_count || header.lcp_level != state->first.lcp_level ||
+            header.sct != state->first.sct || header.fingerprint != state->first.fingerprint) {
+            merge_fail(filename, "shard was computed from different signatures or parameters");
+        }
+        if (fseek(in, (long)n * SHARD_NAME_SIZE, SEEK_CUR) != 0) {
+            merge_fail(filename, "truncated names");
+        }
+    }
+
+    if (state->seen[header.shard_index-1]++) {
+        merge_fail(filename, "shard is given more than once");
+    }
+
+    for (uint64_t k=0; k<header.block_count; k++) {
+        struct shard_block block;
+        if (fread(&block, sizeof(block), 1, in) != 1) {
+            merge_fail(filename, "truncated block");
+        }
+
+        int diagonal = block.row_begin == block.col_begin && block.row_end == block.col_end;
+        if (block.row_begin < 0 || block.row_begin >= block.row_end || block.row_end > n ||
+            block.col_begin < 0 || block.col_begin >= block.col_end || (!diagonal && block.col_end > block.row_begin)) {
+            merge_fail(filename, "invalid block");
+        }
+
+        uint64_t pairs = block_row_offset(&block, block.row_end - 1) + block_row_pairs(&block, block.row_end - 1);
+        if (pairs != block.pairs) {
+            merge_fail(filename, "invalid block");
+        }
+
+        if (pairs > state->values_capacity) {
+            state->values = (double *)realloc(state->values, pairs * 3 * sizeof(double));
+            if (state->values == NULL) {
+                log1(ERROR, "Memory allocation failed for distance shard.");
+                exit(EXIT_FAILURE);
+            }
+            state->values_capacity = pairs;
+        }
+        if (fread(state->values, 3 * sizeof(double), pairs, in) != pairs) {
+            merge_fail(filename, "truncated block");
+        }
+
+        const double *values = state->values;
+        for (int i=block.row_begin; i<block.row_end; i++) {
+            uint64_t row_pairs = block_row_pairs(&block, i);
+            for (uint64_t c=0; c<row_pairs; c++) {
+                size_t j = block.col_begin + c;
+                state->dice[(size_t)i*n+j] = state->dice[j*n+i] = values[0];
+                state->jaccard[(size_t)i*n+j] = state->jaccard[j*n+i] = values[1];
+                state->jukes_cantor[(size_t)i*n+j] = state->jukes_cantor[j*n+i] = values[2];
+                values += 3;
+            }
+        }
+        state->pairs += pairs;
+    }
+
+    fclose(in);
+}
+
+void merge_shards(const struct pargs *program_arguments) {
+
+    uint64_t start = stats_now();
+
+    FILE *list = fopen(program_arguments->shard_list, "r");
+    if (list == NULL) {
+        log1(ERROR, "Could not open file: %s", program_arguments->shard_list);
+        exit(EXIT_FAILURE);
+    }
+
+    struct merge_state state;
+    memset(&state, 0, sizeof(state));
+
+    char buffer[1024];
+    int files = 0;
+
+    while (fgets(buffer, sizeof(buffer), list)) {
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        if (buffer[0] == '\0') {
+            continue;
+        }
+        merge_shard_file(buffer, &state);
+        files++;
+    }
+
+    fclose(list);
+
+    if (files == 0) {
+        log1(ERROR, "No distance shards are given in %s", program_arguments->shard_list);
+        exit(EXIT_FAILURE);
+    }
+
+    int n = state.first.n;
+    for (int s=0; s<state.first.shard_count; s++) {
+        if (!state.seen[s]) {
+            log1(ERROR, "Distance shard %d/%d is missing.", s+1, state.first.shard_count);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (state.pairs != (uint64_t)n * (n-1) / 2) {
+        log1(ERROR, "Distance shards cover %lu of %lu pairs.", state.pairs, (uint64_t)n * (n-1) / 2);
+        exit(EXIT_FAILURE);
+    }
+
+    log1(INFO, "Merged %d distance shards of %d genomes, writing distance matrices to files...", files, n);
+
+    writeDistanceMatrices(program_arguments->prefix, (sim_calculation_type)state.first.sct, state.first.lcp_level, n, state.name_ptrs,
+        state.dice, state.jaccard, state.jukes_cantor);
+
+    free(state.names);
+    free(state.name_ptrs);
+    free(state.dice);
+    free(state.jaccard);
+    free(state.jukes_cantor);
+    free(state.seen);
+    free(state.values);
+
+    log1(INFO, "Merged in %.2f seconds.", (stats_now() - start) / 1e9);
+}
@@ -0,0 +1,80 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "args.h"
+#include "utils.h" // logging, distances
+#include "tpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define SHARD_MAGIC 0x4743534852443031ULL // "GCSHRD01"
+#define SHARD_NAME_SIZE 64
+#define SHARD_TILES_PER_SHARD 16 // tiles of the lower triangle per shard, for balancing
+
+/**
+ * @brief Header at the beginning of a shard block file.
+ *
+ * The header is followed by `n` short names of `SHARD_NAME_SIZE` bytes and
+ * `block_count` blocks. The fingerprint covers the names and signature
+ * sizes, so shards computed from different signatures are not merged.
+ */
+struct shard_header {
+    uint64_t magic;
+    int32_t shard_index; // 1-based
+    int32_t shard_count;
+    int32_t n;
+    int32_t lcp_level;
+    int32_t sct;
+    uint32_t name_size;
+    uint64_t block_count;
+    uint64_t fingerprint;
+};
+
+/**
+ * @brief A block of the lower triangle of the distance matrices.
+ *
+ * Rows and columns are half-open ranges of genome indices. A block is either
+ * on the diagonal, where only pairs below it are kept, or entirely below it.
+ * In the file, the header is followed by `pairs` triples of Dice, Jaccard
+ * and Jukes-Cantor distances, in row-major order.
+ */
+struct shard_block {
+    int32_t row_begin;
+    int32_t row_end;
+    int32_t col_begin;
+    int32_t col_end;
+    uint64_t pairs;
+};
+
+/**
+ * @brief Computes the distances of one shard and writes them as a binary block file.
+ *
+ * The lower triangle is tiled into blocks, which are weighted by the sizes
+ * of the signatures they compare, as a merge-based intersection is linear in
+ * both. Blocks are assigned to shards by the heaviest first to the least
+ * loaded shard. Every shard derives the same plan from the same signatures,
+ * so the shards can run on different machines without coordination. The
+ * result is written to `<prefix>.shard<i>of<n>.bin`.
+ *
+ * @param genome_arguments Pointer to the array of genome arguments (`gargs`)
+ *                         holding the signatures of all genomes.
+ * @param program_arguments Pointer to the program arguments (`pargs`) holding
+ *                          the shard index and count.
+ */
+void calcShardDistances(const struct gargs *genome_arguments, const struct pargs *program_arguments);
+
+/**
+ * @brief Merges the block files of all shards into the distance matrices.
+ *
+ * The files are read from the list given with `-i`. Every shard must be
+ * present exactly once and all of them must come from the same signatures.
+ * The matrices are written like the ones of an unsharded run.
+ *
+ * @param program_arguments Pointer to the program arguments (`pargs`).
+ */
+void merge_shards(const struct pargs *program_arguments);
+
+#endif
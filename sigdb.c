@@ -0,0 +1,245 @@
+#include "sigdb.h"
+
+/**
+ * Fills the parameters of a header with the ones the signatures of a genome
+ * were generated with.
+ */
+static void sigdb_parameters(struct sigdb_header *header, const struct gargs *genome_arguments) {
+    header->lcp_level = genome_arguments->lcp_level;
+    header->sct = genome_arguments->sct;
+    header->apply_filter = genome_arguments->apply_filter;
+    // picked thresholds differ per signature, queries pick their own from the given fallback
+    header->min_cc = genome_arguments->auto_cc ? genome_arguments->fallback_min_cc : genome_arguments->min_cc;
+    header->max_cc = genome_arguments->auto_cc ? genome_arguments->fallback_max_cc : genome_arguments->max_cc;
+    header->key = genome_arguments->key;
+    header->drop_masked = genome_arguments->drop_masked;
+    header->auto_cc = genome_arguments->auto_cc;
+    header->lcp_window = genome_arguments->lcp_window;
+    header->n_split = genome_arguments->n_split;
+}
+
+int sigdb_compatible(const struct sigdb_header *a, const struct sigdb_header *b) {
+    return a->key == b->key && a->lcp_level == b->lcp_level && a->sct == b->sct &&
+        a->apply_filter == b->apply_filter && a->auto_cc == b->auto_cc &&
+        (!a->apply_filter || (a->min_cc == b->min_cc && a->max_cc == b->max_cc)) &&
+        a->lcp_window == b->lcp_window && a->n_split == b->n_split && a->drop_masked == b->drop_masked;
+}
+
+int sigdb_write(const char *filename, const struct gargs *genome_arguments, int n, program_mode mode) {
+
+    char tmp_filename_buffer[4096];
+    if (snprintf(tmp_filename_buffer, sizeof(tmp_filename_buffer), "%s.tmp", filename) >= (int)sizeof(tmp_filename_buffer)) {
+        log1(ERROR, "Filename buffer for signature database overflow.");
+        return 0;
+    }
+
+    FILE *out = fopen(tmp_filename_buffer, "wb");
+    if (out == NULL) {
+        log1(ERROR, "Could not create signature database %s", tmp_filename_buffer);
+        return 0;
+    }
+
+    struct sigdb_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SIGDB_MAGIC;
+    header.count = n;
+    header.mode = mode;
+    if (n) {
+        sigdb_parameters(&header, genome_arguments);
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1;
+
+    uint64_t offset = sizeof(header) + n * sizeof(struct sigdb_entry);
+    for (int i=0; ok && i<n; i++) {
+        struct sigdb_entry entry;
+        memset(&entry, 0, sizeof(entry));
+        strncpy(entry.name, genome_arguments[i].shortName, SIGDB_NAME_SIZE-1);
+        entry.offset = offset;
+        entry.cores_len = genome_arguments[i].cores_len;
+        entry.total_len = genome_arguments[i].total_len;
+        offset += entry.cores_len * key_size(genome_arguments[i].key);
+
+        ok = fwrite(&entry, sizeof(entry), 1, out) == 1;
+    }
+
+    for (int i=0; ok && i<n; i++) {
+        if (genome_arguments[i].cores_len) {
+            ok = fwrite(genome_arguments[i].cores, key_size(genome_arguments[i].key), genome_arguments[i].cores_len, out) == genome_arguments[i].cores_len;
+        }
+    }
+
+    ok = (fclose(out) == 0) && ok;
+
+    if (!ok || rename(tmp_filename_buffer, filename) != 0) {
+        log1(ERROR, "Could not write signature database %s", filename);
+        remove(tmp_filename_buffer);
+        return 0;
+    }
+
+    return 1;
+}
+
+int sigdb_open(const char *filename, struct sigdb *db) {
+
+    memset(db, 0, sizeof(struct sigdb));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        log1(ERROR, "Could not open signature database %s", filename);
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct sigdb_header)) {
+        log1(ERROR, "Invalid signature database %s", filename);
+        close(fd);
+        return 0;
+    }
+
+    db->map_size = st.st_size;
+    db->map = mmap(NULL, db->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (db->map == MAP_FAILED) {
+        log1(ERROR, "Could not map signature database %s", filename);
+        db->map = NULL;
+        return 0;
+    }
+
+    db->header = (const struct sigdb_header *)db->map;
+    db->entries = (const struct sigdb_entry *)(db->header + 1);
+
+    uint64_t count = db->header->count;
+    if (db->header->magic != SIGDB_MAGIC || count > (db->map_size - sizeof(struct sigdb_header)) / sizeof(struct sigdb_entry) ||
+        db->header->key < KEY_CORE || db->header->key > KEY_HASH) {
+        log1(ERROR, "Invalid signature database %s", filename);
+        sigdb_close(db);
+        return 0;
+    }
+
+    db->genomes = (struct gargs *)calloc(count ? count : 1, sizeof(struct gargs));
+    if (db->genomes == NULL) {
+        log1(ERROR, "Memory allocation failed for signature database.");
+        sigdb_close(db);
+        return 0;
+    }
+
+    size_t size = key_size((key_type)db->header->key);
+
+    for (uint64_t i=0; i<count; i++) {
+        const struct sigdb_entry *entry = db->entries + i;
+
+        if (entry->offset % size || entry->offset > db->map_size ||
+            entry->cores_len > (db->map_size - entry->offset) / size ||
+            memchr(entry->name, '\0', SIGDB_NAME_SIZE) == NULL) {
+            log1(ERROR, "Corrupted entry %lu in signature database %s", i, filename);
+            sigdb_close(db);
+            return 0;
+        }
+
+        struct gargs *g = db->genomes + i;
+        g->shortName = (char *)entry->name;
+        g->inFileName = (char *)entry->name;
+        g->cores = (void *)((const char *)db->map + entry->offset);
+        g->key = (key_type)db->header->key;
+        g->cores_len = entry->cores_len;
+        g->total_len = entry->total_len;
+        g->lcp_level = db->header->lcp_level;
+        g->sct = (sim_calculation_type)db->header->sct;
+        g->apply_filter = db->header->apply_filter;
+        g->min_cc = db->header->min_cc;
+        g->max_cc = db->header->max_cc;
+        g->auto_cc = db->header->auto_cc;
+        g->fallback_min_cc = db->header->min_cc;
+        g->fallback_max_cc = db->header->max_cc;
+        g->lcp_window = db->header->lcp_window;
+        g->n_split = db->header->n_split;
+        g->drop_masked = db->header->drop_masked;
+        g->numa_node = -1;
+    }
+
+    // signatures are scanned sequentially by every query
+    madvise(db->map, db->map_size, MADV_WILLNEED);
+
+    return 1;
+}
+
+int sigdb_load(const char *filename, struct gargs **genome_arguments, int *n, program_mode *mode) {
+
+    struct sigdb db;
+    if (!sigdb_open(filename, &db)) {
+        return 0;
+    }
+
+    uint64_t count = db.header->count;
+
+    struct sigdb_header previous;
+    memset(&previous, 0, sizeof(previous));
+    if (*n > 0) {
+        sigdb_parameters(&previous, *genome_arguments);
+    }
+
+    if (*n > 0 && !sigdb_compatible(db.header, &previous)) {
+        log1(ERROR, "Signatures in %s were generated with different parameters than the previous ones.", filename);
+        sigdb_close(&db);
+        return 0;
+    }
+
+    if (*n > 0 && db.header->mode != (int32_t)*mode) {
+        log1(WARN, "Signatures in %s were generated from %s while the previous ones from %s.", filename,
+            db.header->mode == FQ ? "reads" : "assemblies", *mode == FQ ? "reads" : "assemblies");
+    }
+    *mode = (program_mode)db.header->mode;
+
+    struct gargs *temp = (struct gargs *)realloc(*genome_arguments, (*n + count) * sizeof(struct gargs));
+    if (temp == NULL) {
+        log1(ERROR, "Memory allocation failed for genome arguments.");
+        sigdb_close(&db);
+        return 0;
+    }
+    *genome_arguments = temp;
+
+    // copy the signatures out of the mapping, so that they are owned like generated ones
+    for (uint64_t i=0; i<count; i++) {
+        struct gargs *g = *genome_arguments + *n + i;
+        *g = db.genomes[i];
+        g->inFileName = strdup(filename);
+        g->shortName = strdup(db.genomes[i].shortName);
+        g->cores = NULL;
+        g->cores_len = 0;
+        g->cores_capacity = 0;
+
+        if (g->inFileName == NULL || g->shortName == NULL || !reserve_cores(g, db.genomes[i].cores_len)) {
+            log1(ERROR, "Memory allocation failed for signatures of %s", filename);
+            // the array keeps its size, but the signatures of this file are dropped
+            for (uint64_t j=0; j<=i; j++) {
+                struct gargs *loaded = *genome_arguments + *n + j;
+                free(loaded->inFileName);
+                free(loaded->shortName);
+                mem_free(&(loaded->mem), loaded->cores, loaded->cores_capacity * key_size(loaded->key));
+            }
+            sigdb_close(&db);
+            return 0;
+        }
+
+        if (db.genomes[i].cores_len) {
+            memcpy(g->cores, db.genomes[i].cores, db.genomes[i].cores_len * key_size(g->key));
+        }
+        g->cores_len = db.genomes[i].cores_len;
+    }
+
+    *n += count;
+
+    sigdb_close(&db);
+
+    return 1;
+}
+
+void sigdb_close(struct sigdb *db) {
+    if (db->map != NULL) {
+        munmap(db->map, db->map_size);
+    }
+    free(db->genomes);
+    memset(db, 0, sizeof(struct sigdb));
+}
@@ -0,0 +1,134 @@
+#ifndef SIGDB_H
+#define SIGDB_H
+
+#include "args.h"
+#include "utils.h" // logging
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SIGDB_MAGIC 0x4743534442303033ULL // "GCSDB003"
+#define SIGDB_NAME_SIZE 64
+
+/**
+ * @brief Header at the beginning of a signature database file.
+ *
+ * The parameters are the ones the signatures were generated with, so that
+ * signatures of new inputs can be generated comparably.
+ */
+struct sigdb_header {
+    uint64_t magic;
+    uint64_t count;
+    int32_t mode; // FA or FQ
+    int32_t lcp_level;
+    int32_t sct;
+    int32_t apply_filter;
+    uint32_t min_cc;
+    uint32_t max_cc;
+    int32_t key; // key type of the cores
+    int32_t drop_masked;
+    int32_t auto_cc; // 1: thresholds were picked per signature, min_cc and max_cc are the given fallback
+    int32_t reserved;
+    uint64_t lcp_window;
+    uint64_t n_split;
+};
+
+/**
+ * @brief Index entry of a signature in the database.
+ *
+ * The header is followed by `count` entries, which are followed by the
+ * sorted cores of every signature at the offsets given in the entries, as 
+ * keys of the type given in the header.
+ */
+struct sigdb_entry {
+    char name[SIGDB_NAME_SIZE]; // short name, NUL terminated
+    uint64_t offset;
+    uint64_t cores_len;
+    double total_len;
+};
+
+/**
+ * @brief A signature database mapped into memory.
+ *
+ * `genomes` holds one genome argument per signature whose `cores` point into
+ * the read-only mapping, so they can be passed to the distance functions
+ * but must not be modified or freed.
+ */
+struct sigdb {
+    const struct sigdb_header *header;
+    const struct sigdb_entry *entries;
+    struct gargs *genomes;
+    void *map;
+    size_t map_size;
+};
+
+/**
+ * @brief Whether signatures of two headers were generated with the same parameters.
+ *
+ * Every parameter that changes the contents of a signature is compared: the 
+ * key type, LCP level, distance calculation mode, core-count filter and its 
+ * thresholds, windowing, splitting at N runs and dropping of masked regions. 
+ * Only signatures of compatible headers can be compared with each other.
+ *
+ * @param a Pointer to the first header.
+ * @param b Pointer to the second header.
+ * @return 1 if the signatures are comparable, 0 otherwise.
+ */
+int sigdb_compatible(const struct sigdb_header *a, const struct sigdb_header *b);
+
+/**
+ * @brief Writes the signatures of genomes into a database file.
+ *
+ * The file is written to a temporary file and renamed into place, so that
+ * a database being served is never seen partially written.
+ *
+ * @param filename Path of the database.
+ * @param genome_arguments Array of genomes whose signatures were generated.
+ * @param n Number of genomes.
+ * @param mode The program mode the signatures were generated in.
+ * @return 1 on success, 0 otherwise.
+ */
+int sigdb_write(const char *filename, const struct gargs *genome_arguments, int n, program_mode mode);
+
+/**
+ * @brief Maps a signature database into memory.
+ *
+ * The header and every entry are validated against the size of the file.
+ *
+ * @param filename Path of the database.
+ * @param db Pointer to the database to be filled.
+ * @return 1 on success, 0 otherwise.
+ */
+int sigdb_open(const char *filename, struct sigdb *db);
+
+/**
+ * @brief Loads the signatures of a database file into genome arguments.
+ *
+ * The signatures are copied into tracked allocations and appended to the
+ * array, which is grown as needed, so they can be used and freed like the
+ * generated ones. Signatures of all loaded files must have been generated
+ * with the same parameters (see `sigdb_compatible`). On failure, nothing is
+ * appended.
+ *
+ * @param filename Path of the database.
+ * @param genome_arguments Pointer to the array of genome arguments to append to.
+ * @param n Pointer to the number of genomes in the array, updated on success.
+ * @param mode Pointer to the program mode the signatures were generated in,
+ *             compared against and set to the one of the file.
+ * @return 1 on success, 0 otherwise.
+ */
+int sigdb_load(const char *filename, struct gargs **genome_arguments, int *n, program_mode *mode);
+
+/**
+ * @brief Unmaps a signature database.
+ *
+ * @param db Pointer to the database opened by `sigdb_open`.
+ */
+void sigdb_close(struct sigdb *db);
+
+#endif
@@ -0,0 +1,295 @@
+#include "sink.h"
+
+int sink_cores(const struct lps *str, uint64_t own_begin, uint64_t own_end, const struct core_sink *sink) {
+
+    simple_core batch[SINK_BATCH];
+    size_t count = 0;
+
+    for (int i=0; i<str->size; i++) {
+        if (str->cores[i].start < own_begin || str->cores[i].start >= own_end) {
+            continue;
+        }
+
+        batch[count++] = pack_core(&(str->cores[i]));
+
+        if (count == SINK_BATCH) {
+            if (!sink->func(sink->arg, batch, count)) {
+                return 0;
+            }
+            count = 0;
+        }
+    }
+
+    return count == 0 || sink->func(sink->arg, batch, count);
+}
+
+int sink_to_genome(void *arg, const simple_core *cores, size_t count) {
+
+    struct gargs *genome_arguments = (struct gargs *)arg;
+
+    if (!reserve_cores(genome_arguments, genome_arguments->cores_len + count)) {
+        genome_arguments->failed = 1;
+        return 0;
+    }
+
+    if (genome_arguments->key == KEY_CORE) {
+        memcpy((simple_core *)genome_arguments->cores + genome_arguments->cores_len, cores, count * sizeof(simple_core));
+    } else {
+        uint32_t *keys = (uint32_t *)genome_arguments->cores + genome_arguments->cores_len;
+        for (size_t i=0; i<count; i++) {
+            keys[i] = narrow_core(cores[i], genome_arguments->key);
+            genome_arguments->core_bases += cores[i] & 0xFFFFFFFF;
+        }
+    }
+    genome_arguments->cores_len += count;
+
+    return 1;
+}
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// MARK: Segments
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+/**
+ * Position of the next search of segments in a sequence, with the next runs
+ * of a packed sequence that may end a segment.
+ */
+struct segment_iter {
+    uint64_t pos;
+    uint64_t ambiguous;
+    uint64_t masked;
+};
+
+static inline int is_masked(char c) {
+    return c >= 'a' && c <= 'z';
+}
+
+static inline int is_n(char c) {
+    return c == 'N' || c == 'n';
+}
+
+/**
+ * Length of the whole run of N characters (of either case) around the
+ * position, so that runs are measured like the ambiguous runs of a packed
+ * sequence.
+ */
+static uint64_t n_run(const char *sequence, uint64_t len, uint64_t pos, uint64_t *run_end) {
+    uint64_t start = pos, end = pos;
+    while (start > 0 && is_n(sequence[start-1])) {
+        start--;
+    }
+    while (end < len && is_n(sequence[end])) {
+        end++;
+    }
+    *run_end = end;
+    return end - start;
+}
+
+/**
+ * Finds the next segment of a sequence given as characters. Returns 0 if
+ * there is none.
+ */
+static int next_segment_chars(const char *sequence, uint64_t len, struct segment_iter *it, uint64_t n_split, int drop_masked, uint64_t *begin, uint64_t *end) {
+
+    uint64_t pos = it->pos;
+    uint64_t run_end;
+
+    // skip gaps
+    while (pos < len) {
+        if (drop_masked && is_masked(sequence[pos])) {
+            pos++;
+        } else if (n_split && is_n(sequence[pos]) && n_run(sequence, len, pos, &run_end) >= n_split) {
+            pos = run_end;
+        } else {
+            break;
+        }
+    }
+
+    if (pos >= len) {
+        return 0;
+    }
+
+    *begin = pos;
+
+    while (pos < len && !(drop_masked && is_masked(sequence[pos]))) {
+        if (n_split && is_n(sequence[pos])) {
+            if (n_run(sequence, len, pos, &run_end) >= n_split) {
+                break;
+            }
+            // short runs stay in the segment up to a masked character
+            while (pos < run_end && !(drop_masked && is_masked(sequence[pos]))) {
+                pos++;
+            }
+        } else {
+            pos++;
+        }
+    }
+
+    *end = pos;
+    it->pos = pos;
+
+    return 1;
+}
+
+/**
+ * Finds the next segment of a packed sequence from its runs. Returns 0 if
+ * there is none.
+ */
+static int next_segment_packed(const struct packed_seq *sequence, struct segment_iter *it, uint64_t n_split, int drop_masked, uint64_t *begin, uint64_t *end) {
+
+    uint64_t pos = it->pos;
+
+    for (;;) {
+        // runs that end before the position or do not split are passed
+        while (it->ambiguous < sequence->ambiguous_count) {
+            const struct seq_run *run = sequence->ambiguous + it->ambiguous;
+            if (n_split && run->base == 'N' && run->len >= n_split && run->start + run->len > pos) {
+                break;
+            }
+            it->ambiguous++;
+        }
+        while (drop_masked && it->masked < sequence->masked_count && sequence->masked[it->masked].start + sequence->masked[it->masked].len <= pos) {
+            it->masked++;
+        }
+
+        int ambiguous = n_split && it->ambiguous < sequence->ambiguous_count;
+        int masked = drop_masked && it->masked < sequence->masked_count;
+
+        if (ambiguous && sequence->ambiguous[it->ambiguous].start <= pos) {
+            pos = sequence->ambiguous[it->ambiguous].start + sequence->ambiguous[it->ambiguous].len;
+        } else if (masked && sequence->masked[it->masked].start <= pos) {
+            pos = sequence->masked[it->masked].start + sequence->masked[it->masked].len;
+        } else {
+            break;
+        }
+    }
+
+    if (pos >= sequence->len) {
+        return 0;
+    }
+
+    *begin = pos;
+    *end = sequence->len;
+
+    if (n_split && it->ambiguous < sequence->ambiguous_count && sequence->ambiguous[it->ambiguous].start < *end) {
+        *end = sequence->ambiguous[it->ambiguous].start;
+    }
+    if (drop_masked && it->masked < sequence->masked_count && sequence->masked[it->masked].start < *end) {
+        *end = sequence->masked[it->masked].start;
+    }
+
+    it->pos = *end;
+
+    return 1;
+}
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// MARK: LCP
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+/**
+ * Runs LCP over the windows of a segment of a sequence that is either given
+ * as characters or packed. Windows of a packed sequence are restored into
+ * the buffer right before they are processed. Margins do not reach beyond
+ * the segment.
+ */
+static int lcp_segment(const char *sequence, const struct packed_seq *packed, uint64_t seg_begin, uint64_t seg_end, uint64_t window, char *buffer, int reverse_complement, struct gargs *genome_arguments, const struct core_sink *sink, FILE *out) {
+
+    int ok = 1;
+
+    for (uint64_t begin=seg_begin; ok && begin<seg_end; begin+=window) {
+        uint64_t end = seg_end - begin > window ? begin + window : seg_end;
+        uint64_t from = begin - seg_begin > LCP_WINDOW_MARGIN ? begin - LCP_WINDOW_MARGIN : seg_begin;
+        uint64_t to = seg_end - end > LCP_WINDOW_MARGIN ? end + LCP_WINDOW_MARGIN : seg_end;
+
+        const char *text = sequence + from;
+        if (packed != NULL) {
+            packed_unpack(packed, from, to, buffer);
+            text = buffer;
+        }
+
+        uint64_t start = stats_now();
+
+        struct lps str;
+        if (reverse_complement) {
+            init_lps2(&str, text, to - from);
+        } else {
+            init_lps(&str, text, to - from);
+        }
+
+        uint64_t initialized = stats_now();
+
+        lps_deepen(&str, genome_arguments->lcp_level);
+
+        genome_arguments->stats.ns[STAGE_INIT_LPS] += initialized - start;
+        genome_arguments->stats.ns[STAGE_DEEPEN] += stats_now() - initialized;
+
+        if (out != NULL) {
+            save(out, &str);
+        }
+
+        // positions of the reverse complement run from the end of the window
+        if (reverse_complement) {
+            ok = sink_cores(&str, to - end, to - begin, sink);
+        } else {
+            ok = sink_cores(&str, begin - from, end - from, sink);
+        }
+
+        free_lps(&str);
+    }
+
+    return ok;
+}
+
+/**
+ * Splits a sequence into segments and runs LCP over each of them.
+ */
+static int lcp_segments(const char *sequence, const struct packed_seq *packed, uint64_t len, int reverse_complement, struct gargs *genome_arguments, const struct core_sink *sink, FILE *out) {
+
+    uint64_t window = out == NULL && genome_arguments->lcp_window ? genome_arguments->lcp_window : len;
+    uint64_t n_split = genome_arguments->n_split;
+    int drop_masked = genome_arguments->drop_masked;
+    int ok = 1;
+
+    char *buffer = NULL;
+
+    struct segment_iter it = {0, 0, 0};
+    uint64_t begin, end;
+
+    if (packed != NULL) {
+        // windows never reach beyond a segment, so the longest one bounds the buffer
+        uint64_t longest = 0;
+        while (next_segment_packed(packed, &it, n_split, drop_masked, &begin, &end)) {
+            longest = end - begin > longest ? end - begin : longest;
+        }
+        it = (struct segment_iter){0, 0, 0};
+
+        uint64_t buffer_size = (window + 2 * LCP_WINDOW_MARGIN < longest ? window + 2 * LCP_WINDOW_MARGIN : longest) + 1;
+        struct scratch *scratch = scratch_get();
+        buffer = scratch != NULL ? scratch_window(scratch, buffer_size) : NULL;
+        if (buffer == NULL) {
+            log1(ERROR, "Memory allocation failed for sequence window of %s", genome_arguments->inFileName);
+            genome_arguments->failed = 1;
+            return 0;
+        }
+    }
+
+    while (ok && (packed != NULL ? next_segment_packed(packed, &it, n_split, drop_masked, &begin, &end) :
+                                   next_segment_chars(sequence, len, &it, n_split, drop_masked, &begin, &end))) {
+        ok = lcp_segment(sequence, packed, begin, end, window, buffer, reverse_complement, genome_arguments, sink, out);
+    }
+
+    return ok;
+}
+
+int lcp_stream(const char *sequence, uint64_t len, int reverse_complement, struct gargs *genome_arguments, const struct core_sink *sink, FILE *out) {
+    return lcp_segments(sequence, NULL, len, reverse_complement, genome_arguments, sink, out);
+}
+
+int lcp_stream_packed(const struct packed_seq *sequence, int reverse_complement, struct gargs *genome_arguments, const struct core_sink *sink, FILE *out) {
+    return lcp_segments(NULL, sequence, sequence->len, reverse_complement, genome_arguments, sink, out);
+}
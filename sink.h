@@ -0,0 +1,138 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include "args.h"
+#include "utils.h" // reserve_cores, save
+#include "lps.h"
+#include "packed.h"
+#include "scratch.h"
+#include <stdio.h>
+#include <stdint.h>
+
+#define SINK_BATCH 1024          // cores packed on the stack before they are passed to a sink
+#define LCP_WINDOW_MARGIN 16384  // bases of context on both sides of a window
+
+/**
+ * @brief Function receiving a batch of packed cores.
+ *
+ * @param arg Argument given with the sink.
+ * @param cores Packed cores, `label << 32 | length`.
+ * @param count Number of cores.
+ * @return 1 on success, 0 to stop the producer.
+ */
+typedef int (*core_sink_t)(void *arg, const simple_core *cores, size_t count);
+
+/**
+ * @brief A consumer of the cores of the last LCP level.
+ */
+struct core_sink {
+    core_sink_t func;
+    void *arg;
+};
+
+/**
+ * @brief Packs a core into its label and length.
+ */
+static inline simple_core pack_core(const struct core *core) {
+    return ((uint64_t)core->label << 32) + (core->end - core->start);
+}
+
+/**
+ * @brief Reduces a packed core to a 32-bit key of the given type.
+ *
+ * Hashed keys mix label and length with the finalizer of MurmurHash3, so 
+ * that cores differing only in their length map to unrelated keys.
+ */
+static inline uint32_t narrow_core(simple_core core, key_type key) {
+    if (key == KEY_LABEL) {
+        return (uint32_t)(core >> 32);
+    }
+    core ^= core >> 33;
+    core *= 0xff51afd7ed558ccdULL;
+    core ^= core >> 33;
+    core *= 0xc4ceb9fe1a85ec53ULL;
+    core ^= core >> 33;
+    return (uint32_t)(core >> 32);
+}
+
+/**
+ * @brief Passes the cores of an lps that start in the given range to a sink.
+ *
+ * Cores are packed into a small buffer on the stack and handed over in
+ * batches, in the order they appear in the lps.
+ *
+ * @param str Pointer to the deepened lps.
+ * @param own_begin First start position, relative to the sequence of the lps, 
+ *                  of the cores to be passed.
+ * @param own_end One past the last start position.
+ * @param sink Pointer to the sink.
+ * @return 1 on success, 0 if the sink stopped.
+ */
+int sink_cores(const struct lps *str, uint64_t own_begin, uint64_t own_end, const struct core_sink *sink);
+
+/**
+ * @brief Sink appending cores to the cores array of a genome.
+ *
+ * Cores are stored as keys of the type of the genome. For 32-bit keys, the 
+ * lengths of the cores are summed up before they are dropped.
+ *
+ * @param arg Pointer to the genome arguments (`gargs`).
+ * @param cores Packed cores.
+ * @param count Number of cores.
+ * @return 1 on success, 0 if the array could not be grown.
+ */
+int sink_to_genome(void *arg, const simple_core *cores, size_t count);
+
+/**
+ * @brief Runs LCP on a sequence and streams the cores of the last level into a sink.
+ *
+ * Sequences longer than the window of the genome (`lcp_window`) are processed 
+ * in windows with `LCP_WINDOW_MARGIN` bases of context on both sides. Each 
+ * window passes on only the cores starting in its own range, so every core 
+ * is produced once and the lps of the whole sequence is never held in 
+ * memory, only the one of the current window. Cores whose context reaches 
+ * beyond the margin (e.g., inside very long tandem repeats) may differ from 
+ * the ones of an unwindowed run. With a window of 0, or if the lps is saved 
+ * to a file, the sequence is processed at once.
+ *
+ * Before windowing, the sequence is split into segments at runs of at least 
+ * `n_split` Ns (of either case) and, if `drop_masked` is set, at soft-masked 
+ * (lowercase) regions, which are not processed at all. Windows and their 
+ * margins stay within a segment.
+ *
+ * Time spent in `init_lps` and `lps_deepen` is added to the stages of the genome.
+ *
+ * @param sequence Pointer to the sequence.
+ * @param len Length of the sequence.
+ * @param reverse_complement 1 to process the reverse complement (`init_lps2`), 0 otherwise.
+ * @param genome_arguments Pointer to the genome arguments holding the LCP level and the window.
+ * @param sink Pointer to the sink.
+ * @param out File the lps is saved to, NULL if it is not saved.
+ * @return 1 on success, 0 if the sink stopped.
+ */
+int lcp_stream(const char *sequence, uint64_t len, int reverse_complement, struct gargs *genome_arguments, const struct core_sink *sink, FILE *out);
+
+/**
+ * @brief Runs LCP on a packed sequence and streams the cores of the last level into a sink.
+ *
+ * Like `lcp_stream`, but each window (with its margins) is restored from the 
+ * 2-bit form right before it is processed, so the characters of at most one 
+ * window exist at a time. The buffer is bounded by the longest segment and
+ * kept in the scratch of the thread for the following sequences.
+ *
+ * Without a window, LCP needs the characters of a whole segment at once, so
+ * they are restored next to the packed copy (1.25 bytes per base). This is
+ * small against the lps that LCP builds over the same segment anyway; windows
+ * bound both, at the cost of cores that may differ at window boundaries, and
+ * are therefore not used by default.
+ *
+ * @param sequence Pointer to the packed sequence.
+ * @param reverse_complement 1 to process the reverse complement (`init_lps2`), 0 otherwise.
+ * @param genome_arguments Pointer to the genome arguments holding the LCP level and the window.
+ * @param sink Pointer to the sink.
+ * @param out File the lps is saved to, NULL if it is not saved.
+ * @return 1 on success, 0 if the sink stopped or the window could not be allocated.
+ */
+int lcp_stream_packed(const struct packed_seq *sequence, int reverse_complement, struct gargs *genome_arguments, const struct core_sink *sink, FILE *out);
+
+#endif
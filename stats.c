@@ -0,0 +1,150 @@
+#include "stats.h"
+#include "args.h"
+#include "utils.h" // logging
+
+struct rstats run_stats;
+
+const char *stats_stage_name(stats_stage stage) {
+    switch (stage) {
+        case STAGE_CACHE:
+            return "cache";
+        case STAGE_PARSE:
+            return "parse";
+        case STAGE_INIT_LPS:
+            return "init_lps";
+        case STAGE_DEEPEN:
+            return "lps_deepen";
+        case STAGE_SORT:
+            return "sort";
+        case STAGE_FILTER:
+            return "filter";
+        case STAGE_ENCODE:
+            return "encode";
+        case STAGE_DISTANCE:
+            return "distance";
+        case STAGE_WRITE:
+            return "write";
+        default:
+            return "unknown";
+    }
+}
+
+void write_json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (; str != NULL && *str; str++) {
+        unsigned char c = (unsigned char)*str;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void write_json_stages(FILE *out, const uint64_t ns[STAGE_COUNT]) {
+    fprintf(out, "{");
+    for (int s=0; s<STAGE_COUNT; s++) {
+        fprintf(out, "%s\"%s\": %.6f", s ? ", " : "", stats_stage_name((stats_stage)s), ns[s] / 1e9);
+    }
+    fprintf(out, "}");
+}
+
+static const char *stats_mode_name(program_mode mode) {
+    switch (mode) {
+    case FA:
+        return "fa";
+    case FQ:
+        return "fq";
+    case SKETCH:
+        return "sketch";
+    case DIST:
+        return "dist";
+    default:
+        return "ld";
+    }
+}
+
+int stats_write(const char *filename, const struct gargs *genome_arguments, const struct pargs *program_arguments) {
+
+    FILE *out = fopen(filename, "w");
+    if (out == NULL) {
+        log1(ERROR, "Could not open statistics file %s", filename);
+        return 0;
+    }
+
+    int n = program_arguments->number_of_genomes;
+    uint64_t stages[STAGE_COUNT] = {0};
+    uint64_t bytes = 0, bases = 0, reads = 0, cores = 0, signature_cores = 0;
+    int cache_hits = 0;
+
+    // per-genome stages are merged into the shared ones which were only charged by distance calculation
+    for (int s=0; s<STAGE_COUNT; s++) {
+        stages[s] = atomic_load(&(run_stats.ns[s]));
+    }
+
+    for (int i=0; i<n; i++) {
+        const struct gstats *gs = &(genome_arguments[i].stats);
+        for (int s=0; s<STAGE_COUNT; s++) {
+            stages[s] += gs->ns[s];
+        }
+        bytes += gs->bytes;
+        bases += gs->bases;
+        reads += gs->reads;
+        cores += gs->cores;
+        signature_cores += genome_arguments[i].cores_len;
+        cache_hits += gs->cache_hit;
+    }
+
+    double total_seconds = (stats_now() - run_stats.start_ns) / 1e9;
+    double signatures_seconds = run_stats.signatures_ns / 1e9;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"mode\": \"%s\",\n", stats_mode_name(program_arguments->mode));
+    fprintf(out, "  \"threads\": %d,\n", program_arguments->thread_number);
+    fprintf(out, "  \"genomes\": %d,\n", n);
+    fprintf(out, "  \"lcp_level\": %d,\n", n ? genome_arguments[0].lcp_level : 0);
+    fprintf(out, "  \"wall_seconds\": {\"total\": %.6f, \"signatures\": %.6f, \"distances\": %.6f},\n", 
+        total_seconds, signatures_seconds, run_stats.distances_ns / 1e9);
+    fprintf(out, "  \"stage_seconds\": ");
+    write_json_stages(out, stages);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"totals\": {\"bytes\": %lu, \"bases\": %lu, \"reads\": %lu, \"cores\": %lu, \"signature_cores\": %lu, \"cache_hits\": %d, \"pairs\": %lu},\n", 
+        bytes, bases, reads, cores, signature_cores, cache_hits, atomic_load(&(run_stats.pairs)));
+    fprintf(out, "  \"throughput\": {\"bytes_per_second\": %.2f, \"bases_per_second\": %.2f},\n", 
+        signatures_seconds > 0 ? bytes / signatures_seconds : 0.0, signatures_seconds > 0 ? bases / signatures_seconds : 0.0);
+
+    fprintf(out, "  \"memory\": {\"tracked_peak_bytes\": %lu, \"rss_peak_bytes\": %lu, \"rss_timeline\": [", 
+        atomic_load(&(mem_stats.peak)), mem_stats.rss_peak);
+    for (size_t i=0; i<mem_stats.sample_cnt; i++) {
+        fprintf(out, "%s[%.3f, %lu]", i ? ", " : "", mem_stats.samples[i].seconds, mem_stats.samples[i].bytes);
+    }
+    fprintf(out, "]},\n");
+
+    fprintf(out, "  \"per_genome\": [");
+    for (int i=0; i<n; i++) {
+        const struct gargs *g = genome_arguments + i;
+        fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+        write_json_string(out, g->shortName);
+        fprintf(out, ", \"file\": ");
+        write_json_string(out, g->inFileName);
+        fprintf(out, ", \"seconds\": %.6f, \"bytes\": %lu, \"bases\": %lu, \"reads\": %lu, \"cores\": %lu, \"signature_cores\": %lu, \"cache_hit\": %s, \"stage_seconds\": ", 
+            g->work_seconds, g->stats.bytes, g->stats.bases, g->stats.reads, g->stats.cores, g->cores_len, g->stats.cache_hit ? "true" : "false");
+        write_json_stages(out, g->stats.ns);
+        fprintf(out, ", \"memory\": {\"peak_bytes\": %lu, \"stage_peak_bytes\": {", g->mem.peak);
+        for (int s=0; s<STAGE_COUNT; s++) {
+            fprintf(out, "%s\"%s\": %lu", s ? ", " : "", stats_stage_name((stats_stage)s), g->mem.stage_peak[s]);
+        }
+        fprintf(out, "}}}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (fclose(out) != 0) {
+        log1(ERROR, "Could not write statistics file %s", filename);
+        return 0;
+    }
+
+    return 1;
+}
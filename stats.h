@@ -0,0 +1,97 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/**
+ * @brief Processing stages that are timed separately.
+ */
+typedef enum {
+    STAGE_CACHE,     // hashing inputs and loading cached signatures
+    STAGE_PARSE,     // reading and parsing input files
+    STAGE_INIT_LPS,  // init_lps on sequences
+    STAGE_DEEPEN,    // lps_deepen up to the LCP level
+    STAGE_SORT,      // sorting cores in genSign
+    STAGE_FILTER,    // filtering and deduplicating cores in genSign
+    STAGE_ENCODE,    // encoding signatures with the core dictionary or compressing them
+    STAGE_DISTANCE,  // calcUISize and distance formulas
+    STAGE_WRITE,     // writing distance matrices
+    STAGE_COUNT
+} stats_stage;
+
+/**
+ * @brief Counters and stage timers of a single genome.
+ *
+ * A genome is processed by a single thread, so its counters are updated 
+ * without synchronization.
+ */
+struct gstats {
+    uint64_t ns[STAGE_COUNT];
+    uint64_t bytes;      // input bytes consumed
+    uint64_t bases;      // sequence length processed
+    uint64_t reads;      // sequences (chromosomes or reads) processed
+    uint64_t cores;      // cores extracted before genSign
+    int cache_hit;       // 1 if the signature was loaded from the cache
+};
+
+/**
+ * @brief Counters and stage timers of the run, shared by all threads.
+ */
+struct rstats {
+    _Atomic uint64_t ns[STAGE_COUNT];
+    _Atomic uint64_t pairs;
+    uint64_t start_ns;
+    uint64_t signatures_ns; // wall time of signature generation
+    uint64_t distances_ns;  // wall time of distance calculation
+};
+
+extern struct rstats run_stats;
+
+/**
+ * @brief Returns the current time of the monotonic clock in nanoseconds.
+ */
+static inline uint64_t stats_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Adds a duration to a stage of the run.
+ *
+ * `ns` is an elapsed time such as `stats_now() - start`, not a timestamp.
+ * Threads should accumulate locally and call this once per batch of work to 
+ * keep contention on the shared counters low.
+ *
+ * @param stage The stage to be charged.
+ * @param ns Duration in nanoseconds to be added.
+ */
+static inline void stats_add(stats_stage stage, uint64_t ns) {
+    atomic_fetch_add_explicit(&(run_stats.ns[stage]), ns, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the name of a stage as it appears in the statistics output.
+ */
+const char *stats_stage_name(stats_stage stage);
+
+struct gargs;
+struct pargs;
+
+/**
+ * @brief Writes the statistics of the run and of every genome as JSON.
+ *
+ * Stage times of the run are summed over all threads (i.e., thread-seconds), 
+ * while `wall_seconds` holds the elapsed time of the program phases.
+ *
+ * @param filename The name of the output file.
+ * @param genome_arguments Pointer to the array of genome arguments (`gargs`).
+ * @param program_arguments Pointer to the program arguments (`pargs`).
+ * @return 1 on success, 0 otherwise.
+ */
+int stats_write(const char *filename, const struct gargs *genome_arguments, const struct pargs *program_arguments);
+
+#endif
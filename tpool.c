@@ -1,19 +1,92 @@
+#define _GNU_SOURCE // CPU affinity
 #include "tpool.h"
+#include <stdio.h>
+#include <dirent.h>
 
 /**
- * Creates a new work task for the thread pool.
+ * The worker currently running on this thread, NULL for threads outside any pool.
+ */
+static _Thread_local struct tpool_worker *tpool_self = NULL;
+
+// ---------------------------------------------------------------------------------
+// MARK: Task nodes
+// ---------------------------------------------------------------------------------
+
+/**
+ * Allocates a new slab of task nodes and links them into the shared free list.
+ * Must be called with `work_mutex` held.
+ * 
+ * @param tm Pointer to the thread pool.
+ * @return 1 on success, 0 on failure.
+ */
+int tpool_slab_create(struct tpool *tm) {
+    struct tpool_slab *slab;
+    size_t i;
+
+    slab = malloc(sizeof(struct tpool_slab));
+    if (slab == NULL)
+        return 0;
+
+    for (i=0; i<TPOOL_SLAB_SIZE-1; i++)
+        slab->works[i].next = &(slab->works[i+1]);
+    slab->works[TPOOL_SLAB_SIZE-1].next = tm->free_list;
+    tm->free_list = slab->works;
+
+    slab->next = tm->slabs;
+    tm->slabs = slab;
+    return 1;
+}
+
+/**
+ * Takes a task node from the shared free list. Must be called with `work_mutex` held.
  * 
+ * @param tm Pointer to the thread pool.
+ * @return Pointer to a task node or NULL on failure.
+ */
+struct tpool_work *tpool_work_get_shared(struct tpool *tm) {
+    struct tpool_work *work;
+
+    if (tm->free_list == NULL && !tpool_slab_create(tm))
+        return NULL;
+
+    work = tm->free_list;
+    tm->free_list = work->next;
+    return work;
+}
+
+/**
+ * Creates a new work task on a worker of the pool. Workers take nodes from their 
+ * own free list and refill it from the shared one in batches.
+ * 
+ * @param self Pointer to the worker creating the task.
  * @param func Function pointer representing the work to execute.
  * @param arg Argument to be passed to the function.
  * @return Pointer to the newly created tpool_work structure or NULL on failure.
  */
-struct tpool_work *tpool_work_create(thread_func_t func, void *arg) {
+struct tpool_work *tpool_work_create(struct tpool_worker *self, thread_func_t func, void *arg) {
+    struct tpool *tm = self->tm;
     struct tpool_work *work;
+    size_t i;
 
-    if (func == NULL)
-        return NULL;
+    if (self->free_list == NULL) {
+        pthread_mutex_lock(&(tm->work_mutex));
+        for (i=0; i<TPOOL_SLAB_SIZE; i++) {
+            work = tpool_work_get_shared(tm);
+            if (work == NULL)
+                break;
+            work->next = self->free_list;
+            self->free_list = work;
+            self->free_cnt++;
+        }
+        pthread_mutex_unlock(&(tm->work_mutex));
+        if (self->free_list == NULL)
+            return NULL;
+    }
+
+    work = self->free_list;
+    self->free_list = work->next;
+    self->free_cnt--;
 
-    work = malloc(sizeof(struct tpool_work));
     work->func = func;
     work->arg = arg;
     work->next = NULL;
@@ -21,18 +94,245 @@ struct tpool_work *tpool_work_create(thread_func_t func, void *arg) {
 }
 
 /**
- * Frees the memory allocated for a tpool_work structure.
+ * Returns a task node to the free list of the worker that executed it. Half of the 
+ * nodes are handed back to the shared free list once the worker holds too many.
  * 
+ * @param self Pointer to the worker that executed the task.
  * @param work Pointer to the tpool_work structure to destroy.
  */
-void tpool_work_destroy(struct tpool_work *work) {
-    if (work == NULL)
+void tpool_work_destroy(struct tpool_worker *self, struct tpool_work *work) {
+    struct tpool *tm = self->tm;
+    struct tpool_work *first, *last;
+    size_t i;
+
+    work->next = self->free_list;
+    self->free_list = work;
+    self->free_cnt++;
+
+    if (self->free_cnt < TPOOL_FREE_MAX)
         return;
-    free(work);
+
+    first = self->free_list;
+    last = first;
+    for (i=1; i<TPOOL_FREE_MAX/2; i++)
+        last = last->next;
+    self->free_list = last->next;
+    self->free_cnt -= TPOOL_FREE_MAX/2;
+
+    pthread_mutex_lock(&(tm->work_mutex));
+    last->next = tm->free_list;
+    tm->free_list = first;
+    pthread_mutex_unlock(&(tm->work_mutex));
+}
+
+// ---------------------------------------------------------------------------------
+// MARK: Work-stealing deque
+// ---------------------------------------------------------------------------------
+
+struct tpool_array *tpool_array_create(int64_t size) {
+    struct tpool_array *a;
+
+    a = malloc(sizeof(struct tpool_array) + size * sizeof(_Atomic(struct tpool_work *)));
+    if (a == NULL)
+        return NULL;
+
+    a->size = size;
+    a->prev = NULL;
+    return a;
+}
+
+int tpool_deque_init(struct tpool_deque *q) {
+    struct tpool_array *a = tpool_array_create(TPOOL_DEQUE_INITIAL_SIZE);
+
+    if (a == NULL)
+        return 0;
+
+    atomic_init(&(q->top), 0);
+    atomic_init(&(q->bottom), 0);
+    atomic_init(&(q->array), a);
+    return 1;
+}
+
+void tpool_deque_destroy(struct tpool_deque *q) {
+    struct tpool_array *a = atomic_load_explicit(&(q->array), memory_order_relaxed);
+    struct tpool_array *prev;
+
+    while (a != NULL) {
+        prev = a->prev;
+        free(a);
+        a = prev;
+    }
+}
+
+/**
+ * Pushes a task to the bottom of the deque, growing it if needed. Only the owner 
+ * may call this function.
+ * 
+ * @return 1 on success, 0 on failure.
+ */
+int tpool_deque_push(struct tpool_deque *q, struct tpool_work *work) {
+    int64_t b = atomic_load_explicit(&(q->bottom), memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&(q->top), memory_order_acquire);
+    struct tpool_array *a = atomic_load_explicit(&(q->array), memory_order_relaxed);
+    int64_t i;
+
+    if (b - t > a->size - 1) {
+        struct tpool_array *na = tpool_array_create(a->size * 2);
+        if (na == NULL)
+            return 0;
+        for (i=t; i<b; i++) {
+            atomic_store_explicit(&(na->buffer[i & (na->size-1)]), 
+                atomic_load_explicit(&(a->buffer[i & (a->size-1)]), memory_order_relaxed), memory_order_relaxed);
+        }
+        // thieves may still be reading from the old array, so it is retired, not freed
+        na->prev = a;
+        atomic_store_explicit(&(q->array), na, memory_order_release);
+        a = na;
+    }
+
+    atomic_store_explicit(&(a->buffer[b & (a->size-1)]), work, memory_order_relaxed);
+    atomic_store_explicit(&(q->bottom), b+1, memory_order_release);
+    return 1;
 }
 
 /**
- * Retrieves the next available work task from the thread pool queue.
+ * Takes a task from the bottom of the deque. Only the owner may call this function.
+ * 
+ * @return Pointer to the task or NULL if the deque is empty.
+ */
+struct tpool_work *tpool_deque_take(struct tpool_deque *q) {
+    int64_t b = atomic_load_explicit(&(q->bottom), memory_order_relaxed) - 1;
+    struct tpool_array *a = atomic_load_explicit(&(q->array), memory_order_relaxed);
+    struct tpool_work *work = NULL;
+    int64_t t;
+
+    atomic_store_explicit(&(q->bottom), b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    t = atomic_load_explicit(&(q->top), memory_order_relaxed);
+
+    if (t <= b) {
+        work = atomic_load_explicit(&(a->buffer[b & (a->size-1)]), memory_order_relaxed);
+        if (t == b) {
+            // last element, race against thieves
+            if (!atomic_compare_exchange_strong_explicit(&(q->top), &t, t+1, memory_order_seq_cst, memory_order_relaxed))
+                work = NULL;
+            atomic_store_explicit(&(q->bottom), b+1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&(q->bottom), b+1, memory_order_relaxed);
+    }
+
+    return work;
+}
+
+/**
+ * Steals a task from the top of the deque. Any thread may call this function.
+ * 
+ * @return Pointer to the task or NULL if the deque is empty or the steal lost a race.
+ */
+struct tpool_work *tpool_deque_steal(struct tpool_deque *q) {
+    int64_t t = atomic_load_explicit(&(q->top), memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&(q->bottom), memory_order_acquire);
+    struct tpool_work *work = NULL;
+
+    if (t < b) {
+        struct tpool_array *a = atomic_load_explicit(&(q->array), memory_order_acquire);
+        work = atomic_load_explicit(&(a->buffer[t & (a->size-1)]), memory_order_relaxed);
+        if (!atomic_compare_exchange_strong_explicit(&(q->top), &t, t+1, memory_order_seq_cst, memory_order_relaxed))
+            return NULL;
+    }
+
+    return work;
+}
+
+int tpool_deque_empty(struct tpool_deque *q) {
+    int64_t t = atomic_load_explicit(&(q->top), memory_order_acquire);
+    int64_t b = atomic_load_explicit(&(q->bottom), memory_order_acquire);
+    return b <= t;
+}
+
+// ---------------------------------------------------------------------------------
+// MARK: Injection queue
+// ---------------------------------------------------------------------------------
+
+/**
+ * Checks whether task `a` should be started before task `b`: higher priority first, 
+ * then in the order they were added.
+ */
+static inline int tpool_work_before(const struct tpool_work *a, const struct tpool_work *b) {
+    return a->priority > b->priority || (a->priority == b->priority && a->seq < b->seq);
+}
+
+/**
+ * Inserts a task into the injection queue. Must be called with `work_mutex` held.
+ * 
+ * @param tm Pointer to the thread pool.
+ * @param work Pointer to the task.
+ * @return 1 on success, 0 on failure.
+ */
+int tpool_heap_push(struct tpool *tm, struct tpool_work *work) {
+    size_t i, parent;
+
+    if (tm->heap_len == tm->heap_cap) {
+        size_t cap = tm->heap_cap ? tm->heap_cap * 2 : TPOOL_DEQUE_INITIAL_SIZE;
+        struct tpool_work **heap = realloc(tm->heap, cap * sizeof(struct tpool_work *));
+        if (heap == NULL)
+            return 0;
+        tm->heap = heap;
+        tm->heap_cap = cap;
+    }
+
+    work->seq = tm->seq++;
+
+    i = tm->heap_len++;
+    while (i > 0) {
+        parent = (i-1) / 2;
+        if (!tpool_work_before(work, tm->heap[parent]))
+            break;
+        tm->heap[i] = tm->heap[parent];
+        i = parent;
+    }
+    tm->heap[i] = work;
+
+    atomic_fetch_add_explicit(&(tm->inject_cnt), 1, memory_order_relaxed);
+    return 1;
+}
+
+/**
+ * Removes the first task from the injection queue. Must be called with `work_mutex` held.
+ * 
+ * @param tm Pointer to the thread pool.
+ * @return Pointer to the task or NULL if the queue is empty.
+ */
+struct tpool_work *tpool_heap_pop(struct tpool *tm) {
+    struct tpool_work *work, *last;
+    size_t i, child;
+
+    if (tm->heap_len == 0)
+        return NULL;
+
+    work = tm->heap[0];
+    last = tm->heap[--tm->heap_len];
+
+    i = 0;
+    while ((child = 2*i + 1) < tm->heap_len) {
+        if (child+1 < tm->heap_len && tpool_work_before(tm->heap[child+1], tm->heap[child]))
+            child++;
+        if (!tpool_work_before(tm->heap[child], last))
+            break;
+        tm->heap[i] = tm->heap[child];
+        i = child;
+    }
+    if (tm->heap_len)
+        tm->heap[i] = last;
+
+    atomic_fetch_sub_explicit(&(tm->inject_cnt), 1, memory_order_relaxed);
+    return work;
+}
+
+/**
+ * Retrieves the next available work task from the injection queue.
  * 
  * @param tm Pointer to the thread pool.
  * @return Pointer to the next tpool_work structure or NULL if the queue is empty.
@@ -40,138 +340,522 @@ void tpool_work_destroy(struct tpool_work *work) {
 struct tpool_work *tpool_work_get(struct tpool *tm) {
     struct tpool_work *work;
 
-    if (tm == NULL)
+    if (atomic_load_explicit(&(tm->inject_cnt), memory_order_relaxed) == 0)
         return NULL;
 
-    work = tm->work_first;
-    if (work == NULL)
-        return NULL;
+    pthread_mutex_lock(&(tm->work_mutex));
+    work = tpool_heap_pop(tm);
+    pthread_mutex_unlock(&(tm->work_mutex));
 
-    if (work->next == NULL) {
-        tm->work_first = NULL;
-        tm->work_last = NULL;
-    } else {
-        tm->work_first = work->next;
+    return work;
+}
+
+// ---------------------------------------------------------------------------------
+// MARK: Workers
+// ---------------------------------------------------------------------------------
+
+/**
+ * Wakes up one sleeping worker if there is any. Called after new work is published.
+ * 
+ * @param tm Pointer to the thread pool.
+ */
+void tpool_notify(struct tpool *tm) {
+    // pairs with the fence in tpool_sleep so that either the sleeper sees 
+    // the new work or the notifier sees the sleeper
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&(tm->idle_cnt), memory_order_relaxed) == 0)
+        return;
+
+    pthread_mutex_lock(&(tm->work_mutex));
+    pthread_cond_signal(&(tm->work_cond));
+    pthread_mutex_unlock(&(tm->work_mutex));
+}
+
+/**
+ * Tries to steal a task from the other workers, starting from a random victim.
+ * Pinned workers try the workers of their own NUMA node first, so that the
+ * parts of a task stay close to the data its worker touched.
+ * 
+ * @param self Pointer to the worker.
+ * @return Pointer to a task or NULL if no work was found.
+ */
+struct tpool_work *tpool_steal(struct tpool_worker *self) {
+    struct tpool *tm = self->tm;
+    struct tpool_work *work;
+    size_t i, start;
+    int local;
+
+    // xorshift64
+    self->seed ^= self->seed << 13;
+    self->seed ^= self->seed >> 7;
+    self->seed ^= self->seed << 17;
+    start = self->seed % tm->thread_cnt;
+
+    for (local=(tm->node_cnt > 1 && self->node >= 0); local>=0; local--) {
+        for (i=0; i<tm->thread_cnt; i++) {
+            struct tpool_worker *victim = &(tm->workers[(start+i) % tm->thread_cnt]);
+            if (victim == self || (local && victim->node != self->node))
+                continue;
+            work = tpool_deque_steal(&(victim->deque));
+            if (work != NULL)
+                return work;
+        }
     }
 
-    return work;
+    return NULL;
 }
 
 /**
- * Worker thread function to process tasks from the thread pool.
+ * Finds a task for the worker: its own deque first, then the injection queue, 
+ * then the deques of the other workers.
  * 
- * @param arg Pointer to the thread pool structure.
+ * @param self Pointer to the worker.
+ * @return Pointer to a task or NULL if no work was found.
  */
-void* tpool_worker(void *arg) {
-    struct tpool *tm = arg;
+struct tpool_work *tpool_find_work(struct tpool_worker *self) {
     struct tpool_work *work;
+    size_t r;
 
-    while (1) {
-        pthread_mutex_lock(&(tm->work_mutex));
+    work = tpool_deque_take(&(self->deque));
+    if (work != NULL)
+        return work;
 
-        while (tm->work_first == NULL && !tm->stop)
-            pthread_cond_wait(&(tm->work_cond), &(tm->work_mutex));
+    for (r=0; r<TPOOL_STEAL_ROUNDS; r++) {
+        work = tpool_work_get(self->tm);
+        if (work != NULL)
+            return work;
 
-        if (tm->stop)
-            break;
+        work = tpool_steal(self);
+        if (work != NULL)
+            return work;
+    }
 
-        work = tpool_work_get(tm);
-        tm->working_cnt++;
-        pthread_mutex_unlock(&(tm->work_mutex));
+    return NULL;
+}
 
-        if (work != NULL) {
-            work->func(work->arg);
-            tpool_work_destroy(work);
-        }
+/**
+ * Checks whether the deque of any worker holds a task that could be stolen.
+ */
+int tpool_has_stealable(struct tpool *tm) {
+    size_t i;
+
+    for (i=0; i<tm->thread_cnt; i++) {
+        if (!tpool_deque_empty(&(tm->workers[i].deque)))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Checks whether there is any work that a worker could pick up.
+ */
+int tpool_has_work(struct tpool *tm) {
+    if (atomic_load_explicit(&(tm->inject_cnt), memory_order_relaxed) != 0)
+        return 1;
+    return tpool_has_stealable(tm);
+}
+
+/**
+ * Puts the worker to sleep until new work is published or the pool is stopped.
+ * 
+ * @param tm Pointer to the thread pool.
+ */
+void tpool_sleep(struct tpool *tm) {
+    pthread_mutex_lock(&(tm->work_mutex));
+    atomic_fetch_add_explicit(&(tm->idle_cnt), 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
 
+    if (!atomic_load_explicit(&(tm->stop), memory_order_relaxed) && !tpool_has_work(tm))
+        pthread_cond_wait(&(tm->work_cond), &(tm->work_mutex));
+
+    atomic_fetch_sub_explicit(&(tm->idle_cnt), 1, memory_order_relaxed);
+    pthread_mutex_unlock(&(tm->work_mutex));
+}
+
+/**
+ * Runs a task and signals `tpool_wait` if it was the last pending one.
+ * 
+ * @param self Pointer to the worker running the task.
+ * @param work Pointer to the task.
+ */
+void tpool_run(struct tpool_worker *self, struct tpool_work *work) {
+    struct tpool *tm = self->tm;
+    struct tpool_group *group = work->group;
+    int done = 0;
+
+    work->func(work->arg);
+    tpool_work_destroy(self, work);
+
+    // the group may be gone as soon as its counter reaches zero, so it is not touched after
+    if (group != NULL && atomic_fetch_sub_explicit(&(group->pending_cnt), 1, memory_order_acq_rel) == 1)
+        done = 1;
+
+    if (atomic_fetch_sub_explicit(&(tm->pending_cnt), 1, memory_order_acq_rel) == 1)
+        done = 1;
+
+    if (done) {
         pthread_mutex_lock(&(tm->work_mutex));
-        tm->working_cnt--;
-        if (!tm->stop && tm->working_cnt == 0 && tm->work_first == NULL)
-            pthread_cond_signal(&(tm->working_cond));
+        pthread_cond_broadcast(&(tm->working_cond));
         pthread_mutex_unlock(&(tm->work_mutex));
     }
+}
+
+/**
+ * Worker thread function to process tasks from the thread pool.
+ * 
+ * @param arg Pointer to the worker structure.
+ */
+void* tpool_worker(void *arg) {
+    struct tpool_worker *self = arg;
+    struct tpool *tm = self->tm;
+    struct tpool_work *work;
+
+    tpool_self = self;
+
+    // memory first touched by a pinned worker is allocated on its node
+    if (self->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(self->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    while (!atomic_load_explicit(&(tm->stop), memory_order_relaxed)) {
+        work = tpool_find_work(self);
+        if (work != NULL)
+            tpool_run(self, work);
+        else
+            tpool_sleep(tm);
+    }
 
-    tm->thread_cnt--;
-    pthread_cond_signal(&(tm->working_cond));
+    pthread_mutex_lock(&(tm->work_mutex));
+    tm->alive_cnt--;
+    pthread_cond_broadcast(&(tm->working_cond));
     pthread_mutex_unlock(&(tm->work_mutex));
 
+    tpool_self = NULL;
     return NULL;
 }
 
+// ---------------------------------------------------------------------------------
+// MARK: Topology
+// ---------------------------------------------------------------------------------
+
+struct tpool_cpu {
+    int cpu;
+    int node;
+};
+
+/**
+ * Reads a sysfs cpu list such as "0-15,32-47" and records the cpus that are in the 
+ * allowed set.
+ */
+void tpool_read_cpulist(const char *filename, int node, cpu_set_t *allowed, struct tpool_cpu *cpus, size_t *cpu_cnt) {
+    FILE *in = fopen(filename, "r");
+    int first, last, c;
+
+    if (in == NULL)
+        return;
+
+    while (fscanf(in, "%d", &first) == 1) {
+        last = first;
+        if ((c = fgetc(in)) == '-') {
+            if (fscanf(in, "%d", &last) != 1)
+                break;
+            c = fgetc(in);
+        }
+        for (; first<=last && first<CPU_SETSIZE; first++) {
+            if (CPU_ISSET(first, allowed)) {
+                cpus[*cpu_cnt].cpu = first;
+                cpus[*cpu_cnt].node = node;
+                (*cpu_cnt)++;
+                CPU_CLR(first, allowed); // a cpu belongs to a single node
+            }
+        }
+        if (c != ',')
+            break;
+    }
+
+    fclose(in);
+}
+
+/**
+ * Assigns a cpu and a NUMA node to every worker. Workers are spread over the nodes 
+ * round-robin, and over the cpus of each node in order. If the NUMA topology is not 
+ * available, all cpus are assumed to be on node 0.
+ * 
+ * @param tm Pointer to the thread pool.
+ */
+void tpool_place_workers(struct tpool *tm) {
+    struct tpool_cpu cpus[CPU_SETSIZE];
+    size_t node_first[CPU_SETSIZE+1];
+    size_t node_used[CPU_SETSIZE];
+    size_t cpu_cnt = 0, node_cnt = 0;
+    char filename[256];
+    cpu_set_t allowed;
+    struct dirent *entry;
+    DIR *dir;
+    size_t i, n;
+    int node;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+
+    // node directories are not necessarily numbered contiguously
+    dir = opendir("/sys/devices/system/node");
+    if (dir != NULL) {
+        int nodes[CPU_SETSIZE];
+        size_t cnt = 0;
+
+        while ((entry = readdir(dir)) != NULL && cnt < CPU_SETSIZE) {
+            if (sscanf(entry->d_name, "node%d", &node) == 1)
+                nodes[cnt++] = node;
+        }
+        closedir(dir);
+
+        // keep cpus grouped by node in increasing node order
+        for (i=1; i<cnt; i++) {
+            for (n=i; n>0 && nodes[n-1]>nodes[n]; n--) {
+                node = nodes[n];
+                nodes[n] = nodes[n-1];
+                nodes[n-1] = node;
+            }
+        }
+
+        for (i=0; i<cnt; i++) {
+            size_t before = cpu_cnt;
+            snprintf(filename, sizeof(filename), "/sys/devices/system/node/node%d/cpulist", nodes[i]);
+            tpool_read_cpulist(filename, (int)node_cnt, &allowed, cpus, &cpu_cnt);
+            if (cpu_cnt > before)
+                node_first[node_cnt++] = before;
+        }
+    }
+
+    // allowed cpus without a known node
+    if (node_cnt == 0 || CPU_COUNT(&allowed) != 0) {
+        node_first[node_cnt] = cpu_cnt;
+        for (i=0; i<CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &allowed)) {
+                cpus[cpu_cnt].cpu = (int)i;
+                cpus[cpu_cnt].node = (int)node_cnt;
+                cpu_cnt++;
+            }
+        }
+        if (cpu_cnt > node_first[node_cnt])
+            node_cnt++;
+    }
+
+    if (cpu_cnt == 0)
+        return;
+
+    node_first[node_cnt] = cpu_cnt;
+    memset(node_used, 0, sizeof(size_t) * node_cnt);
+
+    for (i=0; i<tm->thread_cnt; i++) {
+        size_t k = i % node_cnt;
+        size_t size = node_first[k+1] - node_first[k];
+        struct tpool_cpu *cpu = &(cpus[node_first[k] + node_used[k]++ % size]);
+        tm->workers[i].cpu = cpu->cpu;
+        tm->workers[i].node = cpu->node;
+    }
+
+    tm->node_cnt = node_cnt;
+}
+
+int tpool_current_node() {
+    struct tpool_worker *self = tpool_self;
+    return self != NULL ? self->node : -1;
+}
+
+// ---------------------------------------------------------------------------------
+// MARK: Creation
+// ---------------------------------------------------------------------------------
+
 struct tpool *tpool_create(size_t num) {
+    return tpool_create_ex(num, 0);
+}
+
+/**
+ * Stops and joins the first `started` workers, then frees the pool.
+ *
+ * @param tm Pointer to the thread pool.
+ * @param started Number of workers whose threads were created.
+ */
+static void tpool_shutdown(struct tpool *tm, size_t started) {
+    struct tpool_slab *slab;
+    struct tpool_slab *slab2;
+    size_t i;
+
+    pthread_mutex_lock(&(tm->work_mutex));
+    atomic_store(&(tm->stop), 1);
+    pthread_cond_broadcast(&(tm->work_cond));
+    while (tm->alive_cnt != 0)
+        pthread_cond_wait(&(tm->working_cond), &(tm->work_mutex));
+    pthread_mutex_unlock(&(tm->work_mutex));
+
+    for (i=0; i<started; i++)
+        pthread_join(tm->workers[i].thread, NULL);
+
+    for (i=0; i<tm->thread_cnt; i++)
+        tpool_deque_destroy(&(tm->workers[i].deque));
+
+    // every task node lives in a slab, whether it is queued or free
+    slab = tm->slabs;
+    while (slab != NULL) {
+        slab2 = slab->next;
+        free(slab);
+        slab = slab2;
+    }
+
+    pthread_mutex_destroy(&(tm->work_mutex));
+    pthread_cond_destroy(&(tm->work_cond));
+    pthread_cond_destroy(&(tm->working_cond));
+
+    free(tm->heap);
+    free(tm->workers);
+    free(tm);
+}
+
+struct tpool *tpool_create_ex(size_t num, int flags) {
     struct tpool *tm;
-    pthread_t thread;
     size_t i;
 
     if (num == 0)
         num = 2;
 
     tm = calloc(1, sizeof(*tm));
+    if (tm == NULL)
+        return NULL;
+
+    tm->workers = aligned_alloc(64, num * sizeof(struct tpool_worker));
+    if (tm->workers == NULL) {
+        free(tm);
+        return NULL;
+    }
+    memset(tm->workers, 0, num * sizeof(struct tpool_worker));
+
     tm->thread_cnt = num;
 
     pthread_mutex_init(&(tm->work_mutex), NULL);
     pthread_cond_init(&(tm->work_cond), NULL);
     pthread_cond_init(&(tm->working_cond), NULL);
 
-    tm->work_first = NULL;
-    tm->work_last = NULL;
+    tm->heap = NULL;
+    tm->heap_len = 0;
+    tm->heap_cap = 0;
+    tm->seq = 0;
+    atomic_init(&(tm->inject_cnt), 0);
+    atomic_init(&(tm->pending_cnt), 0);
+    atomic_init(&(tm->idle_cnt), 0);
+    atomic_init(&(tm->stop), 0);
 
     for (i=0; i<num; i++) {
-        pthread_create(&thread, NULL, tpool_worker, tm);
-        pthread_detach(thread);
+        tm->workers[i].tm = tm;
+        tm->workers[i].id = i;
+        tm->workers[i].seed = 0x9E3779B97F4A7C15ULL * (i+1);
+        tm->workers[i].cpu = -1;
+        tm->workers[i].node = -1;
+        if (!tpool_deque_init(&(tm->workers[i].deque))) {
+            while (i--)
+                tpool_deque_destroy(&(tm->workers[i].deque));
+            free(tm->workers);
+            free(tm);
+            return NULL;
+        }
+    }
+
+    tm->node_cnt = 1;
+    if (flags & TPOOL_PIN)
+        tpool_place_workers(tm);
+
+    // a pool with fewer workers than requested is not created, the started ones are joined
+    for (i=0; i<num; i++) {
+        pthread_mutex_lock(&(tm->work_mutex));
+        if (pthread_create(&(tm->workers[i].thread), NULL, tpool_worker, &(tm->workers[i])) != 0) {
+            pthread_mutex_unlock(&(tm->work_mutex));
+            tpool_shutdown(tm, i);
+            return NULL;
+        }
+        tm->alive_cnt++;
+        pthread_mutex_unlock(&(tm->work_mutex));
     }
 
     return tm;
 }
 
 void tpool_destroy(struct tpool *tm) {
-    struct tpool_work *work;
-    struct tpool_work *work2;
-
     if (tm == NULL)
         return;
 
-    pthread_mutex_lock(&(tm->work_mutex));
-    work = tm->work_first;
-    while (work != NULL) {
-        work2 = work->next;
-        tpool_work_destroy(work);
-        work = work2;
-    }
-    tm->work_first = NULL;
-    tm->stop = 1;
-    pthread_cond_broadcast(&(tm->work_cond));
-    pthread_mutex_unlock(&(tm->work_mutex));
-
-    tpool_wait(tm);
-
-    pthread_mutex_destroy(&(tm->work_mutex));
-    pthread_cond_destroy(&(tm->work_cond));
-    pthread_cond_destroy(&(tm->working_cond));
-
-    free(tm);
+    tpool_shutdown(tm, tm->thread_cnt);
 }
 
-int tpool_add_work(struct tpool *tm, thread_func_t func, void *arg) {
+/**
+ * Adds a new work task to the thread pool, optionally as a member of a group.
+ * 
+ * @param tm Pointer to the thread pool.
+ * @param func Function pointer representing the work to execute.
+ * @param arg Argument to be passed to the function.
+ * @param priority Priority of the task in the injection queue.
+ * @param group Pointer to the group of the task or NULL.
+ * @return 1 on success, 0 on failure.
+ */
+int tpool_submit(struct tpool *tm, thread_func_t func, void *arg, uint64_t priority, struct tpool_group *group) {
+    struct tpool_worker *self = tpool_self;
     struct tpool_work *work;
 
-    if (tm == NULL)
+    if (tm == NULL || func == NULL)
         return 0;
 
-    work = tpool_work_create(func, arg);
-    if (work == NULL)
-        return 0;
+    // fast path: push to the deque of the calling worker without locking
+    if (self != NULL && self->tm == tm) {
+        work = tpool_work_create(self, func, arg);
+        if (work == NULL)
+            return 0;
+        work->priority = priority;
+        work->group = group;
+
+        if (group != NULL)
+            atomic_fetch_add_explicit(&(group->pending_cnt), 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&(tm->pending_cnt), 1, memory_order_relaxed);
+
+        if (tpool_deque_push(&(self->deque), work)) {
+            tpool_notify(tm);
+            return 1;
+        }
 
-    pthread_mutex_lock(&(tm->work_mutex));
-    if (tm->work_first == NULL) {
-        tm->work_first = work;
-        tm->work_last  = tm->work_first;
+        // deque could not grow, fall back to the injection queue
+        pthread_mutex_lock(&(tm->work_mutex));
     } else {
-        tm->work_last->next = work;
-        tm->work_last       = work;
+        pthread_mutex_lock(&(tm->work_mutex));
+        work = tpool_work_get_shared(tm);
+        if (work == NULL) {
+            pthread_mutex_unlock(&(tm->work_mutex));
+            return 0;
+        }
+        work->func = func;
+        work->arg = arg;
+        work->next = NULL;
+        work->priority = priority;
+        work->group = group;
+
+        if (group != NULL)
+            atomic_fetch_add_explicit(&(group->pending_cnt), 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&(tm->pending_cnt), 1, memory_order_relaxed);
     }
 
-    pthread_cond_broadcast(&(tm->work_cond));
+    if (!tpool_heap_push(tm, work)) {
+        // the node is lost to the free lists until the pool is destroyed
+        if (group != NULL)
+            atomic_fetch_sub_explicit(&(group->pending_cnt), 1, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&(tm->pending_cnt), 1, memory_order_relaxed);
+        pthread_mutex_unlock(&(tm->work_mutex));
+        return 0;
+    }
+
+    // sleepers check for work while holding the mutex, so no wakeup can be lost here
+    if (atomic_load_explicit(&(tm->idle_cnt), memory_order_relaxed) != 0)
+        pthread_cond_signal(&(tm->work_cond));
     pthread_mutex_unlock(&(tm->work_mutex));
 
     return 1;
@@ -182,13 +866,119 @@ void tpool_wait(struct tpool *tm) {
         return;
 
     pthread_mutex_lock(&(tm->work_mutex));
-    while (1) {
-        if (tm->work_first != NULL || (!tm->stop && tm->working_cnt != 0) || (tm->stop && tm->thread_cnt != 0)) {
-            pthread_cond_wait(&(tm->working_cond), &(tm->work_mutex));
-        } else {
-            break;
+    while (atomic_load_explicit(&(tm->pending_cnt), memory_order_acquire) != 0 && tm->alive_cnt != 0)
+        pthread_cond_wait(&(tm->working_cond), &(tm->work_mutex));
+    pthread_mutex_unlock(&(tm->work_mutex));
+}
+
+int tpool_add_work(struct tpool *tm, thread_func_t func, void *arg) {
+    return tpool_submit(tm, func, arg, 0, NULL);
+}
+
+int tpool_add_work_prio(struct tpool *tm, thread_func_t func, void *arg, uint64_t priority) {
+    return tpool_submit(tm, func, arg, priority, NULL);
+}
+
+// ---------------------------------------------------------------------------------
+// MARK: Task groups
+// ---------------------------------------------------------------------------------
+
+void tpool_group_init(struct tpool_group *group, struct tpool *tm) {
+    group->tm = tm;
+    atomic_init(&(group->pending_cnt), 0);
+}
+
+int tpool_group_add_work(struct tpool_group *group, thread_func_t func, void *arg) {
+    return tpool_submit(group->tm, func, arg, 0, group);
+}
+
+void tpool_group_wait(struct tpool_group *group) {
+    struct tpool_worker *self = tpool_self;
+    struct tpool *tm = group->tm;
+    struct tpool_work *work;
+
+    if (self != NULL && self->tm == tm) {
+        // help instead of blocking, otherwise the pool deadlocks once every worker waits.
+        // the injection queue is skipped since it holds unrelated top-level tasks
+        while (atomic_load_explicit(&(group->pending_cnt), memory_order_acquire) != 0) {
+            work = tpool_deque_take(&(self->deque));
+            if (work == NULL)
+                work = tpool_steal(self);
+            if (work != NULL) {
+                tpool_run(self, work);
+                continue;
+            }
+
+            // the remaining tasks of the group are running on other workers. Only the 
+            // owner pushes to a deque and this one is empty, so blocking cannot strand 
+            // a task; the last task of the group broadcasts under the mutex
+            pthread_mutex_lock(&(tm->work_mutex));
+            if (atomic_load_explicit(&(group->pending_cnt), memory_order_acquire) != 0 && !tpool_has_stealable(tm))
+                pthread_cond_wait(&(tm->working_cond), &(tm->work_mutex));
+            pthread_mutex_unlock(&(tm->work_mutex));
         }
+        return;
     }
+
+    pthread_mutex_lock(&(tm->work_mutex));
+    while (atomic_load_explicit(&(group->pending_cnt), memory_order_acquire) != 0 && tm->alive_cnt != 0)
+        pthread_cond_wait(&(tm->working_cond), &(tm->work_mutex));
     pthread_mutex_unlock(&(tm->work_mutex));
 }
 
+// ---------------------------------------------------------------------------------
+// MARK: Parallel for
+// ---------------------------------------------------------------------------------
+
+struct tpool_range {
+    range_func_t func;
+    void *arg;
+    size_t end;
+    size_t grain;
+    _Atomic size_t next;
+};
+
+/**
+ * Claims chunks of the range until it is exhausted. Every participant runs this 
+ * loop, so faster threads simply claim more chunks.
+ * 
+ * @param arg Pointer to the tpool_range structure.
+ */
+void tpool_range_run(void *arg) {
+    struct tpool_range *range = arg;
+    size_t begin;
+
+    while ((begin = atomic_fetch_add_explicit(&(range->next), range->grain, memory_order_relaxed)) < range->end)
+        range->func(range->arg, begin, begin + range->grain < range->end ? begin + range->grain : range->end);
+}
+
+void tpool_parallel_for(struct tpool *tm, size_t begin, size_t end, size_t grain, range_func_t func, void *arg) {
+    struct tpool_group group;
+    struct tpool_range range;
+    size_t i, chunks, helpers;
+
+    if (begin >= end)
+        return;
+
+    if (grain == 0) {
+        grain = (end - begin) / (tm->thread_cnt * TPOOL_CHUNKS_PER_THREAD);
+        grain = grain ? grain : 1;
+    }
+
+    range.func = func;
+    range.arg = arg;
+    range.end = end;
+    range.grain = grain;
+    atomic_init(&(range.next), begin);
+
+    chunks = (end - begin + grain - 1) / grain;
+    helpers = chunks - 1 < tm->thread_cnt ? chunks - 1 : tm->thread_cnt;
+
+    tpool_group_init(&group, tm);
+    for (i=0; i<helpers; i++)
+        tpool_group_add_work(&group, tpool_range_run, &range);
+
+    // the caller takes part as well, so the loop completes even if no helper gets to run
+    tpool_range_run(&range);
+    tpool_group_wait(&group);
+}
@@ -1,6 +1,6 @@
 /**
  * @file tpool.h
- * @brief Implementation of a simple thread pool for parallel task execution.
+ * @brief Implementation of a work-stealing thread pool for parallel task execution.
  *
  * This file provides the implementation of a thread pool that allows users
  * to efficiently distribute tasks among a fixed number of worker threads. 
@@ -47,12 +47,22 @@
  * ```
  *
  * ## Features:
- * - Efficient task scheduling with a fixed number of worker threads.
- * - Dynamic work queue management.
- * - Thread-safe operations using mutexes and condition variables.
+ * - Work-stealing scheduling: every worker owns a lock-free deque, tasks added 
+ *   from a worker go to its own deque and idle workers steal from the others.
+ * - Tasks added from outside the pool go to a shared injection queue, which is 
+ *   a priority queue so that callers can control the order tasks are started.
+ * - Task nodes are pooled and recycled instead of being allocated per task.
+ * - Idle workers sleep and are woken one at a time only when work arrives.
+ * - Workers can optionally be pinned to cpus, spread over the NUMA nodes, so 
+ *   that memory they first touch stays local to them.
+ * - Task groups let a task fan out subtasks and wait for only those, and 
+ *   `tpool_parallel_for` splits an index range into dynamically claimed chunks.
  *
  * ## Notes:
  * - Ensure that the worker function and its arguments are thread-safe.
+ * - Tasks added from a worker run in LIFO order on that worker, tasks added 
+ *   from outside the pool are started by decreasing priority, and in FIFO 
+ *   order among equal priorities.
  * - The thread pool must be destroyed after use to free allocated resources.
  */
 
@@ -61,25 +71,93 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
 #include <pthread.h>
+#include <sched.h>
+
+#define TPOOL_DEQUE_INITIAL_SIZE 1024 // must be a power of two
+#define TPOOL_SLAB_SIZE 256           // number of task nodes allocated at once
+#define TPOOL_FREE_MAX 1024           // task nodes a worker keeps before returning them
+#define TPOOL_STEAL_ROUNDS 4          // steal attempts over all workers before sleeping
+#define TPOOL_CHUNKS_PER_THREAD 8     // chunks per thread when parallel_for picks the grain
+
+#define TPOOL_PIN 1 // pin workers to cpus, spread over NUMA nodes
 
 typedef void (*thread_func_t)(void *arg);
+typedef void (*range_func_t)(void *arg, size_t begin, size_t end);
+
+struct tpool_group;
 
 struct tpool_work {
     thread_func_t func;
     void *arg;
+    uint64_t priority;
+    uint64_t seq;
+    struct tpool_group *group;
     struct tpool_work *next;
 };
 
+struct tpool_slab {
+    struct tpool_slab *next;
+    struct tpool_work works[TPOOL_SLAB_SIZE];
+};
+
+struct tpool_array {
+    int64_t size;
+    struct tpool_array *prev; // retired arrays are kept until the pool is destroyed
+    _Atomic(struct tpool_work *) buffer[];
+};
+
+/**
+ * Chase-Lev work-stealing deque. Only the owner pushes and takes from the 
+ * bottom, any thread may steal from the top.
+ */
+struct tpool_deque {
+    _Atomic int64_t top;
+    _Atomic int64_t bottom;
+    _Atomic(struct tpool_array *) array;
+};
+
+struct tpool_worker {
+    struct tpool_deque deque;
+    struct tpool *tm;
+    struct tpool_work *free_list;
+    size_t free_cnt;
+    size_t id;
+    uint64_t seed;
+    int cpu;  // -1 if the worker is not pinned
+    int node; // NUMA node of the cpu, -1 if the worker is not pinned
+    pthread_t thread;
+} __attribute__((aligned(64)));
+
 struct tpool {
-    struct tpool_work *work_first;
-    struct tpool_work *work_last;
+    struct tpool_worker *workers;
+    struct tpool_work **heap;      // injection queue, ordered by priority
+    size_t heap_len;
+    size_t heap_cap;
+    uint64_t seq;
+    struct tpool_work *free_list;  // shared pool of task nodes
+    struct tpool_slab *slabs;
     pthread_mutex_t work_mutex;
     pthread_cond_t work_cond;
     pthread_cond_t working_cond;
-    size_t working_cnt;
+    _Atomic size_t inject_cnt;
+    _Atomic size_t pending_cnt;
+    _Atomic size_t idle_cnt;
     size_t thread_cnt;
-    int stop;
+    size_t alive_cnt;
+    size_t node_cnt;
+    _Atomic int stop;
+};
+
+/**
+ * A set of tasks that can be waited for independently of the rest of the pool.
+ */
+struct tpool_group {
+    struct tpool *tm;
+    _Atomic size_t pending_cnt;
 };
 
 /**
@@ -91,7 +169,29 @@ struct tpool {
 struct tpool *tpool_create(size_t num);
 
 /**
- * Destroys the thread pool, freeing all resources and stopping threads.
+ * Creates a new thread pool with the specified number of threads and options.
+ * 
+ * With `TPOOL_PIN`, every worker is pinned to a single cpu. Workers are placed 
+ * round-robin over the NUMA nodes found in sysfs, so that each node gets a 
+ * share of the workers.
+ * 
+ * @param num Number of worker threads to create (minimum is 2).
+ * @param flags Bitwise or of the `TPOOL_*` options, 0 for none.
+ * @return Pointer to the created tpool structure or NULL on failure, e.g. if 
+ *         a worker thread could not be started.
+ */
+struct tpool *tpool_create_ex(size_t num, int flags);
+
+/**
+ * Returns the NUMA node of the calling thread if it is a pinned worker.
+ * 
+ * @return The node index in [0, node_cnt) or -1.
+ */
+int tpool_current_node();
+
+/**
+ * Destroys the thread pool, freeing all resources and stopping threads. Tasks that 
+ * have not started yet are discarded.
  * 
  * @param tm Pointer to the thread pool to destroy.
  */
@@ -100,6 +200,10 @@ void tpool_destroy(struct tpool *tm);
 /**
  * Adds a new work task to the thread pool.
  * 
+ * If called from one of the pool's workers, the task is pushed to that 
+ * worker's deque without taking any lock. Otherwise it is appended to the 
+ * injection queue.
+ * 
  * @param tm Pointer to the thread pool.
  * @param func Function pointer representing the work to execute.
  * @param arg Argument to be passed to the function.
@@ -108,10 +212,72 @@ void tpool_destroy(struct tpool *tm);
 int tpool_add_work(struct tpool *tm, thread_func_t func, void *arg);
 
 /**
- * Waits for all pending tasks in the thread pool to complete and all threads to finish.
+ * Adds a new work task with a priority to the thread pool.
+ * 
+ * Among tasks waiting in the injection queue, the one with the highest priority 
+ * is started first. Tasks added from a worker of the pool are pushed to its 
+ * deque, where the priority has no effect.
+ * 
+ * @param tm Pointer to the thread pool.
+ * @param func Function pointer representing the work to execute.
+ * @param arg Argument to be passed to the function.
+ * @param priority Priority of the task, higher is started earlier.
+ * @return 1 on success, 0 on failure.
+ */
+int tpool_add_work_prio(struct tpool *tm, thread_func_t func, void *arg, uint64_t priority);
+
+/**
+ * Waits for all pending tasks in the thread pool to complete. It must not be called 
+ * from a task running on the same pool.
  * 
  * @param tm Pointer to the thread pool.
  */
 void tpool_wait(struct tpool *tm);
 
+/**
+ * Initializes an empty task group on the thread pool.
+ * 
+ * @param group Pointer to the group to initialize.
+ * @param tm Pointer to the thread pool that runs the tasks of the group.
+ */
+void tpool_group_init(struct tpool_group *group, struct tpool *tm);
+
+/**
+ * Adds a new work task to the thread pool as a member of the group.
+ * 
+ * @param group Pointer to the group.
+ * @param func Function pointer representing the work to execute.
+ * @param arg Argument to be passed to the function.
+ * @return 1 on success, 0 on failure.
+ */
+int tpool_group_add_work(struct tpool_group *group, thread_func_t func, void *arg);
+
+/**
+ * Waits for all tasks of the group to complete.
+ * 
+ * If called from a worker of the pool, the worker keeps running pending tasks 
+ * from its own deque and from the other workers while waiting, so tasks may 
+ * safely wait for the subtasks they created, and blocks once there is nothing 
+ * left to help with. Otherwise, the caller blocks.
+ * 
+ * @param group Pointer to the group.
+ */
+void tpool_group_wait(struct tpool_group *group);
+
+/**
+ * Runs `func` over the range [begin, end) in parallel and waits for it to complete.
+ * 
+ * The range is split into chunks of `grain` indices, which are claimed 
+ * dynamically by the caller and the helper tasks, so uneven chunks are balanced 
+ * automatically. It can be called from outside the pool or from a task.
+ * 
+ * @param tm Pointer to the thread pool.
+ * @param begin First index of the range.
+ * @param end One past the last index of the range.
+ * @param grain Number of indices per chunk, 0 to pick one from the thread count.
+ * @param func Function called with the argument and the bounds of each chunk.
+ * @param arg Argument to be passed to the function.
+ */
+void tpool_parallel_for(struct tpool *tm, size_t begin, size_t end, size_t grain, range_func_t func, void *arg);
+
 #endif
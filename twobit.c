@@ -0,0 +1,191 @@
+#include "twobit.h"
+
+static inline uint32_t swap32(uint32_t value) {
+    return ((value & 0xFF) << 24) | ((value & 0xFF00) << 8) | ((value >> 8) & 0xFF00) | (value >> 24);
+}
+
+/**
+ * Reads a 32-bit value of the file, returns 0 if it is out of bounds.
+ */
+static int read_u32(const struct twobit *tb, uint64_t offset, uint32_t *value) {
+    if (offset > tb->map_size || tb->map_size - offset < sizeof(uint32_t)) {
+        return 0;
+    }
+    memcpy(value, tb->map + offset, sizeof(uint32_t));
+    if (tb->swap) {
+        *value = swap32(*value);
+    }
+    return 1;
+}
+
+static int read_u64(const struct twobit *tb, uint64_t offset, uint64_t *value) {
+    uint32_t low, high;
+    if (!read_u32(tb, offset, &low) || !read_u32(tb, offset + 4, &high)) {
+        return 0;
+    }
+    // 64-bit values are stored with the byte order of the file
+    *value = tb->swap ? ((uint64_t)low << 32) | high : ((uint64_t)high << 32) | low;
+    return 1;
+}
+
+int is_twobit(const char *filename) {
+
+    FILE *in = fopen(filename, "rb");
+    if (in == NULL) {
+        return 0;
+    }
+
+    uint32_t signature = 0;
+    int found = fread(&signature, sizeof(signature), 1, in) == 1 &&
+        (signature == TWOBIT_SIGNATURE || signature == TWOBIT_SIGNATURE_SWAPPED);
+
+    fclose(in);
+
+    return found;
+}
+
+int twobit_open(const char *filename, struct twobit *tb) {
+
+    memset(tb, 0, sizeof(struct twobit));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        log1(ERROR, "Could not open 2bit file %s", filename);
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < TWOBIT_HEADER_SIZE) {
+        log1(ERROR, "Invalid 2bit file %s", filename);
+        close(fd);
+        return 0;
+    }
+
+    tb->map_size = st.st_size;
+    void *map = mmap(NULL, tb->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        log1(ERROR, "Could not map 2bit file %s", filename);
+        tb->map_size = 0;
+        return 0;
+    }
+
+    tb->map = (const uint8_t *)map;
+
+    // sequences are read once from the front to the back
+    madvise(map, tb->map_size, MADV_SEQUENTIAL);
+
+    uint32_t signature, version, count;
+    memcpy(&signature, tb->map, sizeof(signature));
+    tb->swap = signature == TWOBIT_SIGNATURE_SWAPPED;
+
+    if ((signature != TWOBIT_SIGNATURE && !tb->swap) || !read_u32(tb, 4, &version) || !read_u32(tb, 8, &count) || version > 1) {
+        log1(ERROR, "Invalid 2bit file %s", filename);
+        twobit_close(tb);
+        return 0;
+    }
+
+    tb->version = version;
+    tb->count = count;
+    tb->index = TWOBIT_HEADER_SIZE;
+
+    return 1;
+}
+
+int twobit_next(struct twobit *tb, struct packed_seq *seq) {
+
+    if (tb->next == tb->count) {
+        return 0;
+    }
+
+    // index entry: name size, name, offset of the record
+    if (tb->index >= tb->map_size) {
+        log1(ERROR, "Corrupted index of 2bit file at sequence %u", tb->next + 1);
+        return -1;
+    }
+
+    uint64_t offset;
+    uint32_t offset32;
+    uint64_t entry = tb->index + 1 + tb->map[tb->index];
+    int ok = tb->version == 0 ? read_u32(tb, entry, &offset32) : read_u64(tb, entry, &offset);
+    if (tb->version == 0) {
+        offset = offset32;
+    }
+
+    if (!ok) {
+        log1(ERROR, "Corrupted index of 2bit file at sequence %u", tb->next + 1);
+        return -1;
+    }
+
+    tb->index = entry + (tb->version == 0 ? 4 : 8);
+    tb->next++;
+
+    // record: size, N blocks, mask blocks, reserved word and the packed bases
+    uint32_t size, n_count, mask_count;
+    if (!read_u32(tb, offset, &size) || !read_u32(tb, offset + 4, &n_count)) {
+        log1(ERROR, "Corrupted record of 2bit file at sequence %u", tb->next);
+        return -1;
+    }
+
+    uint64_t n_starts = offset + 8;
+    uint64_t n_sizes = n_starts + 4 * (uint64_t)n_count;
+    uint64_t mask = n_sizes + 4 * (uint64_t)n_count;
+
+    if (!read_u32(tb, mask, &mask_count)) {
+        log1(ERROR, "Corrupted record of 2bit file at sequence %u", tb->next);
+        return -1;
+    }
+
+    uint64_t mask_starts = mask + 4;
+    uint64_t mask_sizes = mask_starts + 4 * (uint64_t)mask_count;
+    uint64_t bases = mask_sizes + 4 * (uint64_t)mask_count + 4;
+    uint64_t bases_size = ((uint64_t)size + TWOBIT_BASES_PER_BYTE - 1) / TWOBIT_BASES_PER_BYTE;
+
+    if (bases > tb->map_size || tb->map_size - bases < bases_size) {
+        log1(ERROR, "Corrupted record of 2bit file at sequence %u", tb->next);
+        return -1;
+    }
+
+    packed_map(seq, tb->map + bases, size);
+    tb->end = bases + bases_size;
+
+    uint64_t previous = 0;
+    for (uint32_t i=0; i<n_count; i++) {
+        uint32_t start, len;
+        if (!read_u32(tb, n_starts + 4 * (uint64_t)i, &start) || !read_u32(tb, n_sizes + 4 * (uint64_t)i, &len) ||
+            start < previous || (uint64_t)start + len > size) {
+            log1(ERROR, "Corrupted N blocks of 2bit file at sequence %u", tb->next);
+            return -1;
+        }
+        if (len && !packed_add_ambiguous(seq, start, len, 'N')) {
+            log1(ERROR, "Memory allocation failed for N blocks of 2bit file.");
+            return -1;
+        }
+        previous = (uint64_t)start + len;
+    }
+
+    previous = 0;
+    for (uint32_t i=0; i<mask_count; i++) {
+        uint32_t start, len;
+        if (!read_u32(tb, mask_starts + 4 * (uint64_t)i, &start) || !read_u32(tb, mask_sizes + 4 * (uint64_t)i, &len) ||
+            start < previous || (uint64_t)start + len > size) {
+            log1(ERROR, "Corrupted mask blocks of 2bit file at sequence %u", tb->next);
+            return -1;
+        }
+        if (len && !packed_add_masked(seq, start, len)) {
+            log1(ERROR, "Memory allocation failed for mask blocks of 2bit file.");
+            return -1;
+        }
+        previous = (uint64_t)start + len;
+    }
+
+    return 1;
+}
+
+void twobit_close(struct twobit *tb) {
+    if (tb->map != NULL) {
+        munmap((void *)tb->map, tb->map_size);
+    }
+    memset(tb, 0, sizeof(struct twobit));
+}
@@ -0,0 +1,75 @@
+#ifndef TWOBIT_H
+#define TWOBIT_H
+
+#include "log.h"
+#include "packed.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TWOBIT_SIGNATURE 0x1A412743
+#define TWOBIT_SIGNATURE_SWAPPED 0x4327411A
+#define TWOBIT_HEADER_SIZE 16
+#define TWOBIT_BASES_PER_BYTE 4
+
+/**
+ * @brief A mapped UCSC .2bit file and the position of the next sequence in its index.
+ *
+ * Version 0 files have 32-bit sequence offsets, version 1 files 64-bit ones.
+ * Files written on a machine of the other byte order are swapped on reading.
+ */
+struct twobit {
+    const uint8_t *map;
+    size_t map_size;
+    int swap;
+    int version;
+    uint32_t count; // sequences
+    uint32_t next; // index of the next sequence
+    uint64_t index; // offset of the next index entry
+    uint64_t end; // offset of the end of the last record read
+};
+
+/**
+ * @brief Checks whether a file is a .2bit file by its signature.
+ *
+ * @param filename Path of the file.
+ * @return 1 if the file starts with the .2bit signature (in either byte order), 0 otherwise.
+ */
+int is_twobit(const char *filename);
+
+/**
+ * @brief Maps a .2bit file and validates its header.
+ *
+ * @param filename Path of the file.
+ * @param tb Pointer to the structure to be filled.
+ * @return 1 on success, 0 on failure (logged).
+ */
+int twobit_open(const char *filename, struct twobit *tb);
+
+/**
+ * @brief Makes a packed sequence a view of the next sequence of a .2bit file.
+ *
+ * The packed DNA is used in place from the mapping, and the N blocks and
+ * mask blocks of the record become the ambiguous and masked runs of the
+ * sequence, so nothing is parsed or copied besides the block lists.
+ *
+ * @param tb Pointer to the mapped file.
+ * @param seq Pointer to the packed sequence, initialized with `packed_init`.
+ * @return 1 if a sequence was read, 0 at the end of the file, -1 if the
+ *         record is corrupted or the runs could not be allocated (logged).
+ */
+int twobit_next(struct twobit *tb, struct packed_seq *seq);
+
+/**
+ * @brief Unmaps a .2bit file.
+ *
+ * @param tb Pointer to the mapped file.
+ */
+void twobit_close(struct twobit *tb);
+
+#endif
@@ -1,36 +1,109 @@
 #include "utils.h"
 
+// kernels specialized for 64-bit and 32-bit keys
+#define KEY_T uint64_t
+#define KEY_SUFFIX 64
+#include "keykernels.h"
+
+#define KEY_T uint32_t
+#define KEY_SUFFIX 32
+#include "keykernels.h"
+
+/**
+ * Intersection and union sizes of one bucket of two partitioned signatures.
+ */
+static void calcPartitionUISize(const struct gargs *argument1, const struct gargs *argument2, uint32_t p, uint64_t *interSize, uint64_t *unionSize) {
+
+    uint64_t begin1 = argument1->partition_offsets[p], end1 = argument1->partition_offsets[p+1];
+    uint64_t begin2 = argument2->partition_offsets[p], end2 = argument2->partition_offsets[p+1];
+
+    if (argument1->key == KEY_CORE) {
+        ui_size_64((const uint64_t *)argument1->cores + begin1, end1 - begin1, (const uint64_t *)argument2->cores + begin2, end2 - begin2, interSize, unionSize);
+    } else {
+        ui_size_32((const uint32_t *)argument1->cores + begin1, end1 - begin1, (const uint32_t *)argument2->cores + begin2, end2 - begin2, interSize, unionSize);
+    }
+}
+
 void calcUISize(const struct gargs *argument1, const struct gargs *argument2, uint64_t *interSize, uint64_t *unionSize) {
-    
-    uint64_t is = 0;
-    uint64_t us = 0;
-    uint64_t size1 = argument1->cores_len;
-    uint64_t size2 = argument2->cores_len;
-    uint64_t index1 = 0;
-    uint64_t index2 = 0;
-
-    const simple_core *cores1 = argument1->cores;
-    const simple_core *cores2 = argument2->cores;
-
-    while (index1 < size1 && index2 < size2) {
-        us++;
-        
-        if (cores1[index1] == cores2[index2]) {
-            is++;
-            index1++;
-            index2++;
-        } else if (cores1[index1] < cores2[index2]) {
-            index1++;
-        } else {
-            index2++;
+
+    // signatures are either all encoded with the dictionary of the run or none is
+    if (argument1->dict != NULL) {
+        uint64_t is = bitmap_and_count(&(argument1->ids), &(argument2->ids));
+        *interSize = is;
+        *unionSize = argument1->cores_len + argument2->cores_len - is;
+        return;
+    }
+
+    if (argument1->compress) {
+        uint64_t is = blocksig_and_count(&(argument1->blocks), &(argument2->blocks));
+        *interSize = is;
+        *unionSize = argument1->cores_len + argument2->cores_len - is;
+        return;
+    }
+
+    // buckets hold disjoint ranges of keys, so their sizes add up to the totals
+    if (argument1->partition_offsets != NULL && argument2->partition_offsets != NULL) {
+        uint64_t is = 0, us = 0;
+        for (uint32_t p=0; p<argument1->partitions; p++) {
+            uint64_t bucket_is, bucket_us;
+            calcPartitionUISize(argument1, argument2, p, &bucket_is, &bucket_us);
+            is += bucket_is;
+            us += bucket_us;
         }
+        *interSize = is;
+        *unionSize = us;
+        return;
+    }
+
+    // signatures of different key types are never compared (see sigdb_load)
+    if (argument1->key == KEY_CORE) {
+        ui_size_64((const uint64_t *)argument1->cores, argument1->cores_len, (const uint64_t *)argument2->cores, argument2->cores_len, interSize, unionSize);
+    } else {
+        ui_size_32((const uint32_t *)argument1->cores, argument1->cores_len, (const uint32_t *)argument2->cores, argument2->cores_len, interSize, unionSize);
+    }
+}
+
+struct partition_args {
+    const struct gargs *argument1;
+    const struct gargs *argument2;
+    _Atomic uint64_t interSize;
+    _Atomic uint64_t unionSize;
+};
+
+static void calcPartitionRange(void *arg, size_t begin, size_t end) {
+
+    struct partition_args *args = (struct partition_args *)arg;
+    uint64_t is = 0, us = 0;
+
+    for (size_t p=begin; p<end; p++) {
+        uint64_t bucket_is, bucket_us;
+        calcPartitionUISize(args->argument1, args->argument2, p, &bucket_is, &bucket_us);
+        is += bucket_is;
+        us += bucket_us;
+    }
+
+    atomic_fetch_add_explicit(&(args->interSize), is, memory_order_relaxed);
+    atomic_fetch_add_explicit(&(args->unionSize), us, memory_order_relaxed);
+}
+
+void calcUISizeParallel(struct tpool *tm, const struct gargs *argument1, const struct gargs *argument2, uint64_t *interSize, uint64_t *unionSize) {
+
+    if (tm == NULL || argument1->partition_offsets == NULL || argument2->partition_offsets == NULL ||
+        argument1->cores_len + argument2->cores_len < PARALLEL_PAIR_CORES) {
+        calcUISize(argument1, argument2, interSize, unionSize);
+        return;
     }
 
-    us += (size1-index1);
-    us += (size2-index2);
+    struct partition_args args;
+    args.argument1 = argument1;
+    args.argument2 = argument2;
+    atomic_init(&(args.interSize), 0);
+    atomic_init(&(args.unionSize), 0);
+
+    tpool_parallel_for(tm, 0, argument1->partitions, 0, calcPartitionRange, &args);
 
-    *interSize = is;
-    *unionSize = us;
+    *interSize = atomic_load(&(args.interSize));
+    *unionSize = atomic_load(&(args.unionSize));
 }
 
 double calcJaccardSim(uint64_t interSize, uint64_t unionSize) {
@@ -49,116 +122,294 @@ double calcJukesCantorCor(double hammingDist) {
     return - 3.0/4.0 * log(1 - hammingDist * 4.0/3.0);
 }
 
+void calcPairDistances(struct tpool *tm, const struct gargs *argument1, const struct gargs *argument2, double *dice, double *jaccard, double *jukes_cantor) {
+
+    uint64_t interSize, unionSize;
+    calcUISizeParallel(tm, argument1, argument2, &interSize, &unionSize);
+
+    *dice = 1.0 - calcDiceSim(interSize, argument1->cores_len, argument2->cores_len);
+    *jaccard = 1.0 - calcJaccardSim(interSize, unionSize);
+
+    double avg_len = (argument1->total_len+argument2->total_len)/(argument1->cores_len+argument2->cores_len);
+    *jukes_cantor = calcJukesCantorCor(calcHammDist(1.0 - *jaccard, avg_len));
+}
+
+struct distance_args {
+    struct tpool *tm;
+    const struct gargs *genome_arguments;
+    int n;
+    double *dice;
+    double *jaccard;
+    double *jukes_cantor;
+    // rows grouped by the NUMA node of their genome
+    int node_cnt;
+    int *rows;
+    size_t *node_first;
+    _Atomic size_t *node_next;
+    // signature bytes read by a worker on another node than the signature
+    _Atomic uint64_t remote_bytes;
+    _Atomic uint64_t total_bytes;
+};
+
+void calcDistanceRow(struct distance_args *args, int i, int node) {
+
+    const struct gargs *genome_arguments = args->genome_arguments;
+    int n = args->n;
+    uint64_t remote_bytes = 0;
+    uint64_t total_bytes = 0;
+    uint64_t start = stats_now();
+
+    for (int j=i+1; j<n; j++) {
+
+        double diceDist, jaccardDist, jukesCantorDist;
+        calcPairDistances(args->tm, &(genome_arguments[i]), &(genome_arguments[j]), &diceDist, &jaccardDist, &jukesCantorDist);
+
+        args->dice[i*n+j] = diceDist;
+        args->jaccard[i*n+j] = jaccardDist;
+        args->jukes_cantor[i*n+j] = jukesCantorDist;
+
+        // set values to transposed locations
+        args->dice[j*n+i] = diceDist;
+        args->jaccard[j*n+i] = jaccardDist;
+        args->jukes_cantor[j*n+i] = jukesCantorDist;
+
+        if (node >= 0) {
+            uint64_t bytes_i = signature_bytes(&(genome_arguments[i]));
+            uint64_t bytes_j = signature_bytes(&(genome_arguments[j]));
+            remote_bytes += genome_arguments[i].numa_node != node ? bytes_i : 0;
+            remote_bytes += genome_arguments[j].numa_node != node ? bytes_j : 0;
+            total_bytes += bytes_i + bytes_j;
+        }
+    }
+
+    stats_add(STAGE_DISTANCE, stats_now() - start);
+    atomic_fetch_add_explicit(&(run_stats.pairs), n-i-1, memory_order_relaxed);
+    progress_add(&(progress.pairs), n-i-1);
+
+    if (total_bytes) {
+        atomic_fetch_add_explicit(&(args->remote_bytes), remote_bytes, memory_order_relaxed);
+        atomic_fetch_add_explicit(&(args->total_bytes), total_bytes, memory_order_relaxed);
+    }
+}
+
+void calcDistanceWorker(void *arg) {
+
+    struct distance_args *args = (struct distance_args *)arg;
+    int node = tpool_current_node();
+    int home = node >= 0 ? node : 0;
+
+    // claim rows of the local node first, then help the other nodes
+    for (int k=0; k<args->node_cnt; k++) {
+        int current = (home + k) % args->node_cnt;
+        size_t index;
+
+        while ((index = atomic_fetch_add_explicit(&(args->node_next[current]), 1, memory_order_relaxed)) < args->node_first[current+1]) {
+            calcDistanceRow(args, args->rows[index], node);
+        }
+    }
+}
+
 void calcDistances(const struct gargs *genome_arguments, const struct pargs* program_arguments) {
 
     log1(INFO, "Calculating distance matrices...");
 
+    uint64_t start = stats_now();
+    int n = program_arguments->number_of_genomes;
+
     // Initialize similarity matrices
-    double jaccard[program_arguments->number_of_genomes][program_arguments->number_of_genomes];
-    double dice[program_arguments->number_of_genomes][program_arguments->number_of_genomes];
-    double jukes_cantor[program_arguments->number_of_genomes][program_arguments->number_of_genomes];
-    
-    for (int i = 0; i < program_arguments->number_of_genomes; i++) {
-        jaccard[i][i] = 0.0;
-        dice[i][i] = 0.0;
-        jukes_cantor[i][i]= 0.0;
-    }
-
-    // Compute similarity scores
-    for (int i=0; i<program_arguments->number_of_genomes; i++) { 
-        for (int j=i+1; j<program_arguments->number_of_genomes; j++) {
-            
-            size_t interSize, unionSize;
-            calcUISize(&(genome_arguments[i]), &(genome_arguments[j]), &interSize, &unionSize);
-
-            double diceDist = 1.0 - calcDiceSim(interSize, genome_arguments[i].cores_len, genome_arguments[j].cores_len);
-            double jaccardDist = 1.0 - calcJaccardSim(interSize, unionSize);
-            
-            double avg_len = (genome_arguments[i].total_len+genome_arguments[j].total_len)/(genome_arguments[i].cores_len+genome_arguments[j].cores_len);
-            double jukesCantorDist = calcHammDist(1.0 - jaccardDist, avg_len);
-            jukesCantorDist = calcJukesCantorCor(jukesCantorDist);
-
-            dice[i][j] = diceDist;
-            jaccard[i][j] = jaccardDist;
-            jukes_cantor[i][j] = jukesCantorDist;
-
-            // set values to transposed locations
-            dice[j][i] = diceDist;
-            jaccard[j][i] = jaccardDist;
-            jukes_cantor[j][i] = jukesCantorDist;
+    double *jaccard = (double *)calloc((size_t)n * n, sizeof(double));
+    double *dice = (double *)calloc((size_t)n * n, sizeof(double));
+    double *jukes_cantor = (double *)calloc((size_t)n * n, sizeof(double));
+
+    if (jaccard == NULL || dice == NULL || jukes_cantor == NULL) {
+        log1(ERROR, "Memory allocation failed for distance matrices.");
+        exit(EXIT_FAILURE);
+    }
+
+    struct tpool *tm = tpool_create_ex(program_arguments->thread_number, program_arguments->pin ? TPOOL_PIN : 0);
+    if (tm == NULL) {
+        log1(ERROR, "Could not start the threads of the pool.");
+        exit(EXIT_FAILURE);
+    }
+
+    progress_begin(PROGRESS_DISTANCES, 0, 0, (uint64_t)n * (n-1) / 2);
+
+    struct distance_args args;
+    args.tm = tm;
+    args.genome_arguments = genome_arguments;
+    args.n = n;
+    args.dice = dice;
+    args.jaccard = jaccard;
+    args.jukes_cantor = jukes_cantor;
+    args.node_cnt = (int)tm->node_cnt;
+    args.rows = (int *)malloc(n * sizeof(int));
+    args.node_first = (size_t *)calloc(args.node_cnt + 1, sizeof(size_t));
+    args.node_next = (_Atomic size_t *)malloc(args.node_cnt * sizeof(_Atomic size_t));
+    atomic_init(&(args.remote_bytes), 0);
+    atomic_init(&(args.total_bytes), 0);
+
+    if (args.rows == NULL || args.node_first == NULL || args.node_next == NULL) {
+        log1(ERROR, "Memory allocation failed for distance scheduling.");
+        exit(EXIT_FAILURE);
+    }
+
+    // bucket rows by node, keeping the long rows of each node first
+    for (int i=0; i<n; i++) {
+        int node = genome_arguments[i].numa_node >= 0 && genome_arguments[i].numa_node < args.node_cnt ? genome_arguments[i].numa_node : 0;
+        args.node_first[node+1]++;
+    }
+    for (int k=0; k<args.node_cnt; k++) {
+        args.node_first[k+1] += args.node_first[k];
+        atomic_init(&(args.node_next[k]), args.node_first[k]);
+    }
+    for (int i=0; i<n; i++) {
+        int node = genome_arguments[i].numa_node >= 0 && genome_arguments[i].numa_node < args.node_cnt ? genome_arguments[i].numa_node : 0;
+        args.rows[atomic_fetch_add(&(args.node_next[node]), 1)] = i;
+    }
+    for (int k=0; k<args.node_cnt; k++) {
+        atomic_init(&(args.node_next[k]), args.node_first[k]);
+    }
+
+    // Compute similarity scores, every worker claims rows one at a time
+    struct tpool_group group;
+    tpool_group_init(&group, tm);
+    for (size_t t=0; t<tm->thread_cnt; t++) {
+        if (!tpool_group_add_work(&group, calcDistanceWorker, &args)) {
+            log1(ERROR, "Could not submit the distance calculation to the pool.");
+            exit(EXIT_FAILURE);
         }
     }
+    tpool_group_wait(&group);
+
+    tpool_destroy(tm);
+
+    if (genome_arguments[0].verbose && program_arguments->pin) {
+        uint64_t total_bytes = atomic_load(&(args.total_bytes));
+        uint64_t remote_bytes = atomic_load(&(args.remote_bytes));
+        log1(INFO, "NUMA nodes: %d, cross-node signature traffic: %.2f MB of %.2f MB (%.2f%%)", args.node_cnt, 
+            remote_bytes / 1048576.0, total_bytes / 1048576.0, total_bytes ? 100.0 * remote_bytes / total_bytes : 0.0);
+    }
+
+    free(args.rows);
+    free(args.node_first);
+    free((void *)args.node_next);
+
+    writeGenomeMatrices(genome_arguments, program_arguments, dice, jaccard, jukes_cantor);
+
+    run_stats.distances_ns = stats_now() - start;
+}
+
+void writeGenomeMatrices(const struct gargs *genome_arguments, const struct pargs *program_arguments, double *dice, double *jaccard, double *jukes_cantor) {
 
     log1(INFO, "Writing distance matrices to files...");
 
-    int lcp_level = genome_arguments[0].lcp_level;
-    
+    uint64_t write_start = stats_now();
+    int n = program_arguments->number_of_genomes;
+
+    const char **names = (const char **)malloc(n * sizeof(char *));
+    if (names == NULL) {
+        log1(ERROR, "Memory allocation failed for genome names.");
+        exit(EXIT_FAILURE);
+    }
+    for (int i=0; i<n; i++) {
+        names[i] = genome_arguments[i].shortName;
+    }
+
+    writeDistanceMatrices(program_arguments->prefix, genome_arguments[0].sct, genome_arguments[0].lcp_level, n, names, dice, jaccard, jukes_cantor);
+
+    free(names);
+    free(dice);
+    free(jaccard);
+    free(jukes_cantor);
+
+    stats_add(STAGE_WRITE, stats_now() - write_start);
+}
+
+void writeDistanceMatrix(const char *filename, int n, const char **names, const double *matrix) {
+
+    FILE *out = fopen(filename, "w");
+    if (out == NULL) {
+        log1(ERROR, "Could not create %s", filename);
+        return;
+    }
+
+    fprintf(out, "%d\n", n);
+
+    for (int i = 0; i < n; i++) {
+        fprintf(out, "%10s", names[i]);
+
+        for (int j = 0; j < n; j++) {
+            fprintf(out, " %.15f", matrix[(size_t)i*n+j]);
+        }
+        fprintf(out, "\n");
+    }
+    fclose(out);
+}
+
+void writeDistanceMatrices(const char *prefix, sim_calculation_type sct, int lcp_level, int n, const char **names, const double *dice, const double *jaccard, const double *jukes_cantor) {
+
     // Write outputs to files
-    char *program_type = genome_arguments[0].sct == SET ? "set" : "vec";
-    FILE *dice_out, *jaccard_out, *jukes_cantor_out;
+    char *program_type = sct == SET ? "set" : "vec";
     char filename_buffer[256];
-    if (snprintf(filename_buffer, 256, "%s.%s.%s%d.phy", program_arguments->prefix, program_type, "dice.lvl", lcp_level) < 0) {
+
+    if (snprintf(filename_buffer, 256, "%s.%s.%s%d.phy", prefix, program_type, "dice.lvl", lcp_level) < 0) {
         log1(ERROR, "Filename buffer for dice overflow.");
         exit(EXIT_FAILURE);
     }
-    dice_out = fopen(filename_buffer, "w");
+    writeDistanceMatrix(filename_buffer, n, names, dice);
 
-    if (snprintf(filename_buffer, 256, "%s.%s.%s%d.phy", program_arguments->prefix, program_type, "jaccard.lvl", lcp_level) < 0) {
+    if (snprintf(filename_buffer, 256, "%s.%s.%s%d.phy", prefix, program_type, "jaccard.lvl", lcp_level) < 0) {
         log1(ERROR, "Filename buffer for jaccard overflow.");
         exit(EXIT_FAILURE);
     }
-    jaccard_out = fopen(filename_buffer, "w");
+    writeDistanceMatrix(filename_buffer, n, names, jaccard);
 
-    if (snprintf(filename_buffer, 256, "%s.%s.%s%d.phy", program_arguments->prefix, program_type, "jc.lvl", lcp_level) < 0) {
+    if (snprintf(filename_buffer, 256, "%s.%s.%s%d.phy", prefix, program_type, "jc.lvl", lcp_level) < 0) {
         log1(ERROR, "Filename buffer for jc overflow.");
         exit(EXIT_FAILURE);
     }
-    jukes_cantor_out = fopen(filename_buffer, "w");
+    writeDistanceMatrix(filename_buffer, n, names, jukes_cantor);
+}
 
-    // write dice
-    if (dice_out) {
-        fprintf(dice_out, "%d\n", program_arguments->number_of_genomes);
+int writeCCHistograms(const struct gargs *genome_arguments, const struct pargs *program_arguments) {
 
-        for (int i = 0; i < program_arguments->number_of_genomes; i++) {
-            fprintf(dice_out, "%10s", genome_arguments[i].shortName);
+    char filename_buffer[256];
 
-            for (int j = 0; j < program_arguments->number_of_genomes; j++) {
-                fprintf(dice_out, " %.15f", dice[i][j]);
-            }
-            fprintf(dice_out, "\n");
-        }
-        fclose(dice_out);
+    if (snprintf(filename_buffer, 256, "%s.cc.hist", program_arguments->prefix) >= 256) {
+        log1(ERROR, "Filename buffer for the core abundance histograms overflow.");
+        return 0;
     }
 
-    // write jaccard
-    if (jaccard_out) {
-        fprintf(jaccard_out, "%d\n", program_arguments->number_of_genomes);
-
-        for (int i = 0; i < program_arguments->number_of_genomes; i++) {
-            fprintf(jaccard_out, "%10s", genome_arguments[i].shortName);
-
-            for (int j = 0; j < program_arguments->number_of_genomes; j++) {
-                fprintf(jaccard_out, " %.15f", jaccard[i][j]);
-            }
-            fprintf(jaccard_out, "\n");
-        }
-        fclose(jaccard_out);
+    FILE *out = fopen(filename_buffer, "w");
+    if (out == NULL) {
+        log1(ERROR, "Could not open file: %s", filename_buffer);
+        return 0;
     }
 
-    // write jukes cantor
-    if (jukes_cantor_out) {
-        fprintf(jukes_cantor_out, "%d\n", program_arguments->number_of_genomes);
+    for (int i=0; i<program_arguments->number_of_genomes; i++) {
+        const struct gargs *g = genome_arguments + i;
 
-        for (int i = 0; i < program_arguments->number_of_genomes; i++) {
-            fprintf(jukes_cantor_out, "%10s", genome_arguments[i].shortName);
+        // the thresholds of cached signatures are not known
+        if (g->cc_hist == NULL) {
+            fprintf(out, "# %s\tcached\n", g->shortName);
+            continue;
+        }
 
-            for (int j = 0; j < program_arguments->number_of_genomes; j++) {
-                fprintf(jukes_cantor_out, " %.15f", jukes_cantor[i][j]);
+        fprintf(out, "# %s\tmin-cc %u\tmax-cc %u\n", g->shortName, g->min_cc, g->max_cc);
+        for (uint32_t c=1; c<CC_HIST_BINS; c++) {
+            if (g->cc_hist[c]) {
+                fprintf(out, "%u\t%lu\n", c, g->cc_hist[c]);
             }
-            fprintf(jukes_cantor_out, "\n");
         }
-        fclose(jukes_cantor_out);
     }
+
+    int ok = !ferror(out);
+    if (fclose(out) != 0 || !ok) {
+        log1(ERROR, "Could not write file: %s", filename_buffer);
+        return 0;
+    }
+
+    return 1;
 }
 
 // ---------------------------------------------------------------------------------
@@ -167,150 +418,666 @@ void calcDistances(const struct gargs *genome_arguments, const struct pargs* pro
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
 
-void quicksort(simple_core *array, int low, int high) {
-    if (low < high) {
-        simple_core pivot = array[high];
-        int i = low - 1;
-
-        for (int j = low; j < high; j++) {
-            if (array[j] < pivot) {
-                i++;
-                simple_core temp = array[i];
-                array[i] = array[j];
-                array[j] = temp;
-            }
+int reserve_cores(struct gargs *genome_arguments, uint64_t needed) {
+
+    if (needed <= genome_arguments->cores_capacity) {
+        return 1;
+    }
+
+    uint64_t capacity = genome_arguments->cores_capacity ? genome_arguments->cores_capacity : needed;
+    while (capacity < needed) {
+        capacity = capacity * 1.5 + 1;
+    }
+
+    size_t size = key_size(genome_arguments->key);
+    void *temp = mem_realloc(&(genome_arguments->mem), genome_arguments->cores, genome_arguments->cores_capacity * size, capacity * size);
+    if (temp == NULL) {
+        log1(ERROR, "Couldn't increase cores array size.");
+        return 0;
+    }
+
+    genome_arguments->cores = temp;
+    genome_arguments->cores_capacity = capacity;
+
+    return 1;
+}
+
+/**
+ * Picks core-count thresholds from an abundance histogram the way k-mer spectrum
+ * tools do: cores of sequencing errors make up the left tail that decreases down
+ * to a trough, after which the counts rise to the peak at the coverage of the
+ * sample. Cores below the trough are errors, cores far above the peak repeats.
+ * Returns 0 if the histogram has no trough followed by a higher peak, or if most
+ * of the cores are below the trough, as in samples too shallow to have a peak.
+ */
+static int pick_cc_thresholds(const uint64_t *hist, uint32_t *min_cc, uint32_t *max_cc) {
+
+    // the last bin collects all higher counts and is not a point of the curve
+    uint32_t trough = 1;
+    while (trough + 1 < CC_HIST_BINS - 1 && hist[trough + 1] <= hist[trough]) {
+        trough++;
+    }
+
+    uint32_t peak = trough;
+    for (uint32_t c=trough+1; c<CC_HIST_BINS-1; c++) {
+        if (hist[c] > hist[peak]) {
+            peak = c;
         }
+    }
+
+    if (peak == trough) {
+        return 0;
+    }
 
-        simple_core temp = array[i+1];
-        array[i+1] = array[high];
-        array[high] = temp;
+    double total = 0, solid = 0;
+    for (uint32_t c=1; c<CC_HIST_BINS; c++) {
+        total += (double)c * hist[c];
+        solid += c >= trough ? (double)c * hist[c] : 0;
+    }
 
-        quicksort(array, low, i);
-        quicksort(array, i + 2, high);
+    if (solid < AUTO_MIN_SOLID * total) {
+        return 0;
     }
+
+    *min_cc = trough;
+    *max_cc = peak * AUTO_MAX_CC_FACTOR;
+
+    return 1;
 }
 
 void genSign(struct gargs *genome_arguments, sim_calculation_type mode) {
 
-    simple_core *cores = genome_arguments->cores;
+    void *cores = genome_arguments->cores;
     uint64_t len = genome_arguments->cores_len;
+    uint64_t produced = len;
+    size_t size = key_size(genome_arguments->key);
+    int wide = genome_arguments->key == KEY_CORE;
     double total_len = genome_arguments->total_len;
+    uint64_t start = stats_now();
 
-    quicksort(cores, 0, len);
-    
-    if (genome_arguments->apply_filter) {
-        uint32_t min_cc = genome_arguments->min_cc;
-        uint32_t max_cc = genome_arguments->max_cc;
-        uint64_t index = 0;
-        uint64_t i = 0;
+    mem_stage(&(genome_arguments->mem), STAGE_SORT);
 
-        while (i<len) {
-            uint64_t freq = 1;
+    if (wide) {
+        radix_sort_64((uint64_t *)cores, len, 56);
+    } else {
+        radix_sort_32((uint32_t *)cores, len, 24);
+    }
 
-            for (uint64_t j=i+1; j<len && cores[i]==cores[j]; j++, freq++);
+    uint64_t sorted = stats_now();
+    genome_arguments->stats.ns[STAGE_SORT] += sorted - start;
+    genome_arguments->stats.cores += len;
 
-            if (min_cc<=freq && freq<=max_cc) {
-                memcpy(&(cores[index]), &(cores[i]), freq * sizeof(simple_core));
-                index += freq;
-            }
+    if (genome_arguments->auto_cc) {
+        uint64_t *hist = (uint64_t *)mem_malloc(&(genome_arguments->mem), CC_HIST_BINS * sizeof(uint64_t));
+        if (hist == NULL) {
+            log1(ERROR, "Memory allocation failed for the core abundance histogram of %s", genome_arguments->shortName);
+            genome_arguments->failed = 1;
+            return;
+        }
+        memset(hist, 0, CC_HIST_BINS * sizeof(uint64_t));
 
-            i += freq;
+        if (wide) {
+            count_keys_64((const uint64_t *)cores, len, hist, CC_HIST_BINS);
+        } else {
+            count_keys_32((const uint32_t *)cores, len, hist, CC_HIST_BINS);
         }
-        genome_arguments->cores_len = index;
-        len = index;
+        genome_arguments->cc_hist = hist;
+
+        if (pick_cc_thresholds(hist, &(genome_arguments->min_cc), &(genome_arguments->max_cc))) {
+            if (genome_arguments->verbose) {
+                log1(INFO, "%s: min-cc %u, max-cc %u picked from the core abundance histogram", genome_arguments->shortName, genome_arguments->min_cc, genome_arguments->max_cc);
+            }
+        } else {
+            log1(WARN, "%s: no error trough in the core abundance histogram, keeping min-cc %u and max-cc %u", genome_arguments->shortName, genome_arguments->min_cc, genome_arguments->max_cc);
+        }
+    }
+    
+    if (genome_arguments->apply_filter) {
+        uint32_t min_cc = genome_arguments->min_cc;
+        uint32_t max_cc = genome_arguments->max_cc;
+
+        len = wide ? filter_keys_64((uint64_t *)cores, len, min_cc, max_cc) : filter_keys_32((uint32_t *)cores, len, min_cc, max_cc);
+        genome_arguments->cores_len = len;
     }
     
     if (mode == VECTOR) {
+        genome_arguments->stats.ns[STAGE_FILTER] += stats_now() - sorted;
         return;
     }
 
-    uint64_t index = 0;
-    uint64_t i=1;
-    total_len += cores[0] & 0xFFFFFFFF;
+    uint64_t index = wide ? unique_keys_64((uint64_t *)cores, len) : unique_keys_32((uint32_t *)cores, len);
 
-    while (i<len) {
-        if (cores[index] != cores[i]) {
-            index++;
-            cores[index] = cores[i];
-            total_len += cores[i] & 0xFFFFFFFF;
+    // 32-bit keys do not hold lengths, their mean over all produced cores is used
+    if (wide) {
+        for (uint64_t i=0; i<index; i++) {
+            total_len += ((uint64_t *)cores)[i] & 0xFFFFFFFF;
         }
-        i++;
+    } else if (produced) {
+        total_len += (double)genome_arguments->core_bases / produced * index;
     }
 
+    mem_stage(&(genome_arguments->mem), STAGE_FILTER);
+
     if (index) {
-        simple_core *new_cores = (simple_core *)realloc(cores, index * sizeof(simple_core));
+        void *new_cores = mem_realloc(&(genome_arguments->mem), cores, genome_arguments->cores_capacity * size, index * size);
         if (new_cores) {
             genome_arguments->cores = new_cores;
+            genome_arguments->cores_capacity = index;
         } else {
-            free(cores);
+            mem_free(&(genome_arguments->mem), cores, genome_arguments->cores_capacity * size);
             genome_arguments->cores = NULL;
+            genome_arguments->cores_capacity = 0;
             index = 0;
         }
     } else {
-        free(cores);
+        mem_free(&(genome_arguments->mem), cores, genome_arguments->cores_capacity * size);
         genome_arguments->cores = NULL;
+        genome_arguments->cores_capacity = 0;
     }
 
     genome_arguments->cores_len = index; 
     genome_arguments->total_len = total_len;
+    genome_arguments->stats.ns[STAGE_FILTER] += stats_now() - sorted;
+}
+
+void encodeSign(struct gargs *genome_arguments) {
+
+    uint64_t len = genome_arguments->cores_len;
+    uint64_t start = stats_now();
+
+    mem_stage(&(genome_arguments->mem), STAGE_ENCODE);
+
+    uint32_t *ids = (uint32_t *)mem_malloc(&(genome_arguments->mem), (len ? len : 1) * sizeof(uint32_t));
+    if (ids == NULL) {
+        log1(ERROR, "Memory allocation failed for encoding the signature of %s", genome_arguments->shortName);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!coredict_encode(genome_arguments->dict, genome_arguments->cores, len, genome_arguments->key, ids, &(genome_arguments->mem))) {
+        exit(EXIT_FAILURE);
+    }
+
+    // the keys are no longer needed once they have their IDs
+    mem_free(&(genome_arguments->mem), genome_arguments->cores, genome_arguments->cores_capacity * key_size(genome_arguments->key));
+    genome_arguments->cores = NULL;
+    genome_arguments->cores_capacity = 0;
+
+    radix_sort_32(ids, len, 24);
+
+    if (!bitmap_build(&(genome_arguments->ids), &(genome_arguments->mem), ids, len)) {
+        log1(ERROR, "Memory allocation failed for the bitmap of %s", genome_arguments->shortName);
+        exit(EXIT_FAILURE);
+    }
+
+    mem_free(&(genome_arguments->mem), ids, (len ? len : 1) * sizeof(uint32_t));
+
+    genome_arguments->stats.ns[STAGE_ENCODE] += stats_now() - start;
+}
+
+void compressSign(struct gargs *genome_arguments) {
+
+    uint64_t start = stats_now();
+
+    mem_stage(&(genome_arguments->mem), STAGE_ENCODE);
+
+    if (!blocksig_build(&(genome_arguments->blocks), &(genome_arguments->mem), genome_arguments->cores, genome_arguments->cores_len, key_size(genome_arguments->key))) {
+        log1(ERROR, "Memory allocation failed for compressing the signature of %s", genome_arguments->shortName);
+        exit(EXIT_FAILURE);
+    }
+
+    mem_free(&(genome_arguments->mem), genome_arguments->cores, genome_arguments->cores_capacity * key_size(genome_arguments->key));
+    genome_arguments->cores = NULL;
+    genome_arguments->cores_capacity = 0;
+
+    genome_arguments->stats.ns[STAGE_ENCODE] += stats_now() - start;
+}
+
+void partitionSign(struct gargs *genome_arguments, const uint64_t *splitters) {
+
+    uint32_t partitions = genome_arguments->partitions;
+    uint64_t len = genome_arguments->cores_len;
+
+    uint64_t *offsets = (uint64_t *)mem_malloc(&(genome_arguments->mem), (partitions + 1) * sizeof(uint64_t));
+    if (offsets == NULL) {
+        log1(ERROR, "Memory allocation failed for the partitions of %s", genome_arguments->shortName);
+        exit(EXIT_FAILURE);
+    }
+
+    // the keys of a bucket are contiguous in the sorted signature
+    offsets[0] = 0;
+    for (uint32_t p=1; p<partitions; p++) {
+        offsets[p] = genome_arguments->key == KEY_CORE ? lower_bound_64((const uint64_t *)genome_arguments->cores, len, splitters[p-1]) : 
+            lower_bound_32((const uint32_t *)genome_arguments->cores, len, splitters[p-1]);
+    }
+    offsets[partitions] = len;
+
+    genome_arguments->partition_offsets = offsets;
+}
+
+void partitionSignatures(struct gargs *genome_arguments, int n) {
+
+    uint32_t partitions = genome_arguments[0].partitions;
+    uint64_t samples = (uint64_t)partitions * PARTITION_SAMPLES;
+    uint64_t total = 0;
+
+    for (int i=0; i<n; i++) {
+        total += genome_arguments[i].cores_len;
+    }
+
+    // every signature adds at most one sample more than its share
+    uint64_t *keys = (uint64_t *)malloc((samples + n) * sizeof(uint64_t));
+    uint64_t *splitters = (uint64_t *)malloc(partitions * sizeof(uint64_t));
+    if (keys == NULL || splitters == NULL) {
+        log1(ERROR, "Memory allocation failed for the partitions of the signatures.");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t count = 0;
+    for (int i=0; i<n && total; i++) {
+        const struct gargs *g = genome_arguments + i;
+        uint64_t share = (samples * g->cores_len + total - 1) / total;
+        for (uint64_t s=0; s<share; s++) {
+            uint64_t index = (s * 2 + 1) * g->cores_len / (share * 2);
+            keys[count++] = g->key == KEY_CORE ? ((const uint64_t *)g->cores)[index] : ((const uint32_t *)g->cores)[index];
+        }
+    }
+
+    radix_sort_64(keys, count, 56);
+
+    for (uint32_t p=1; p<partitions; p++) {
+        splitters[p-1] = count ? keys[p * count / partitions] : 0;
+    }
+
+    for (int i=0; i<n; i++) {
+        partitionSign(genome_arguments + i, splitters);
+    }
+
+    free(keys);
+    free(splitters);
+}
+
+void packSign(struct gargs *genome_arguments) {
+    if (genome_arguments->dict != NULL) {
+        encodeSign(genome_arguments);
+    } else if (genome_arguments->compress) {
+        compressSign(genome_arguments);
+    }
+}
+
+void encodeRange(void *arg, size_t begin, size_t end) {
+    struct gargs *genome_arguments = (struct gargs *)arg;
+    for (size_t i=begin; i<end; i++) {
+        packSign(genome_arguments + i);
+    }
+}
+
+void encodeSignatures(struct gargs *genome_arguments, const struct pargs *program_arguments) {
+
+    struct tpool *tm = tpool_create_ex(program_arguments->thread_number, program_arguments->pin ? TPOOL_PIN : 0);
+    if (tm == NULL) {
+        log1(ERROR, "Could not start the threads of the pool.");
+        exit(EXIT_FAILURE);
+    }
+
+    // encoding time is charged to the genomes
+    tpool_parallel_for(tm, 0, program_arguments->number_of_genomes, 1, encodeRange, genome_arguments);
+    tpool_destroy(tm);
 }
 
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
-// MARK: File I/O operations
+// MARK: Scheduling
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
 
-void save(FILE *out, struct lps *str) {
-    int isDone = 0;
+struct pipeline {
+    struct gargs *genome_arguments;
+    int n;
+    double *dice;
+    double *jaccard;
+    double *jukes_cantor;
+    struct tpool *tm;
+    // genomes in the order their signatures were done
+    pthread_mutex_t mutex;
+    int *ready;
+    int ready_count;
+    uint64_t start;
+    // signature bytes read by a worker on another node than the signature
+    _Atomic uint64_t remote_bytes;
+    _Atomic uint64_t total_bytes;
+};
 
-    // notify that there is an output to be written
-    fwrite(&isDone, sizeof(int), 1, out);
+struct pipeline_row {
+    struct pipeline *pipeline;
+    int i;
+};
 
-    // write lps object
-    write_lps(str, out);
+struct genome_task {
+    thread_func_t func;
+    struct gargs *genome_arguments;
+    struct pipeline *pipeline; // NULL if distances are calculated afterwards
+};
+
+void calcPipelineRange(void *arg, size_t begin, size_t end) {
+
+    struct pipeline_row *row = (struct pipeline_row *)arg;
+    struct pipeline *pipeline = row->pipeline;
+    const struct gargs *genome_arguments = pipeline->genome_arguments;
+    size_t n = pipeline->n;
+    int node = tpool_current_node();
+    uint64_t remote_bytes = 0;
+    uint64_t total_bytes = 0;
+    uint64_t start = stats_now();
+
+    for (size_t k=begin; k<end; k++) {
+        // keep the argument order of calcDistances so that results are identical
+        size_t i = row->i < pipeline->ready[k] ? row->i : pipeline->ready[k];
+        size_t j = row->i < pipeline->ready[k] ? pipeline->ready[k] : row->i;
+
+        double diceDist, jaccardDist, jukesCantorDist;
+        calcPairDistances(pipeline->tm, &(genome_arguments[i]), &(genome_arguments[j]), &diceDist, &jaccardDist, &jukesCantorDist);
+
+        pipeline->dice[i*n+j] = pipeline->dice[j*n+i] = diceDist;
+        pipeline->jaccard[i*n+j] = pipeline->jaccard[j*n+i] = jaccardDist;
+        pipeline->jukes_cantor[i*n+j] = pipeline->jukes_cantor[j*n+i] = jukesCantorDist;
+
+        if (node >= 0) {
+            uint64_t bytes_i = signature_bytes(&(genome_arguments[i]));
+            uint64_t bytes_j = signature_bytes(&(genome_arguments[j]));
+            remote_bytes += genome_arguments[i].numa_node != node ? bytes_i : 0;
+            remote_bytes += genome_arguments[j].numa_node != node ? bytes_j : 0;
+            total_bytes += bytes_i + bytes_j;
+        }
+    }
+
+    stats_add(STAGE_DISTANCE, stats_now() - start);
+    atomic_fetch_add_explicit(&(run_stats.pairs), end-begin, memory_order_relaxed);
+    progress_add(&(progress.pairs), end-begin);
+
+    if (total_bytes) {
+        atomic_fetch_add_explicit(&(pipeline->remote_bytes), remote_bytes, memory_order_relaxed);
+        atomic_fetch_add_explicit(&(pipeline->total_bytes), total_bytes, memory_order_relaxed);
+    }
 }
 
-void done(FILE *out) {
-    int isDone = 1;
+void pipeline_ready(struct genome_task *task) {
 
-    // notify that there will be no output after this
-    fwrite(&isDone, sizeof(int), 1, out);
+    struct pipeline *pipeline = task->pipeline;
+    int i = (int)(task->genome_arguments - pipeline->genome_arguments);
+
+    pthread_mutex_lock(&(pipeline->mutex));
+    int rank = pipeline->ready_count++;
+    pipeline->ready[rank] = i;
+    pthread_mutex_unlock(&(pipeline->mutex));
+
+    if (rank == pipeline->n - 1) {
+        run_stats.signatures_ns = stats_now() - pipeline->start;
+        progress_switch(PROGRESS_DISTANCES);
+    }
+
+    // every pair is compared by the genome whose signature was done later. Unlike 
+    // calcDistances, rows need no bucketing by node: the row of a genome starts on 
+    // the worker that just generated its signature on its own node, and idle workers 
+    // of the same node take parts of it before the ones of other nodes do
+    struct pipeline_row row = {pipeline, i};
+    tpool_parallel_for(pipeline->tm, 0, rank, 0, calcPipelineRange, &row);
+}
+
+void run_genome_task(void *arg) {
+    struct genome_task *task = (struct genome_task *)arg;
+    uint64_t start = stats_now();
+
+    // the signature is first touched by this thread, so it lives on its node
+    task->genome_arguments->numa_node = tpool_current_node();
+
+    task->func(task->genome_arguments);
+
+    // a signature missing cores would give wrong distances
+    if (task->genome_arguments->failed) {
+        log1(ERROR, "Could not generate the signature of %s", task->genome_arguments->inFileName);
+        exit(EXIT_FAILURE);
+    }
+
+    // signatures are encoded before they are compared
+    packSign(task->genome_arguments);
+
+    task->genome_arguments->work_seconds = (stats_now() - start) / 1e9;
+    progress_add(&(progress.genomes), 1);
+
+    if (task->pipeline != NULL) {
+        pipeline_ready(task);
+    }
+}
+
+/**
+ * Orders genome tasks by decreasing estimated work.
+ */
+static int compare_task_work_desc(const void *a, const void *b) {
+    uint64_t wa = ((const struct genome_task *)a)->genome_arguments->work_estimate;
+    uint64_t wb = ((const struct genome_task *)b)->genome_arguments->work_estimate;
+    return (wa < wb) - (wa > wb);
+}
+
+int compare_work_desc(const void *a, const void *b) {
+    uint64_t wa = (*(const struct gargs **)a)->work_estimate;
+    uint64_t wb = (*(const struct gargs **)b)->work_estimate;
+    return (wa < wb) - (wa > wb);
+}
+
+uint64_t get_file_size(const char *filename) {
+    struct stat st;
+
+    if (stat(filename, &st) != 0) {
+        return 0;
+    }
+
+    return st.st_size;
+}
+
+int is_stream_input(const char *filename) {
+    struct stat st;
+
+    if (strcmp(filename, STDIN_INPUT) == 0) {
+        return 1;
+    }
+
+    return stat(filename, &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+uint64_t estimate_input_size(const char *filename) {
+    uint64_t size = get_file_size(filename);
+    size_t len = strlen(filename);
+
+    if (len > 3 && strcmp(filename + len - 3, ".gz") == 0) {
+        size *= COMPRESSION_RATIO;
+    }
+    if (len > 5 && strcmp(filename + len - 5, ".2bit") == 0) {
+        size *= 4; // bases per byte
+    }
+
+    return size;
+}
+
+void schedule_genomes(struct gargs *genome_arguments, struct pargs *program_arguments, thread_func_t func, struct pipeline *pipeline) {
+
+    int n = program_arguments->number_of_genomes;
+
+    struct genome_task *tasks = (struct genome_task *)malloc(n * sizeof(struct genome_task));
+    if (tasks == NULL) {
+        log1(ERROR, "Memory allocation failed for genome tasks.");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t bytes_total = 0;
+
+    for (int i=0; i<n; i++) {
+        genome_arguments[i].work_estimate = estimate_input_size(genome_arguments[i].inFileName);
+        bytes_total += get_file_size(genome_arguments[i].inFileName);
+        tasks[i].func = func;
+        tasks[i].genome_arguments = genome_arguments + i;
+        tasks[i].pipeline = pipeline;
+    }
+
+    // workers start on the first tasks while the others are still being queued,
+    // so tasks are queued in the order of the priorities as well
+    qsort(tasks, n, sizeof(struct genome_task), compare_task_work_desc);
+
+    progress_begin(PROGRESS_SIGNATURES, n, bytes_total, 0);
+
+    struct tpool *tm;
+
+    tm = tpool_create_ex(program_arguments->thread_number, program_arguments->pin ? TPOOL_PIN : 0);
+    if (tm == NULL) {
+        log1(ERROR, "Could not start the threads of the pool.");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t start = stats_now();
+
+    if (pipeline != NULL) {
+        pipeline->tm = tm;
+        pipeline->start = start;
+    }
+
+    // the priority queue of the pool starts the largest genomes first
+    for (int i=0; i<n; i++) {
+        if (!tpool_add_work_prio(tm, run_genome_task, tasks+i, tasks[i].genome_arguments->work_estimate)) {
+            log1(ERROR, "Could not submit the genome %s to the pool.", tasks[i].genome_arguments->inFileName);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    tpool_wait(tm);
+
+    // with a pipeline, the signatures are done when the last one is ready
+    if (pipeline == NULL) {
+        run_stats.signatures_ns = stats_now() - start;
+    }
+    double makespan = run_stats.signatures_ns / 1e9;
+
+    tpool_destroy(tm);
+    free(tasks);
+
+    if (!genome_arguments[0].verbose || n == 0) {
+        return;
+    }
+
+    // simulate the LPT schedule on the estimated work to get the expected makespan
+    struct gargs **order = (struct gargs **)malloc(n * sizeof(struct gargs *));
+    double *loads = (double *)calloc(program_arguments->thread_number, sizeof(double));
+    if (order == NULL || loads == NULL) {
+        free(order);
+        free(loads);
+        return;
+    }
+
+    double total_work = 0.0;
+    double total_seconds = 0.0;
+
+    for (int i=0; i<n; i++) {
+        order[i] = genome_arguments + i;
+        total_work += genome_arguments[i].work_estimate;
+        total_seconds += genome_arguments[i].work_seconds;
+    }
+
+    qsort(order, n, sizeof(struct gargs *), compare_work_desc);
+
+    for (int i=0; i<n; i++) {
+        int min = 0;
+        for (int t=1; t<program_arguments->thread_number; t++) {
+            if (loads[t] < loads[min]) {
+                min = t;
+            }
+        }
+        loads[min] += order[i]->work_estimate;
+    }
+
+    double max_load = 0.0;
+    for (int t=0; t<program_arguments->thread_number; t++) {
+        max_load = loads[t] > max_load ? loads[t] : max_load;
+    }
+
+    // convert estimated work to seconds with the throughput observed in this run
+    double seconds_per_unit = total_work > 0 ? total_seconds / total_work : 0.0;
+
+    log1(INFO, "Expected makespan: %.2fs, actual makespan: %.2fs, total work: %.2fs on %d threads", 
+        max_load * seconds_per_unit, makespan, total_seconds, program_arguments->thread_number);
+
+    free(order);
+    free(loads);
+}
+
+void run_genomes(struct gargs *genome_arguments, struct pargs *program_arguments, thread_func_t func) {
+
+    schedule_genomes(genome_arguments, program_arguments, func, NULL);
+}
+
+void calcPipelinedDistances(struct gargs *genome_arguments, struct pargs *program_arguments, thread_func_t func) {
+
+    log1(INFO, "Calculating signatures and distance matrices...");
+
+    uint64_t start = stats_now();
+    int n = program_arguments->number_of_genomes;
+
+    struct pipeline pipeline;
+    pipeline.genome_arguments = genome_arguments;
+    pipeline.n = n;
+    pipeline.dice = (double *)calloc((size_t)n * n, sizeof(double));
+    pipeline.jaccard = (double *)calloc((size_t)n * n, sizeof(double));
+    pipeline.jukes_cantor = (double *)calloc((size_t)n * n, sizeof(double));
+    pipeline.ready = (int *)malloc(n * sizeof(int));
+    pipeline.ready_count = 0;
+    pthread_mutex_init(&(pipeline.mutex), NULL);
+    atomic_init(&(pipeline.remote_bytes), 0);
+    atomic_init(&(pipeline.total_bytes), 0);
+
+    if (pipeline.dice == NULL || pipeline.jaccard == NULL || pipeline.jukes_cantor == NULL || pipeline.ready == NULL) {
+        log1(ERROR, "Memory allocation failed for distance matrices.");
+        exit(EXIT_FAILURE);
+    }
+
+    // pairs are counted while the signatures are generated
+    progress_begin(PROGRESS_DISTANCES, 0, 0, (uint64_t)n * (n-1) / 2);
+
+    schedule_genomes(genome_arguments, program_arguments, func, &pipeline);
+
+    // only the part after the last signature is reported as distance time
+    run_stats.distances_ns = stats_now() - start - run_stats.signatures_ns;
+
+    if (genome_arguments[0].verbose && program_arguments->pin) {
+        uint64_t total_bytes = atomic_load(&(pipeline.total_bytes));
+        uint64_t remote_bytes = atomic_load(&(pipeline.remote_bytes));
+        log1(INFO, "Cross-node signature traffic: %.2f MB of %.2f MB (%.2f%%)", 
+            remote_bytes / 1048576.0, total_bytes / 1048576.0, total_bytes ? 100.0 * remote_bytes / total_bytes : 0.0);
+    }
+
+    pthread_mutex_destroy(&(pipeline.mutex));
+    free(pipeline.ready);
+
+    writeGenomeMatrices(genome_arguments, program_arguments, pipeline.dice, pipeline.jaccard, pipeline.jukes_cantor);
 }
 
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
-// MARK: Logging
+// MARK: File I/O operations
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
 
-int log1(LogLevel level, const char *format, ...) {
-    time_t now;
-    time(&now);
-    struct tm *local = localtime(&now);
-    printf("[%02d-%02d-%04d %02d:%02d:%02d] ", local->tm_mday, local->tm_mon + 1, local->tm_year + 1900,
-           local->tm_hour, local->tm_min, local->tm_sec);
+void save(FILE *out, struct lps *str) {
+    int isDone = 0;
 
-    switch (level) {
-        case INFO:
-            printf("[INFO] ");
-            break;
-        case WARN:
-            printf("[WARN] ");
-            break;
-        case ERROR:
-            printf("[ERROR] ");
-            break;
-    }
+    // notify that there is an output to be written
+    fwrite(&isDone, sizeof(int), 1, out);
 
-    va_list args;
-    va_start(args, format);
-    vprintf(format, args);
-    va_end(args);
+    // write lps object
+    write_lps(str, out);
+}
 
-    printf("\n");
+void done(FILE *out) {
+    int isDone = 1;
 
-    return 1;
+    // notify that there will be no output after this
+    fwrite(&isDone, sizeof(int), 1, out);
 }
 
 // ---------------------------------------------------------------------------------
@@ -321,12 +1088,24 @@ int log1(LogLevel level, const char *format, ...) {
 
 void free_args(struct gargs * genome_arguments, struct pargs * program_arguments) {
 
+    struct coredict *dict = program_arguments->number_of_genomes ? genome_arguments[0].dict : NULL;
+
     for (int i=0; i<program_arguments->number_of_genomes; i++) {
-        if (genome_arguments[i].cores_len) {
-            if (genome_arguments[i].cores_len)
-                free(genome_arguments[i].cores);
-            genome_arguments[i].cores_len = 0;
-        }
+        mem_free(&(genome_arguments[i].mem), genome_arguments[i].cores, genome_arguments[i].cores_capacity * key_size(genome_arguments[i].key));
+        bitmap_free(&(genome_arguments[i].ids), &(genome_arguments[i].mem));
+        blocksig_free(&(genome_arguments[i].blocks), &(genome_arguments[i].mem));
+        mem_free(&(genome_arguments[i].mem), genome_arguments[i].partition_offsets, (genome_arguments[i].partitions + 1) * sizeof(uint64_t));
+        mem_free(&(genome_arguments[i].mem), genome_arguments[i].cc_hist, CC_HIST_BINS * sizeof(uint64_t));
+        genome_arguments[i].partition_offsets = NULL;
+        genome_arguments[i].cc_hist = NULL;
+        genome_arguments[i].cores = NULL;
+        genome_arguments[i].cores_len = 0;
+        genome_arguments[i].cores_capacity = 0;
+    }
+
+    if (dict != NULL) {
+        coredict_free(dict);
+        free(dict);
     }
 
     free(genome_arguments);
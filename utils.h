@@ -2,12 +2,17 @@
 #define UTILS_H
 
 #include "args.h"
+#include "tpool.h"
 #include "lps.h"
+#include "dict.h"
+#include "bitmap.h"
+#include "blocksig.h"
 #include <stdio.h>
 #include <time.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <math.h>
+#include <sys/stat.h>
 
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
@@ -20,7 +25,10 @@
  * 
  * This function computes the intersection and union sizes between the `cores` vectors 
  * in two thread-specific argument structures (`argument1` and `argument2`). It performs the calculations 
- * based on a set-based mode.
+ * based on a set-based mode. Both signatures must have the same key type. Signatures 
+ * encoded with a core dictionary are intersected on their bitmaps (see `bitmap_and_count`), 
+ * compressed ones on their blocks (see `blocksig_and_count`). Partitioned signatures 
+ * are merged bucket by bucket, so that both buckets of a merge fit in cache.
  * 
  * @param argument1 A constant reference to the `gargs` structure representing the first set of LCP cores 
  *        and counts for comparison.
@@ -31,6 +39,23 @@
  */
 void calcUISize(const struct gargs *argument1, const struct gargs *argument2, uint64_t *interSize, uint64_t *unionSize);
 
+/**
+ * @brief Calculates the intersection and union sizes like `calcUISize`, merging 
+ *        the buckets of partitioned signatures on a thread pool.
+ *
+ * The buckets of a pair are independent, so a single pair of large signatures 
+ * is compared by several threads. Pairs of fewer than `PARALLEL_PAIR_CORES` 
+ * cores and signatures that are not partitioned are compared by the calling 
+ * thread, as the rows of the distance matrices already keep the pool busy.
+ *
+ * @param tm Pointer to the thread pool, NULL to compare on the calling thread.
+ * @param argument1 Pointer to the genome arguments holding the first signature.
+ * @param argument2 Pointer to the genome arguments holding the second signature.
+ * @param interSize A reference to the variable where the computed size of the intersection will be stored.
+ * @param unionSize A reference to the variable where the computed size of the union will be stored.
+ */
+void calcUISizeParallel(struct tpool *tm, const struct gargs *argument1, const struct gargs *argument2, uint64_t *interSize, uint64_t *unionSize);
+
 /**
  * @brief Calculates the Jaccard similarity between two genomes.
  *
@@ -82,11 +107,26 @@ double calcHammDist(double jaccardSim, double avgLen);
  */
 double calcJukesCantorCor(double hammingDist);
 
+/**
+ * @brief Calculates the Dice, Jaccard and Jukes-Cantor distances of two signatures.
+ *
+ * @param tm Pointer to the thread pool partitioned signatures are merged on, 
+ *        NULL to compare on the calling thread (see `calcUISizeParallel`).
+ * @param argument1 Pointer to the genome arguments holding the first signature.
+ * @param argument2 Pointer to the genome arguments holding the second signature.
+ * @param dice Pointer to store the Dice distance.
+ * @param jaccard Pointer to store the Jaccard distance.
+ * @param jukes_cantor Pointer to store the Jukes-Cantor corrected distance.
+ */
+void calcPairDistances(struct tpool *tm, const struct gargs *argument1, const struct gargs *argument2, double *dice, double *jaccard, double *jukes_cantor);
+
 /**
  * @brief Computes and writes distance matrices for genome comparisons.
  *
  * This function calculates pairwise distance matrices (Dice, Jaccard, and 
- * Jukes-Cantor) for the given genomes using their cores and lengths. It writes 
+ * Jukes-Cantor) for the given genomes using their cores and lengths. Rows of 
+ * the matrices are claimed dynamically by the workers, which prefer rows whose 
+ * signatures were allocated on their own NUMA node. It writes 
  * the resulting matrices to output files with filenames based on the program 
  * prefix, genome type, and LCP level.
  *
@@ -98,17 +138,87 @@ double calcJukesCantorCor(double hammingDist);
  */
 void calcDistances(const struct gargs *genome_arguments, const struct pargs* program_arguments);
 
+/**
+ * @brief Writes the distance matrices of the genomes and frees them.
+ *
+ * @param genome_arguments Pointer to the array of genome arguments (`gargs`), 
+ *                         whose short names label the rows.
+ * @param program_arguments Pointer to the program arguments (`pargs`).
+ * @param dice Row-major Dice distance matrix, freed after writing.
+ * @param jaccard Row-major Jaccard distance matrix, freed after writing.
+ * @param jukes_cantor Row-major Jukes-Cantor distance matrix, freed after writing.
+ */
+void writeGenomeMatrices(const struct gargs *genome_arguments, const struct pargs *program_arguments, double *dice, double *jaccard, double *jukes_cantor);
+
+/**
+ * @brief Writes a distance matrix in PHYLIP format.
+ *
+ * @param filename Path of the output file.
+ * @param n Number of genomes.
+ * @param names Short names of the genomes, used as row labels.
+ * @param matrix Row-major `n x n` distance matrix.
+ */
+void writeDistanceMatrix(const char *filename, int n, const char **names, const double *matrix);
+
+/**
+ * @brief Writes the Dice, Jaccard and Jukes-Cantor matrices.
+ *
+ * Filenames are based on the prefix, the distance calculation mode and the 
+ * LCP level, e.g. `gc.set.jaccard.lvl4.phy`.
+ *
+ * @param prefix Prefix of the result files.
+ * @param sct Whether distances were calculated on sets or vectors of cores.
+ * @param lcp_level LCP level of the signatures.
+ * @param n Number of genomes.
+ * @param names Short names of the genomes.
+ * @param dice Row-major Dice distance matrix.
+ * @param jaccard Row-major Jaccard distance matrix.
+ * @param jukes_cantor Row-major Jukes-Cantor distance matrix.
+ */
+void writeDistanceMatrices(const char *prefix, sim_calculation_type sct, int lcp_level, int n, const char **names, const double *dice, const double *jaccard, const double *jukes_cantor);
+
+/**
+ * @brief Writes the core abundance histograms built with `--auto-cc` to `[prefix].cc.hist`.
+ *
+ * Every genome starts with a `#` line holding its short name and the thresholds
+ * applied to it, followed by `count<TAB>cores` lines for the non-empty bins. The
+ * last bin (`CC_HIST_BINS - 1`) holds all higher counts. Genomes loaded from the 
+ * signature cache have no histogram, their `#` line says `cached` instead.
+ *
+ * @param genome_arguments Array of genome arguments.
+ * @param program_arguments Program arguments with the prefix and the number of genomes.
+ * @return 1 on success, 0 if the file could not be written (logged).
+ */
+int writeCCHistograms(const struct gargs *genome_arguments, const struct pargs *program_arguments);
+
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
 // MARK: LCP cores related functions
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
 
+/**
+ * @brief Ensures that the cores array of a genome can hold the given number of cores.
+ *
+ * The array is grown by a factor of 1.5 until it fits, through the tracked 
+ * allocation layer so that the growth is accounted to the genome.
+ *
+ * @param genome_arguments Pointer to the genome arguments owning the cores array.
+ * @param needed The number of cores the array must be able to hold.
+ * @return 1 on success, 0 if the array could not be grown.
+ */
+int reserve_cores(struct gargs *genome_arguments, uint64_t needed);
+
 /**
  * @brief Sorts the provided vector of hash values in ascending order.
  *
  * This function modifies the input vector `hash_values` by sorting it in-place
  * The resulting vector will contain the same values arranged in ascending order.
+ * Sorting, filtering and deduplication are specialized for the key width of 
+ * the genome (see `keykernels.h`); keys are sorted by an in-place radix sort.
+ * With `auto_cc`, the abundance histogram of the cores is counted on the sorted
+ * keys (`cc_hist`) and `min_cc` and `max_cc` are replaced by the thresholds 
+ * picked from it before the keys are filtered.
  *
  * @param genome_arguments A reference to a vector of `gargs` structures
  *        representing the arguments specific to each genome which is needed for cores.
@@ -117,6 +227,155 @@ void calcDistances(const struct gargs *genome_arguments, const struct pargs* pro
  */
 void genSign(struct gargs *genome_arguments, sim_calculation_type mode);
 
+/**
+ * @brief Replaces the keys of a signature by a bitmap of their dictionary IDs.
+ *
+ * The keys are mapped to their IDs in the core dictionary of the genome, 
+ * adding the new ones, and the sorted IDs are stored as a compressed bitmap 
+ * (`ids`). The keys are freed, `cores_len` keeps the size of the signature. 
+ * Exits if memory cannot be allocated.
+ *
+ * @param genome_arguments Pointer to the genome arguments with a signature from `genSign`.
+ */
+void encodeSign(struct gargs *genome_arguments);
+
+/**
+ * @brief Replaces the keys of a signature by their block-compressed form.
+ *
+ * The sorted keys are stored as gaps bit-packed in blocks (`blocks`), and the 
+ * keys are freed. Exits if memory cannot be allocated.
+ *
+ * @param genome_arguments Pointer to the genome arguments with a signature from `genSign`.
+ */
+void compressSign(struct gargs *genome_arguments);
+
+/**
+ * @brief Splits a sorted signature into buckets at the given keys.
+ *
+ * The keys stay where they are: as the signature is sorted, every bucket is 
+ * a contiguous range, and only the offsets of the `partitions` ranges are 
+ * stored (`partition_offsets`). Exits if memory cannot be allocated.
+ *
+ * @param genome_arguments Pointer to the genome arguments with a signature from `genSign`.
+ * @param splitters The first keys of the buckets after the first one, 
+ *        `partitions - 1` sorted values shared by all signatures.
+ */
+void partitionSign(struct gargs *genome_arguments, const uint64_t *splitters);
+
+/**
+ * @brief Splits the signatures of all genomes into buckets with shared boundaries.
+ *
+ * Labels of lcptools are small dense IDs, so the high bits of the keys do not
+ * spread them over buckets. The boundaries are instead picked as quantiles of
+ * `PARTITION_SAMPLES` keys per bucket, sampled evenly from all signatures in
+ * proportion to their sizes, so that all signatures have to be complete. 
+ * Exits if memory cannot be allocated.
+ *
+ * @param genome_arguments Pointer to the array of genome arguments (`gargs`).
+ * @param n Number of genomes.
+ */
+void partitionSignatures(struct gargs *genome_arguments, int n);
+
+/**
+ * @brief Encodes with the core dictionary or compresses a signature, as selected 
+ *        for the genome.
+ *
+ * @param genome_arguments Pointer to the genome arguments with a signature from `genSign`.
+ */
+void packSign(struct gargs *genome_arguments);
+
+/**
+ * @brief Encodes or compresses the signatures of all genomes on a thread pool (see `packSign`).
+ *
+ * Used for signatures that are loaded instead of generated, e.g. by dist.
+ *
+ * @param genome_arguments Pointer to the array of genome arguments (`gargs`).
+ * @param program_arguments Pointer to the program arguments (`pargs`).
+ */
+void encodeSignatures(struct gargs *genome_arguments, const struct pargs *program_arguments);
+
+/**
+ * @brief Bytes of the signature of a genome, as keys, bitmap or compressed blocks.
+ */
+static inline uint64_t signature_bytes(const struct gargs *genome_arguments) {
+    if (genome_arguments->dict != NULL) {
+        return bitmap_bytes(&(genome_arguments->ids));
+    }
+    if (genome_arguments->compress) {
+        return blocksig_bytes(&(genome_arguments->blocks));
+    }
+    return genome_arguments->cores_len * key_size(genome_arguments->key);
+}
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// MARK: Scheduling
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+/**
+ * @brief Returns the size of a file on disk.
+ *
+ * @param filename The name of the file.
+ * @return The size in bytes, 0 if the file cannot be accessed.
+ */
+uint64_t get_file_size(const char *filename);
+
+/**
+ * @brief Checks if an input can only be read once from start to end.
+ *
+ * Standard input (`-`), named pipes and devices have no size known in advance 
+ * and cannot be hashed for the cache without consuming them.
+ *
+ * @param filename The name of the input file.
+ * @return 1 if the input is a stream, 0 if it is a regular file.
+ */
+int is_stream_input(const char *filename);
+
+/**
+ * @brief Estimates the uncompressed size of an input file.
+ *
+ * The size of gzipped inputs (`.gz`) is scaled by `COMPRESSION_RATIO`, the size 
+ * of .2bit inputs by the 4 bases packed into every byte.
+ *
+ * @param filename The name of the input file.
+ * @return The estimated uncompressed size in bytes, 0 if the file cannot be accessed.
+ */
+uint64_t estimate_input_size(const char *filename);
+
+/**
+ * @brief Processes all genomes on a thread pool, largest estimated work first.
+ *
+ * The work of each genome is estimated from its input size, and the genomes are 
+ * submitted to the pool's priority queue in order of decreasing work, so that 
+ * the longest ones are started first (LPT scheduling) even while the workers 
+ * already run the first ones. This prevents a large genome listed last from being 
+ * processed alone while the other threads are idle. In verbose mode, the makespan 
+ * expected from the LPT schedule is reported together with the actual one.
+ *
+ * @param genome_arguments Pointer to the array of genome arguments (`gargs`).
+ * @param program_arguments Pointer to the program arguments (`pargs`).
+ * @param func The function that processes a single genome.
+ */
+void run_genomes(struct gargs *genome_arguments, struct pargs *program_arguments, thread_func_t func);
+
+/**
+ * @brief Generates the signatures and calculates the distances of all genomes in one pipeline.
+ *
+ * Genomes are scheduled like in `run_genomes`. When the signature of a genome 
+ * is done, it is compared on the same pool against every signature that was 
+ * done before it, so a pair is calculated as soon as both of its signatures 
+ * are ready. Distances of the early genomes are computed while the slow ones 
+ * are still being processed, and the wall time gets close to the longer of 
+ * the two phases instead of their sum. The matrices are written like in 
+ * `calcDistances`.
+ *
+ * @param genome_arguments Pointer to the array of genome arguments (`gargs`).
+ * @param program_arguments Pointer to the program arguments (`pargs`).
+ * @param func The function that processes a single genome.
+ */
+void calcPipelinedDistances(struct gargs *genome_arguments, struct pargs *program_arguments, thread_func_t func);
+
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
 // MARK: File I/O operations
@@ -144,26 +403,6 @@ void save(FILE *out, struct lps *str);
  */
 void done(FILE *out);
 
-// ---------------------------------------------------------------------------------
-// ---------------------------------------------------------------------------------
-// MARK: Logging
-// ---------------------------------------------------------------------------------
-// ---------------------------------------------------------------------------------
-
-/**
- * @brief Logs a formatted message with a timestamp and log level.
- *
- * This function prints a log message prefixed with the current timestamp and 
- * the specified log level (INFO, WARN, or ERROR). It uses a `printf`-style 
- * format string and additional arguments for the message content.
- *
- * @param level The log level (INFO, WARN, or ERROR) to categorize the log message.
- * @param format A `printf`-style format string for the log message.
- * @param ... Additional arguments for the format string.
- * @return Always returns 1 upon completion.
- */
-int log1(LogLevel level, const char *format, ...);
-
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
 // MARK: Cleanup
@@ -173,8 +412,9 @@ int log1(LogLevel level, const char *format, ...);
 /**
  * @brief Frees allocated memory for genome and program arguments.
  *
- * This function releases the memory allocated for the `cores` array in each 
- * genome argument within the `genome_arguments` structure. It also resets the 
+ * This function releases the memory allocated for the `cores` array (or the 
+ * bitmap) in each genome argument within the `genome_arguments` structure, and
+ * the core dictionary shared by the genomes. It also resets the 
  * length of the `cores` array (`cores_len`) to 0 to avoid dangling references. 
  * Finally, it frees the entire `genome_arguments` array.
  *